@@ -0,0 +1,217 @@
+// End-to-end benchmark: polls a simulated inverter (on a pseudo-terminal) through the real
+// SerialPort and protocol adapters, publishing to an in-process MQTT stand-in, and reports latency
+// percentiles of every stage.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "configuration.h"
+#include "protocols/protocol_adapter.hh"
+#include "serial_port.hh"
+#include "simulator/pty_link.hh"
+#include "spdlog/spdlog.h"
+#include "stubs.hh"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Latency samples, in microseconds.
+class Samples {
+ public:
+  void Add(Clock::duration duration) {
+    values_.push_back(std::chrono::duration<double, std::micro>(duration).count());
+  }
+
+  /// Writes {"count":..,"p50":..,"p90":..,"p99":..,"max":..} (in microseconds).
+  void WriteJson(std::ostream& out) {
+    std::ranges::sort(values_);
+    out << "{\"count\": " << values_.size();
+    for (const auto& [name, percentile] : {std::pair{"p50", 50}, {"p90", 90}, {"p99", 99}}) {
+      out << ", \"" << name << "\": " << GetPercentile(percentile);
+    }
+    out << ", \"max\": " << (values_.empty() ? 0 : values_.back()) << "}";
+  }
+
+ private:
+  /// Nearest-rank percentile of the sorted values.
+  double GetPercentile(int percentile) const {
+    if (values_.empty()) return 0;
+    const auto rank = (percentile * values_.size() + 99) / 100;
+    return values_[std::max<std::size_t>(rank, 1) - 1];
+  }
+
+  std::vector<double> values_;
+};
+
+/// Collects the timestamps of the stages every reply goes through.
+class Timeline {
+ public:
+  void OnQueryStarted(std::string_view command) {
+    FinishHandling(Clock::now());
+    round_trip_start_ = Clock::now();
+    command_ = command;
+  }
+
+  /// The transport delivered the reply (i.e. <cr> has been received and CRC has been checked).
+  void OnReplyReceived() {
+    reply_time_ = Clock::now();
+    stages_[command_].round_trip.Add(*reply_time_ - round_trip_start_);
+  }
+
+  void OnPublished() {
+    if (reply_time_) {
+      reply_to_publish_.Add(Clock::now() - *reply_time_);
+    }
+  }
+
+  void OnCycleFinished(Clock::duration cycle_duration) {
+    FinishHandling(Clock::now());
+    cycles_.Add(cycle_duration);
+  }
+
+  void WriteJson(std::ostream& out) {
+    out << "{\n  \"unit\": \"us\",\n  \"cycle\": ";
+    cycles_.WriteJson(out);
+    out << ",\n  \"reply_to_publish\": ";
+    reply_to_publish_.WriteJson(out);
+    out << ",\n  \"commands\": {";
+    bool first = true;
+    for (auto& [command, stages] : stages_) {
+      out << (first ? "\n" : ",\n") << "    \"" << command << "\": {\"round_trip\": ";
+      stages.round_trip.WriteJson(out);
+      out << ", \"parse\": ";
+      stages.parse.WriteJson(out);
+      out << "}";
+      first = false;
+    }
+    out << "\n  }\n}\n";
+  }
+
+ private:
+  /// Handling of the previous reply (parsing, updating sensors, publishing) is over.
+  void FinishHandling(Clock::time_point now) {
+    if (reply_time_) {
+      stages_[command_].parse.Add(now - *reply_time_);
+      reply_time_.reset();
+    }
+  }
+
+  struct Stages {
+    Samples round_trip;
+    /// From the reply being delivered till the adapter is done with it.
+    Samples parse;
+  };
+
+  std::map<std::string, Stages, std::less<>> stages_;
+  Samples reply_to_publish_;
+  Samples cycles_;
+
+  std::string command_;
+  Clock::time_point round_trip_start_;
+  std::optional<Clock::time_point> reply_time_;
+};
+
+Timeline timeline;
+
+/// Passes queries through, recording their timing.
+class TimingTransport : public Transport {
+ public:
+  explicit TimingTransport(const Transport& transport) : transport_(transport) {}
+
+  std::string Query(std::string_view query, bool with_crc,
+                    std::size_t expected_reply_length) const override {
+    timeline.OnQueryStarted(GetCommandName(query));
+    auto reply = transport_.Query(query, with_crc, expected_reply_length);
+    timeline.OnReplyReceived();
+    return reply;
+  }
+
+ private:
+  const Transport& transport_;
+};
+
+/// The stand-in for the broker: a publish is "acknowledged" as soon as it's made.
+class TimingMqttClient : public bench::StubMqttClient {
+ public:
+  void Publish(const std::string& topic, std::string_view payload, int qos, bool retain) override {
+    StubMqttClient::Publish(topic, payload, qos, retain);
+    timeline.OnPublished();
+  }
+};
+
+void PrintHelp() {
+  std::cout <<
+"USAGE:  ./inverter_e2e_benchmark <options>"
+"\nOPTIONS:"
+"\n    --protocol <PI18|PI30>   Protocol of the simulated inverter (default: PI30)."
+"\n    --cycles <n>             The number of poll cycles (default: 10)."
+"\n    --latency <ms>           Reply latency of the simulated inverter (default: 100)."
+"\n    --baud <rate>            Baud rate of the simulated inverter, 0 for no limit (default: 2400)."
+"\n    --out <file>             Write the results to the file instead of stdout, as JSON."
+"\n    -h | --help              This Help Message."
+"\n    -d                       Enable additional debug logging.\n";
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  CommandLineArguments arguments(argc, argv);
+  if (arguments.IsSet("-h", "--help")) {
+    PrintHelp();
+    return 0;
+  }
+  spdlog::set_level(arguments.IsSet("-d") ? spdlog::level::debug : spdlog::level::warn);
+
+  const auto protocol = arguments.IsSet("--protocol")
+                        ? ProtocolFromString(arguments.Get("--protocol"))
+                        : Protocol::PI30;
+  const auto cycles = arguments.IsSet("--cycles") ? std::stoi(arguments.Get("--cycles")) : 10;
+  simulator::PtyLink::Options options{.link = ""};
+  if (arguments.IsSet("--latency")) {
+    options.latency = std::chrono::milliseconds(std::stoi(arguments.Get("--latency")));
+  }
+  if (arguments.IsSet("--baud")) {
+    options.baud_rate = std::stoi(arguments.Get("--baud"));
+  }
+
+  auto model = simulator::InverterModel::Create(protocol);
+  simulator::PtyLink pty_link(options);
+  std::thread inverter([&] { pty_link.Serve(*model); });
+
+  {
+    MqttClient::Install(std::make_unique<TimingMqttClient>());
+    SerialPort port(pty_link.GetDeviceName(), Settings::Instance().retry_policy);
+    TimingTransport transport(port);
+
+    // The same sequence as in main() of inverter_poller, without waiting between the cycles.
+    auto adapter = DetectProtocol(transport);
+    Settings::SetDeviceSerialNumber(adapter->GetSerialNumber());
+    for (int i = 0; i < cycles; ++i) {
+      const auto start = Clock::now();
+      adapter->GetRatedInfo();
+      adapter->GetStatusInfo();
+      timeline.OnCycleFinished(Clock::now() - start);
+      std::cerr << "Cycle " << i + 1 << '/' << cycles << " is done\n";
+    }
+  }
+
+  pty_link.Stop();
+  inverter.join();
+
+  if (arguments.IsSet("--out")) {
+    std::ofstream file(arguments.Get("--out"));
+    timeline.WriteJson(file);
+  } else {
+    timeline.WriteJson(std::cout);
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+#include "harness.hh"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "configuration.h"
+
+namespace bench {
+namespace {
+
+struct Benchmark {
+  std::string_view name;
+  Function function;
+};
+
+struct Result {
+  std::string_view name;
+  std::size_t iterations;
+  /// Per iteration, median over the repetitions.
+  double real_time_ns;
+  double cpu_time_ns;
+};
+
+std::vector<Benchmark>& GetBenchmarks() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+std::chrono::nanoseconds GetCpuTime() {
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+
+double Median(std::vector<double> values) {
+  std::ranges::sort(values);
+  return values[values.size() / 2];
+}
+
+Result Run(const Benchmark& benchmark, std::chrono::milliseconds min_time, int repetitions) {
+  using Clock = std::chrono::steady_clock;
+
+  // Find out how many iterations take at least min_time.
+  std::size_t iterations = 1;
+  while (true) {
+    const auto start = Clock::now();
+    benchmark.function(iterations);
+    const auto elapsed = Clock::now() - start;
+    if (elapsed >= min_time || iterations >= (1ull << 40)) break;
+    // Aim a bit above min_time, but don't grow too fast because of a too short first run.
+    const auto ratio = elapsed.count() ? 1.4 * min_time / elapsed : 10.0;
+    iterations = static_cast<std::size_t>(iterations * std::clamp(ratio, 2.0, 10.0));
+  }
+
+  std::vector<double> real_times;
+  std::vector<double> cpu_times;
+  for (int i = 0; i < repetitions; ++i) {
+    const auto cpu_start = GetCpuTime();
+    const auto start = Clock::now();
+    benchmark.function(iterations);
+    const std::chrono::duration<double, std::nano> real_time = Clock::now() - start;
+    const std::chrono::duration<double, std::nano> cpu_time = GetCpuTime() - cpu_start;
+    real_times.push_back(real_time.count() / iterations);
+    cpu_times.push_back(cpu_time.count() / iterations);
+  }
+  return {benchmark.name, iterations, Median(real_times), Median(cpu_times)};
+}
+
+void WriteJson(std::ostream& out, const std::vector<Result>& results) {
+  char date[32];
+  const auto now = std::time(nullptr);
+  std::strftime(date, std::size(date), "%FT%T%z", std::localtime(&now));
+  char host_name[256] = "";
+  gethostname(host_name, std::size(host_name) - 1);
+
+  out << "{\n  \"context\": {\n";
+  out << "    \"date\": \"" << date << "\",\n";
+  out << "    \"host_name\": \"" << host_name << "\",\n";
+  out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "\n";
+  out << "  },\n  \"benchmarks\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << result.name << "\", "
+        << "\"run_type\": \"iteration\", "
+        << "\"iterations\": " << result.iterations << ", "
+        << "\"real_time\": " << result.real_time_ns << ", "
+        << "\"cpu_time\": " << result.cpu_time_ns << ", "
+        << "\"time_unit\": \"ns\"}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void PrintHelp() {
+  std::cout <<
+"USAGE:  ./inverter_benchmarks <options>"
+"\nOPTIONS:"
+"\n    --filter <substring>     Run only the benchmarks with the substring in their names."
+"\n    --min-time <ms>          Minimal duration of a single repetition (default: 200)."
+"\n    --repetitions <n>        The reported time is the median of the repetitions (default: 5)."
+"\n    --out <file>             Write the results to the file instead of stdout, as JSON."
+"\n    -h | --help              This Help Message.\n";
+}
+
+}  // namespace
+
+
+bool Register(std::string_view name, Function function) {
+  GetBenchmarks().push_back({name, function});
+  return true;
+}
+
+int RunAll(int argc, char* argv[]) {
+  CommandLineArguments arguments(argc, argv);
+  if (arguments.IsSet("-h", "--help")) {
+    PrintHelp();
+    return 0;
+  }
+  const auto filter = arguments.IsSet("--filter") ? arguments.Get("--filter") : "";
+  const auto min_time = std::chrono::milliseconds(
+      arguments.IsSet("--min-time") ? std::stoi(arguments.Get("--min-time")) : 200);
+  const auto repetitions = std::max(
+      1, arguments.IsSet("--repetitions") ? std::stoi(arguments.Get("--repetitions")) : 5);
+
+  std::vector<Result> results;
+  for (const auto& benchmark : GetBenchmarks()) {
+    if (benchmark.name.find(filter) == std::string_view::npos) continue;
+    const auto& result = results.emplace_back(Run(benchmark, min_time, repetitions));
+    // Human-readable progress goes to stderr, so stdout is pure JSON.
+    std::cerr << result.name << ": " << result.real_time_ns << " ns, " << result.iterations
+              << " iterations\n";
+  }
+
+  if (arguments.IsSet("--out")) {
+    std::ofstream file(arguments.Get("--out"));
+    WriteJson(file, results);
+  } else {
+    WriteJson(std::cout, results);
+  }
+  return 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/// A tiny benchmarking harness. Google Benchmark would be an overkill (and yet another submodule)
+/// for a handful of microbenchmarks, but its JSON output format is kept, so its tools (e.g.
+/// compare.py) work with the results.
+///
+/// Usage:
+///   BENCHMARK(Something) {
+///     for (std::size_t i = 0; i < iterations; ++i) {
+///       bench::DoNotOptimize(DoSomething());
+///     }
+///   }
+namespace bench {
+
+using Function = void (*)(std::size_t iterations);
+
+/// @returns true, so it could be used to initialize a static variable.
+bool Register(std::string_view name, Function);
+
+/// Run the registered benchmarks according to the command line options.
+/// @returns the exit code.
+int RunAll(int argc, char* argv[]);
+
+/// Prevents the compiler from optimizing away the computation of @a value.
+template<typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}  // namespace bench
+
+#define BENCHMARK(name)                                                   \
+  static void name(std::size_t iterations);                               \
+  [[maybe_unused]] static const bool name##_registered =                  \
+      bench::Register(#name, &name);                                      \
+  static void name(std::size_t iterations)
@@ -0,0 +1,201 @@
+// Benchmarks of the path every reply takes: CRC check -> parsing -> sensors update -> publishing.
+
+#include <string>
+
+#include "frame.hh"
+#include "harness.hh"
+#include "mqtt/sensor.hh"
+#include "mqtt/sensors.hh"
+#include "protocols/pi18_protocol_adapter.hh"
+#include "protocols/pi30_protocol_adapter.hh"
+#include "stubs.hh"
+#include "utils.h"
+
+namespace {
+
+// Real replies (without the prefix that is stripped before the handlers get them) and slightly
+// different ones, to force sensors to publish.
+const std::string kPi30GeneralStatus[] = {
+    "230.0 50.0 229.9 50.0 0322 0250 006 398 52.50 004 095 0038 02.4 358.2 52.50 00000 00010110 "
+    "00 00 00858 010",
+    "231.2 49.9 230.1 50.0 0345 0271 007 399 52.60 006 096 0039 02.9 361.0 52.60 00000 00010110 "
+    "00 00 01034 010",
+};
+const std::string kPi30RatingInformation =
+    "230.0 21.7 230.0 50.0 21.7 5000 4000 48.0 46.0 42.0 56.4 54.0 0 30 060 0 1 1 9 01 0 0 54.0 0 "
+    "1 120";
+const std::string kPi18GeneralStatus[] = {
+    "2292,499,2300,500,1004,0913,020,505,505,000,000,023,042,034,036,000,2105,0000,3431,0000,0,2,0,"
+    "1,1,2,1,0",
+    "2301,500,2300,500,1104,1013,022,507,507,000,000,025,043,035,037,000,2255,0000,3455,0000,0,2,0,"
+    "1,1,2,1,0",
+};
+const std::string kPi18RatedInformation =
+    "882300,217,2300,500,217,5000,5000,480,460,540,420,564,540,0,060,120,0,1,1,9,0,0,0,1,1,0";
+
+// The whole reply frame, including CRC and <cr>.
+std::string GetFrame(std::string_view payload) {
+  std::string frame(payload);
+  frame += frame::GetCRC(frame);
+  frame += '\r';
+  return frame;
+}
+
+bench::StubMqttClient& InstallStubMqttClient() {
+  static auto* client = [] {
+    auto stub = std::make_unique<bench::StubMqttClient>();
+    auto* result = stub.get();
+    MqttClient::Install(std::move(stub));
+    return result;
+  }();
+  return *client;
+}
+
+bench::FakeTransport& GetFakeTransport() {
+  static bench::FakeTransport transport({
+      {"QPIGS", "(" + kPi30GeneralStatus[0]},
+      {"QMOD", "(B"},
+      {"QPIWS", "(" + std::string(32, '0')},
+      {"^P005GS", "^D106" + kPi18GeneralStatus[0]},
+      {"^P005ET", "^D01100012345"},
+      {"^P006MOD", "^D00505"},
+      {"^P007FLAG", "^D0200,0,0,0,0,1,0,0,0"},
+      {"^P005FWS", "^D03700,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0"},
+  });
+  return transport;
+}
+
+/// Exposes the reply handlers.
+class Pi30Adapter : public Pi30ProtocolAdapter {
+ public:
+  Pi30Adapter() : Pi30ProtocolAdapter(GetFakeTransport()) { InstallStubMqttClient(); }
+  using Pi30ProtocolAdapter::HandleGeneralStatus;
+  using Pi30ProtocolAdapter::HandleRatingInformation;
+};
+
+class Pi18Adapter : public Pi18ProtocolAdapter {
+ public:
+  Pi18Adapter() : Pi18ProtocolAdapter(GetFakeTransport()) { InstallStubMqttClient(); }
+  using Pi18ProtocolAdapter::HandleGeneralStatus;
+  using Pi18ProtocolAdapter::HandleRatedInformation;
+};
+
+}  // namespace
+
+
+BENCHMARK(GetCRC) {
+  const auto frame = GetFrame("^D106" + kPi18GeneralStatus[0]);
+  const std::string_view payload(frame.data(), frame.length() - 3);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::DoNotOptimize(frame::GetCRC(payload));
+  }
+}
+
+BENCHMARK(CheckCRC) {
+  const auto frame = GetFrame("^D106" + kPi18GeneralStatus[0]);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::DoNotOptimize(frame::CheckCRC(frame));
+  }
+}
+
+BENCHMARK(FindFrameStart) {
+  const auto frame = "\x9f\x01" + GetFrame("^D106" + kPi18GeneralStatus[0]);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::DoNotOptimize(frame::FindFrameStart(frame));
+  }
+}
+
+BENCHMARK(Pi30_GeneralStatus_Unchanged) {
+  static Pi30Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.HandleGeneralStatus(kPi30GeneralStatus[0]);
+  }
+}
+
+BENCHMARK(Pi30_GeneralStatus_Changed) {
+  static Pi30Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.HandleGeneralStatus(kPi30GeneralStatus[i % 2]);
+  }
+}
+
+BENCHMARK(Pi30_RatingInformation) {
+  static Pi30Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.HandleRatingInformation(kPi30RatingInformation);
+  }
+}
+
+BENCHMARK(Pi30_StatusInfoCycle) {
+  static Pi30Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.GetStatusInfo();
+  }
+}
+
+BENCHMARK(Pi18_GeneralStatus_Unchanged) {
+  static Pi18Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.HandleGeneralStatus(kPi18GeneralStatus[0]);
+  }
+}
+
+BENCHMARK(Pi18_GeneralStatus_Changed) {
+  static Pi18Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.HandleGeneralStatus(kPi18GeneralStatus[i % 2]);
+  }
+}
+
+BENCHMARK(Pi18_RatedInformation) {
+  static Pi18Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.HandleRatedInformation(kPi18RatedInformation);
+  }
+}
+
+BENCHMARK(Pi18_StatusInfoCycle) {
+  static Pi18Adapter adapter;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    adapter.GetStatusInfo();
+  }
+}
+
+BENCHMARK(TypedSensor_Update_Unchanged) {
+  InstallStubMqttClient();
+  static mqtt::SensorValues values;
+  static mqtt::TypedSensor<float> sensor(values, mqtt::SensorId::kGridVoltage);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    sensor.Update(230.5f);
+  }
+}
+
+BENCHMARK(TypedSensor_Update_Changed) {
+  InstallStubMqttClient();
+  static mqtt::SensorValues values;
+  static mqtt::TypedSensor<float> sensor(values, mqtt::SensorId::kGridVoltage);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    sensor.Update(i % 2 ? 230.5f : 231.0f);
+  }
+}
+
+BENCHMARK(Sensor_Register) {
+  InstallStubMqttClient();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    mqtt::implementation_details::Register(mqtt::SensorId::kBatteryVoltage);
+  }
+}
+
+BENCHMARK(PrintBytesAsHex) {
+  const auto frame = GetFrame("^D106" + kPi18GeneralStatus[0]);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::DoNotOptimize(utils::PrintBytesAsHex(frame));
+  }
+}
+
+BENCHMARK(EscapeString) {
+  const auto frame = GetFrame("^D106" + kPi18GeneralStatus[0]);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::DoNotOptimize(utils::EscapeString(frame));
+  }
+}
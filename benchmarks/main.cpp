@@ -0,0 +1,8 @@
+#include "harness.hh"
+#include "spdlog/spdlog.h"
+
+int main(int argc, char* argv[]) {
+  // Logging isn't what is measured. Besides, stdout is for the results.
+  spdlog::set_level(spdlog::level::off);
+  return bench::RunAll(argc, argv);
+}
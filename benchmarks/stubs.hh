@@ -0,0 +1,55 @@
+#pragma once
+
+#include <format>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "mqtt/mqtt.hh"
+#include "transport.hh"
+
+namespace bench {
+
+/// Swallows everything, counting published messages.
+class StubMqttClient : public MqttClient {
+ public:
+  void Publish(const std::string& topic, std::string_view payload, int, bool) override {
+    ++published_messages_;
+    published_bytes_ += topic.length() + payload.length();
+  }
+
+  void Subscribe(std::string, SubscriptionCalllback&&) override {}
+
+  Statistics GetStatistics() const override {
+    return {.published_messages = published_messages_};
+  }
+
+  std::size_t GetPublishedBytes() const { return published_bytes_; }
+
+ private:
+  std::size_t published_messages_ = 0;
+  std::size_t published_bytes_ = 0;
+};
+
+
+/// Replies to queries with canned replies.
+class FakeTransport : public Transport {
+ public:
+  using Replies = std::map<std::string, std::string, std::less<>>;
+
+  /// @param replies - query -> reply (without CRC and carriage return).
+  explicit FakeTransport(Replies replies) : replies_(std::move(replies)) {}
+
+  std::string Query(std::string_view query, bool, std::size_t) const override {
+    const auto reply = replies_.find(query);
+    if (reply == replies_.end()) {
+      throw std::runtime_error(std::format("No canned reply to {}", query));
+    }
+    return reply->second;
+  }
+
+ private:
+  const Replies replies_;
+};
+
+}  // namespace bench
@@ -0,0 +1,89 @@
+#include "capture.hh"
+
+#include <cstdint>
+#include <format>
+#include <stdexcept>
+
+namespace capture {
+namespace {
+
+constexpr std::string_view kMagic = "INVCAP1\n";
+
+template<typename T>
+void WriteLittleEndian(std::ofstream& file, T value) {
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    file.put(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+template<typename T>
+bool ReadLittleEndian(std::ifstream& file, T& value) {
+  value = 0;
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    const auto byte = file.get();
+    if (byte == std::ifstream::traits_type::eof()) return false;
+    value |= static_cast<T>(static_cast<unsigned char>(byte)) << (8 * i);
+  }
+  return true;
+}
+
+}  // namespace
+
+
+Writer::Writer(const std::string& filename)
+    : file_(filename, std::ios::binary | std::ios::trunc),
+      start_time_(std::chrono::steady_clock::now()) {
+  if (!file_) {
+    throw std::runtime_error("Failed to create capture file: " + filename);
+  }
+  file_ << kMagic;
+}
+
+void Writer::Write(RecordType type, std::string_view data) {
+  const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_time_);
+  std::lock_guard lock(mutex_);
+  file_.put(static_cast<char>(type));
+  WriteLittleEndian<std::uint64_t>(file_, time.count());
+  WriteLittleEndian<std::uint32_t>(file_, data.length());
+  file_.write(data.data(), data.length());
+  // Captures are made to investigate problems, so they have to survive crashes.
+  file_.flush();
+}
+
+Reader::Reader(const std::string& filename) : file_(filename, std::ios::binary) {
+  if (!file_) {
+    throw std::runtime_error("Failed to open capture file: " + filename);
+  }
+  std::string magic(kMagic.length(), '\0');
+  if (!file_.read(magic.data(), magic.length()) || magic != kMagic) {
+    throw std::runtime_error(std::format("{} is not a capture file", filename));
+  }
+}
+
+std::optional<Record> Reader::Next() {
+  const auto type = file_.get();
+  if (type == std::ifstream::traits_type::eof()) return std::nullopt;
+
+  Record record{.type = static_cast<RecordType>(type)};
+  std::uint64_t time;
+  std::uint32_t length;
+  if (!ReadLittleEndian(file_, time) || !ReadLittleEndian(file_, length)) {
+    throw std::runtime_error("Truncated capture record");
+  }
+  record.time = std::chrono::nanoseconds(time);
+  record.data.resize(length);
+  if (!file_.read(record.data.data(), length)) {
+    throw std::runtime_error("Truncated capture record");
+  }
+
+  switch (record.type) {
+    case RecordType::kSent:
+    case RecordType::kReceived:
+    case RecordType::kTimeout:
+      return record;
+  }
+  throw std::runtime_error(std::format("Unknown capture record type: {}", type));
+}
+
+}  // namespace capture
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Wire-level recording of a session with the inverter: every frame sent to and received from the
+/// device, with monotonic timestamps. See SerialPort::StartCapture() and ReplayTransport.
+///
+/// File format: the "INVCAP1\n" magic followed by records:
+///   1 byte   - RecordType;
+///   8 bytes  - time since the start of the capture in nanoseconds, little-endian;
+///   4 bytes  - length of the data, little-endian;
+///   the data - raw bytes as they were sent/received, including CRC, <cr> and garbage.
+namespace capture {
+
+enum class RecordType : char {
+  kSent = 'S',
+  /// Everything read from the device by a single SerialPort::Receive() call.
+  kReceived = 'R',
+  /// The reply hasn't been completed in time. The data is what has been received.
+  kTimeout = 'T',
+};
+
+struct Record {
+  RecordType type;
+  std::chrono::nanoseconds time;
+  std::string data;
+};
+
+/// This class is thread-safe.
+class Writer {
+ public:
+  /// @throws std::runtime_error if the file can't be created.
+  explicit Writer(const std::string& filename);
+
+  void Write(RecordType, std::string_view data);
+
+ private:
+  std::mutex mutex_;
+  std::ofstream file_;
+  const std::chrono::steady_clock::time_point start_time_;
+};
+
+class Reader {
+ public:
+  /// @throws std::runtime_error if the file can't be opened or isn't a capture.
+  explicit Reader(const std::string& filename);
+
+  /// @returns the next record, or nothing if the capture is over.
+  /// @throws std::runtime_error if the capture is damaged.
+  std::optional<Record> Next();
+
+ private:
+  std::ifstream file_;
+};
+
+}  // namespace capture
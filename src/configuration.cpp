@@ -49,14 +49,32 @@ static int ToInt(const std::string& option_name, const std::string& option_value
   }
 }
 
+namespace {
+
+thread_local const DeviceSettings* current_device = nullptr;
+
+}  // namespace
+
 const Settings& Settings::Instance() {
   static Settings instance;
   return instance;
 }
 
+const DeviceSettings& Settings::CurrentDevice() {
+  return current_device ? *current_device : Instance().devices.front();
+}
+
 void Settings::SetDeviceSerialNumber(const std::string& sn) {
   // yeah, very dirty!
-  const_cast<Settings&>(Instance()).device.serial_number = sn;
+  const_cast<DeviceSettings&>(CurrentDevice()).serial_number = sn;
+}
+
+DeviceScope::DeviceScope(const DeviceSettings& device) : previous_(current_device) {
+  current_device = &device;
+}
+
+DeviceScope::~DeviceScope() {
+  current_device = previous_;
 }
 
 void Settings::LoadFromFile(const std::string& filename) {
@@ -81,13 +99,17 @@ void Settings::LoadFromFile(const std::string& filename) {
     auto parameter_name = line.substr(0, delimiter);
     auto parameter_value = line.substr(delimiter + 1, std::string::npos - delimiter);
     if (parameter_name == "device") {
-      settings.device.path = std::move(parameter_value);
+      // Every next "device=" starts a new device. Other device_* options refer to the last one.
+      if (!settings.devices.back().path.empty()) {
+        settings.devices.emplace_back();
+      }
+      settings.devices.back().path = std::move(parameter_value);
     } else if (parameter_name == "device_name") {
-      settings.device.name = std::move(parameter_value);
+      settings.devices.back().name = std::move(parameter_value);
     } else if (parameter_name == "device_manufacturer") {
-      settings.device.manufacturer = std::move(parameter_value);
+      settings.devices.back().manufacturer = std::move(parameter_value);
     } else if (parameter_name == "device_model") {
-      settings.device.model = std::move(parameter_value);
+      settings.devices.back().model = std::move(parameter_value);
     } else if (parameter_name == "mqtt_server") {
       settings.mqtt.server = std::move(parameter_value);
     } else if (parameter_name == "mqtt_port") {
@@ -100,6 +122,35 @@ void Settings::LoadFromFile(const std::string& filename) {
       settings.mqtt.password = std::move(parameter_value);
     } else if (parameter_name == "polling_interval") {
       settings.polling_interval = ToInt(parameter_name, parameter_value);
+    } else if (parameter_name == "polling_engine") {
+      if (parameter_value == "threads") {
+        settings.polling_engine = PollingEngine::kThreads;
+      } else if (parameter_value == "epoll") {
+        settings.polling_engine = PollingEngine::kEpoll;
+      } else {
+        throw std::runtime_error(std::format(
+            "ERROR. Incorrect value '{}' for option '{}'. 'threads' or 'epoll' is expected.",
+            parameter_value, parameter_name));
+      }
+    } else if (parameter_name == "serial_crc_retries") {
+      settings.retry_policy.crc_retries = ToInt(parameter_name, parameter_value);
+    } else if (parameter_name == "serial_timeout_retries") {
+      settings.retry_policy.timeout_retries = ToInt(parameter_name, parameter_value);
+    } else if (parameter_name == "serial_retry_backoff") {
+      settings.retry_policy.initial_backoff =
+          std::chrono::milliseconds(ToInt(parameter_name, parameter_value));
+    } else if (parameter_name == "serial_retry_max_backoff") {
+      settings.retry_policy.max_backoff =
+          std::chrono::milliseconds(ToInt(parameter_name, parameter_value));
+    } else if (parameter_name == "metrics_port") {
+      settings.metrics_port = ToInt(parameter_name, parameter_value);
+    } else if (parameter_name == "control_socket") {
+      settings.control_socket = std::move(parameter_value);
+    } else if (parameter_name == "control_cache_ttl") {
+      settings.control_cache_ttl =
+          std::chrono::milliseconds(ToInt(parameter_name, parameter_value));
+    } else if (parameter_name == "data_directory") {
+      settings.data_directory = std::move(parameter_value);
     } else if (parameter_name == "amperage_factor") {
       settings.amperage_factor = ToFloat(parameter_name, parameter_value);
     } else if (parameter_name == "watt_factor") {
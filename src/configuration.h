@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -40,13 +41,50 @@ struct DeviceSettings {
   std::string serial_number;
 };
 
+/// How queries to the device are retried, see SerialPort::Query().
+struct RetryPolicy {
+  /// How many times a query is retried when the reply is corrupted (e.g. CRC doesn't match).
+  int crc_retries = 5;
+  /// How many times a query is retried when the device doesn't reply in time.
+  /// Timeouts are expensive, and usually mean that the device isn't going to reply at all.
+  int timeout_retries = 2;
+  /// The pause before the first retry. Each next one is twice as long (up to @a max_backoff).
+  /// Each pause is randomly shortened by up to a half (jitter).
+  std::chrono::milliseconds initial_backoff{100};
+  std::chrono::milliseconds max_backoff{2000};
+};
+
 struct Settings {
-  DeviceSettings device;
+  /// Inverters to poll. There is always at least one. Each "device=" line of the configuration
+  /// file starts a new one, so a single process can serve several inverters (the gateway mode).
+  std::vector<DeviceSettings> devices{1};
   MqttSettings mqtt;
+  RetryPolicy retry_policy;
 
   /// Polling interval in milliseconds.
   int polling_interval=5000;
 
+  enum class PollingEngine {
+    kThreads,  // A thread per device, making blocking queries.
+    kEpoll,    // A single thread drives all the devices, see Reactor.
+  };
+  PollingEngine polling_engine = PollingEngine::kThreads;
+
+  /// Port to serve Prometheus metrics (http://<host>:<port>/metrics) and the history of sensors
+  /// (http://<host>:<port>/history) on. 0 disables the server.
+  int metrics_port = 0;
+
+  /// Unix-domain socket to accept raw commands on while polling, see ControlServer. Empty disables
+  /// it.
+  std::string control_socket;
+  /// How long replies to read-only queries are served from the cache to the consumers of the
+  /// control socket, see ResponseCache.
+  std::chrono::milliseconds control_cache_ttl{2000};
+
+  /// Where to keep the data that should survive restarts, e.g. the history of sensors. Empty means
+  /// "keep nothing".
+  std::string data_directory;
+
   /// This allows you to modify the amperage in case the inverter is giving an incorrect
   /// reading compared to measurement tools.  Normally this will remain '1'
   float amperage_factor = 1.0f;
@@ -58,11 +96,33 @@ struct Settings {
   static const Settings& Instance();
   static void LoadFromFile(const std::string& filename);
 
+  /// @returns whether several inverters are polled. Then the data of each of them (metrics, history
+  ///          etc.) is told apart by its serial number.
+  bool IsGateway() const { return devices.size() > 1; }
+
+  /// @returns the device the calling thread works with, see DeviceScope. The first one by default.
+  static const DeviceSettings& CurrentDevice();
+
   // Dirty bypass to initialize serial number (SN) after the settings is loaded from file. Settings
   // are required to retrieve SN from the inverter. But SN is required for mqtt which is used
   // during retrieving data from the inverter as well.
+  // Sets SN of the current device.
   static void SetDeviceSerialNumber(const std::string&);
 
  private:
   Settings() = default;
 };
+
+/// Makes @a device the current one (see Settings::CurrentDevice()) for the calling thread, until the
+/// scope ends. Sensors take their MQTT topics, file names etc. from the current device.
+class DeviceScope {
+ public:
+  explicit DeviceScope(const DeviceSettings& device);
+  ~DeviceScope();
+
+  DeviceScope(const DeviceScope&) = delete;
+  DeviceScope& operator=(const DeviceScope&) = delete;
+
+ private:
+  const DeviceSettings* const previous_;
+};
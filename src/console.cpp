@@ -0,0 +1,109 @@
+#include "console.hh"
+
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include "frame.hh"
+#include "utils.h"
+
+
+namespace console {
+namespace {
+
+std::string_view Plural(unsigned count, std::string_view singular, std::string_view plural) {
+  return count == 1 ? singular : plural;
+}
+
+/// @returns e.g. "212 ms, 2 attempts, 1 CRC error".
+std::string Describe(std::chrono::steady_clock::duration latency, const QueryMetrics& before,
+                     const QueryMetrics& after) {
+  const auto attempts = after.attempts - before.attempts;
+  const auto crc_errors = after.crc_errors - before.crc_errors;
+  const auto timeouts = after.timeouts - before.timeouts;
+  auto result = std::format(
+      "{} ms, {} {}", std::chrono::duration_cast<std::chrono::milliseconds>(latency).count(),
+      attempts, Plural(attempts, "attempt", "attempts"));
+  if (crc_errors == 0) {
+    result += ", CRC ok";
+  } else {
+    result += std::format(", {} {}", crc_errors, Plural(crc_errors, "CRC error", "CRC errors"));
+  }
+  if (timeouts > 0) {
+    result += std::format(", {} {}", timeouts, Plural(timeouts, "timeout", "timeouts"));
+  }
+  return result;
+}
+
+/// Inverters that take CHK in commands reply with it too.
+frame::Checksum GetReplyChecksum(Framing framing) {
+  return framing == Framing::kChk ? frame::Checksum::kChk : frame::Checksum::kCrc;
+}
+
+}  // namespace
+
+Framing FramingFromString(std::string_view name) {
+  if (name == "none") return Framing::kNone;
+  if (name == "crc") return Framing::kCrc;
+  if (name == "chk") return Framing::kChk;
+  throw std::runtime_error(std::format("ERROR. Unknown framing: {}", name));
+}
+
+int Run(Transport& transport, std::istream& input, std::ostream& output,
+        const Options& options) {
+  auto framing = options.framing;
+  transport.SetReplyChecksum(GetReplyChecksum(framing));
+  int failures = 0;
+  std::string line;
+  while (true) {
+    if (options.interactive) {
+      output << "> " << std::flush;
+    }
+    if (!std::getline(input, line)) break;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line.starts_with('#')) continue;
+    if (line.starts_with(':')) {
+      try {
+        framing = FramingFromString(std::string_view(line).substr(1));
+        transport.SetReplyChecksum(GetReplyChecksum(framing));
+      } catch (const std::exception& e) {
+        output << e.what() << "\n";
+      }
+      continue;
+    }
+
+    auto query = line;
+    if (framing == Framing::kChk) {
+      query += frame::GetCHK(query);
+    }
+    const auto command = std::string(Transport::GetCommandName(query));
+    const auto before = transport.GetMetrics()[command];
+    const auto start = std::chrono::steady_clock::now();
+    std::string result;
+    try {
+      if (framing == Framing::kChk && query.back() == '\r') {
+        // The inverter would take the checksum for the end of the frame and get a truncated one.
+        throw std::runtime_error("The checksum of the command is <cr>, so it can't be framed");
+      }
+      const auto reply = transport.Query(query, framing == Framing::kCrc);
+      utils::WriteEscaped(reply, std::back_inserter(result));
+    } catch (const std::exception& e) {
+      ++failures;
+      result = std::format("ERROR: {}", e.what());
+    }
+    const auto latency = std::chrono::steady_clock::now() - start;
+    if (!options.interactive) {
+      output << line << "\n";
+    }
+    output << result << "\n  "
+           << Describe(latency, before, transport.GetMetrics()[command]) << std::endl;
+  }
+  return failures;
+}
+
+}  // namespace console
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <iosfwd>
+#include <string_view>
+
+#include "transport.hh"
+
+/// Sessions of raw commands over a single link to the inverter (see --repl and --script), to
+/// explore the protocol without reopening the port for each command.
+/// Each line of the input is a command, sent as is. Empty lines and lines starting with '#' are
+/// skipped. The framing could be switched in between by the lines ":none", ":crc" and ":chk".
+namespace console {
+
+/// What is appended to each command. Replies are expected to end with the same checksum (CRC
+/// unless it's CHK).
+enum class Framing {
+  kNone,
+  /// CRC-16/XMODEM, see frame::GetCRC().
+  kCrc,
+  /// A single byte checksum of some PI30 inverters, see frame::GetCHK().
+  kChk,
+};
+
+/// @returns the framing named @a name: "none", "crc" or "chk".
+/// @throws std::runtime_error if the name is unknown.
+Framing FramingFromString(std::string_view name);
+
+struct Options {
+  Framing framing = Framing::kNone;
+  /// Prompt for each command, e.g. when reading from the terminal.
+  bool interactive = false;
+};
+
+/// Send the commands read from @a input via @a transport, one after another, and print their
+/// replies into @a output, along with the latency, the number of attempts and CRC errors.
+/// A failed command doesn't stop the session.
+/// @returns the number of commands that have failed.
+int Run(Transport& transport, std::istream& input, std::ostream& output, const Options&);
+
+}  // namespace console
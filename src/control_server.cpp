@@ -0,0 +1,261 @@
+#include "control_server.hh"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <system_error>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+constexpr std::size_t kMaxRequestSize = 1024;
+constexpr std::size_t kMaxClients = 16;
+/// A client that sends nothing for that long is disconnected.
+constexpr std::chrono::seconds kClientTimeout{60};
+/// A raw query may take long: retries, a slow inverter, waiting for the poll query in progress.
+constexpr std::chrono::seconds kQueryTimeout{60};
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+sockaddr_un GetAddress(const std::string& path) {
+  sockaddr_un address{.sun_family = AF_UNIX};
+  if (path.length() >= sizeof(address.sun_path)) {
+    throw std::runtime_error(std::format("ERROR. Control socket path is too long: {}", path));
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  return address;
+}
+
+/// @returns the connected socket, or -1 if nobody listens at @a path.
+int Connect(const std::string& path) {
+  const auto address = GetAddress(path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) ThrowSystemError("socket");
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    const auto error = errno;
+    close(fd);
+    if (error == ENOENT || error == ECONNREFUSED) return -1;
+    errno = error;
+    ThrowSystemError("connect");
+  }
+  return fd;
+}
+
+void SetTimeout(int fd, std::chrono::seconds timeout) {
+  const timeval tv{.tv_sec = timeout.count(), .tv_usec = 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/// @param received - the bytes received after the previous line, if any.
+/// @returns the line without "\n", or nothing if the peer has gone or is too slow.
+std::optional<std::string> ReadLine(int fd, std::string& received) {
+  char buffer[256];
+  while (received.find('\n') == std::string::npos) {
+    const auto n_bytes = read(fd, buffer, sizeof(buffer));
+    if (n_bytes < 0 && errno == EINTR) continue;
+    if (n_bytes <= 0 || received.size() + n_bytes > kMaxRequestSize) return std::nullopt;
+    received.append(buffer, n_bytes);
+  }
+  const auto line_end = received.find('\n');
+  auto line = received.substr(0, line_end);
+  received.erase(0, line_end + 1);
+  return line;
+}
+
+/// The reply, or the reason of a failure, may be anything, but must stay on its line.
+std::string Escape(std::string_view text) {
+  std::string result;
+  result.reserve(text.size());
+  for (char c : text) {
+    switch (c) {
+      case '\\': result += "\\\\"; break;
+      case '\n': result += "\\n"; break;
+      case '\r': result += "\\r"; break;
+      default: result += c;
+    }
+  }
+  return result;
+}
+
+std::string Unescape(std::string_view text) {
+  std::string result;
+  result.reserve(text.size());
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (text[i] != '\\' || i + 1 == text.size()) {
+      result += text[i];
+      continue;
+    }
+    switch (text[++i]) {
+      case 'n': result += '\n'; break;
+      case 'r': result += '\r'; break;
+      default: result += text[i];
+    }
+  }
+  return result;
+}
+
+bool WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const auto n_bytes = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n_bytes < 0 && errno == EINTR) continue;
+    if (n_bytes <= 0) return false;
+    data.remove_prefix(n_bytes);
+  }
+  return true;
+}
+
+}  // namespace
+
+
+ControlServer::ControlServer(std::string path, Handler handler)
+    : path_(std::move(path)), handler_(std::move(handler)) {
+  if (const int fd = Connect(path_); fd >= 0) {
+    close(fd);
+    throw std::runtime_error(std::format("ERROR. Another poller is listening on {}", path_));
+  }
+  // Nobody listens there, so the file (if any) is left by a process that has crashed.
+  unlink(path_.c_str());
+
+  const auto address = GetAddress(path_);
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) ThrowSystemError("socket");
+  // Raw commands can change the inverter's settings, so only the owner (and the group) may send
+  // them. The socket is created with these permissions, so there is no moment when others could
+  // connect. The umask is process-wide, but nothing else creates files while the poller starts.
+  const auto previous_umask = umask(0117);
+  const auto bound = bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+  umask(previous_umask);
+  if (bound != 0) {
+    close(listen_fd_);
+    ThrowSystemError("bind");
+  }
+  // Just in case the umask hasn't applied, e.g. it has been changed by another thread meanwhile.
+  if (chmod(path_.c_str(), 0660) != 0) {
+    const auto error = errno;
+    close(listen_fd_);
+    unlink(path_.c_str());
+    errno = error;
+    ThrowSystemError("chmod");
+  }
+  if (listen(listen_fd_, SOMAXCONN) != 0 || pipe2(stop_pipe_, O_CLOEXEC) != 0) {
+    const auto error = errno;
+    close(listen_fd_);
+    unlink(path_.c_str());
+    errno = error;
+    ThrowSystemError("listen");
+  }
+  spdlog::info("Serving raw commands on {}", path_);
+}
+
+ControlServer::~ControlServer() {
+  if (thread_.joinable()) {
+    const char stop = 0;
+    (void) !write(stop_pipe_[1], &stop, 1);
+    // The clients are disconnected by the server's thread.
+    thread_.join();
+  }
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+  close(listen_fd_);
+  unlink(path_.c_str());
+}
+
+void ControlServer::Start() {
+  thread_ = std::thread(&ControlServer::Run, this);
+}
+
+void ControlServer::Run() {
+  pollfd fds[] = {{.fd = stop_pipe_[0], .events = POLLIN}, {.fd = listen_fd_, .events = POLLIN}};
+  while (true) {
+    RemoveFinishedClients();
+    // Stop accepting while all the slots are busy, the kernel keeps the backlog meanwhile.
+    fds[1].fd = clients_.size() < kMaxClients ? listen_fd_ : -1;
+    if (poll(fds, std::size(fds), 1000) < 0 && errno != EINTR) {
+      spdlog::error("Control server stopped: poll failed with {}", errno);
+      break;
+    }
+    if (fds[0].revents) break;
+    if (!(fds[1].revents & POLLIN)) continue;
+
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    SetTimeout(fd, kClientTimeout);
+    auto& client = clients_.emplace_back(fd);
+    client.thread = std::thread(&ControlServer::Serve, this, std::ref(client));
+  }
+
+  // Wake up the clients' threads blocked in reading.
+  for (auto& client : clients_) {
+    shutdown(client.fd, SHUT_RDWR);
+  }
+  for (auto& client : clients_) {
+    client.thread.join();
+    close(client.fd);
+  }
+  clients_.clear();
+}
+
+void ControlServer::RemoveFinishedClients() {
+  std::erase_if(clients_, [](Client& client) {
+    if (!client.finished) return false;
+    client.thread.join();
+    close(client.fd);
+    return true;
+  });
+}
+
+void ControlServer::Serve(Client& client) const {
+  std::string received;
+  while (const auto request = ReadLine(client.fd, received)) {
+    // E.g. "/dev/hidraw0 1 QPIGS".
+    std::string response;
+    const auto path_end = request->find(' ');
+    const auto crc_end = request->find(' ', path_end + 1);
+    if (path_end == std::string::npos || crc_end == std::string::npos) {
+      response = "ERROR Malformed request\n";
+    } else {
+      const std::string_view device_path(request->data(), path_end);
+      const bool with_crc = request->substr(path_end + 1, crc_end - path_end - 1) == "1";
+      const std::string_view command = std::string_view(*request).substr(crc_end + 1);
+      try {
+        spdlog::debug("Raw command {} to {}", command, device_path);
+        response = std::format("OK {}\n", Escape(handler_(device_path, with_crc, command)));
+      } catch (const std::exception& e) {
+        spdlog::warn("Raw command {} to {} failed: {}", command, device_path, e.what());
+        response = std::format("ERROR {}\n", Escape(e.what()));
+      }
+    }
+    if (!WriteAll(client.fd, response)) break;
+  }
+  client.finished = true;
+}
+
+std::optional<std::string> ControlServer::Query(const std::string& path,
+                                                std::string_view device_path, bool with_crc,
+                                                std::string_view command) {
+  const int fd = Connect(path);
+  if (fd < 0) return std::nullopt;
+
+  SetTimeout(fd, kQueryTimeout);
+  const auto sent = WriteAll(fd, std::format("{} {:d} {}\n", device_path, with_crc, command));
+  std::string received;
+  const auto response = sent ? ReadLine(fd, received) : std::nullopt;
+  close(fd);
+  if (!response) {
+    throw std::runtime_error(std::format("No response from the poller on {}", path));
+  }
+  if (response->starts_with("OK ")) return Unescape(std::string_view(*response).substr(3));
+  throw std::runtime_error(Unescape(response->starts_with("ERROR ")
+                                    ? std::string_view(*response).substr(6) : *response));
+}
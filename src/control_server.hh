@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/// A Unix-domain socket to talk to the running poller, which owns the serial ports: to send raw
+/// commands to an inverter with `inverter_poller -r`, or to share the inverter with other tools on
+/// the host (a BMS script, a vendor logger etc.).
+/// A request and its response are single lines:
+///   "<device path> <0|1 - whether to append CRC> <command>\n"
+///   "OK <reply>\n" or "ERROR <reason>\n"
+/// Backslashes, line feeds and carriage returns in the reply and the reason are escaped as "\\",
+/// "\n" and "\r".
+/// A client may send any number of requests over a connection, one after another. Clients are
+/// served concurrently, each by its own thread.
+class ControlServer {
+ public:
+  /// Sends @a command to the inverter at @a device_path, and returns the reply. Is called on the
+  /// threads of the clients, possibly concurrently, and is allowed to block and to throw.
+  using Handler = std::function<std::string(std::string_view device_path, bool with_crc,
+                                            std::string_view command)>;
+
+  /// Starts listening on @a path. A stale socket file left by a crashed process is replaced.
+  /// @throws std::system_error if the socket couldn't be bound, or std::runtime_error if another
+  ///         poller is listening there already.
+  ControlServer(std::string path, Handler handler);
+  ~ControlServer();
+
+  ControlServer(const ControlServer&) = delete;
+  ControlServer& operator=(const ControlServer&) = delete;
+
+  /// Start serving requests in the background thread.
+  void Start();
+
+  /// Send @a command via the server listening on @a path.
+  /// @returns nothing if no server is listening there (e.g. the poller isn't running).
+  /// @throws std::runtime_error if the command has failed.
+  static std::optional<std::string> Query(const std::string& path, std::string_view device_path,
+                                          bool with_crc, std::string_view command);
+
+ private:
+  struct Client {
+    int fd;
+    std::atomic<bool> finished = false;
+    std::thread thread;
+  };
+
+  void Run();
+  /// Serve the requests of @a client until it disconnects.
+  void Serve(Client& client) const;
+  /// Join the threads of the clients that have disconnected.
+  void RemoveFinishedClients();
+
+  const std::string path_;
+  const Handler handler_;
+  int listen_fd_ = -1;
+  /// Wakes the server's thread up on shutdown.
+  int stop_pipe_[2] = {-1, -1};
+  std::thread thread_;
+  /// Is accessed by the server's thread only.
+  std::list<Client> clients_;
+};
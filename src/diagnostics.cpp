@@ -0,0 +1,95 @@
+#include "diagnostics.hh"
+
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <unistd.h>
+
+#include "configuration.h"
+#include "mqtt/mqtt.hh"
+
+namespace {
+
+/// Round to hundredths, so that insignificant fluctuations don't cause publishing.
+float Round(float value) {
+  return std::round(value * 100) / 100;
+}
+
+float ToMilliseconds(std::chrono::nanoseconds duration) {
+  return Round(std::chrono::duration<float, std::milli>(duration).count());
+}
+
+/// @returns the resident set size of the process, in MiB, or 0 if it's unknown.
+float GetMemoryUsage() {
+  std::ifstream statm("/proc/self/statm");
+  std::size_t total_pages = 0, resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages)) return 0;
+  return Round(float(resident_pages * sysconf(_SC_PAGESIZE)) / (1024 * 1024));
+}
+
+/// Commands like "^P005GS" or "QPIGS" -> "P005GS" or "QPIGS", suitable for sensor names and topics.
+std::string ToSensorName(std::string_view command) {
+  std::string result;
+  for (const char c : command) {
+    if (std::isalnum(static_cast<unsigned char>(c))) result += c;
+  }
+  return result;
+}
+
+}  // namespace
+
+
+Diagnostics::CommandLatency::CommandLatency(const std::string& command)
+    : p50(std::format("Diagnostics_{}_latency_p50", ToSensorName(command)),
+          mqtt::SensorKind::kDuration),
+      p95(std::format("Diagnostics_{}_latency_p95", ToSensorName(command)),
+          mqtt::SensorKind::kDuration) {}
+
+void Diagnostics::Update(Clock::duration cycle_duration) {
+  UpdateLinkQuality();
+
+  cycle_duration_.Update(ToMilliseconds(cycle_duration));
+  if (cycle_duration > std::chrono::seconds(Settings::Instance().polling_interval)) {
+    ++overruns_count_;
+  }
+  overruns_.Update(overruns_count_);
+
+  UpdateMqtt();
+  memory_.Update(GetMemoryUsage());
+}
+
+void Diagnostics::UpdateLinkQuality() {
+  unsigned crc_errors = 0, timeouts = 0, retries = 0;
+  for (const auto& [command, metrics] : transport_.GetMetrics()) {
+    crc_errors += metrics.crc_errors;
+    timeouts += metrics.timeouts;
+    retries += metrics.attempts - metrics.queries;
+    if (metrics.queries == metrics.failures) continue;  // No latency samples yet.
+
+    auto& latency = latencies_[command];
+    if (!latency) {
+      latency = std::make_unique<CommandLatency>(command);
+    }
+    latency->p50.Update(ToMilliseconds(metrics.p50_latency));
+    latency->p95.Update(ToMilliseconds(metrics.p95_latency));
+  }
+  crc_errors_.Update(crc_errors);
+  timeouts_.Update(timeouts);
+  retries_.Update(retries);
+}
+
+void Diagnostics::UpdateMqtt() {
+  const auto statistics = MqttClient::Instance().GetStatistics();
+  mqtt_pending_.Update(statistics.pending_messages);
+
+  const auto now = Clock::now();
+  if (last_update_) {
+    const auto minutes = std::chrono::duration<double, std::ratio<60>>(now - *last_update_);
+    const auto published = statistics.published_messages - last_published_messages_;
+    if (minutes.count() > 0) {
+      mqtt_publish_rate_.Update(std::lround(published / minutes.count()));
+    }
+  }
+  last_update_ = now;
+  last_published_messages_ = statistics.published_messages;
+}
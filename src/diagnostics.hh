@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "mqtt/sensor.hh"
+#include "transport.hh"
+
+/// Health of the poller itself, published to Home Assistant as diagnostic sensors: the quality of
+/// the link to the inverter, timings of the poll cycle, MQTT backlog and memory usage.
+class Diagnostics {
+ public:
+  explicit Diagnostics(const Transport& transport) : transport_(transport) {}
+
+  /// Call once per poll cycle.
+  /// @param cycle_duration - how long querying the inverter took during this cycle.
+  void Update(std::chrono::steady_clock::duration cycle_duration);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct CommandLatency {
+    explicit CommandLatency(const std::string& command);
+
+    mqtt::DiagnosticSensor<float> p50;
+    mqtt::DiagnosticSensor<float> p95;
+  };
+
+  void UpdateLinkQuality();
+  void UpdateMqtt();
+
+  const Transport& transport_;
+  std::map<std::string, std::unique_ptr<CommandLatency>> latencies_;
+
+  mqtt::DiagnosticSensor<unsigned> crc_errors_{"Diagnostics_CRC_errors", mqtt::SensorKind::kNone,
+                                               true};
+  mqtt::DiagnosticSensor<unsigned> timeouts_{"Diagnostics_timeouts", mqtt::SensorKind::kNone,
+                                             true};
+  mqtt::DiagnosticSensor<unsigned> retries_{"Diagnostics_retries", mqtt::SensorKind::kNone,
+                                            true};
+  mqtt::DiagnosticSensor<float> cycle_duration_{"Diagnostics_poll_cycle_duration",
+                                                mqtt::SensorKind::kDuration};
+  mqtt::DiagnosticSensor<unsigned> overruns_{"Diagnostics_poll_cycle_overruns",
+                                             mqtt::SensorKind::kNone, true};
+  mqtt::DiagnosticSensor<unsigned> mqtt_pending_{"Diagnostics_MQTT_pending_messages"};
+  mqtt::DiagnosticSensor<unsigned> mqtt_publish_rate_{"Diagnostics_MQTT_publishes_per_minute"};
+  mqtt::DiagnosticSensor<float> memory_{"Diagnostics_memory_usage", mqtt::SensorKind::kDataSize};
+
+  unsigned overruns_count_ = 0;
+  std::uint64_t last_published_messages_ = 0;
+  std::optional<Clock::time_point> last_update_;
+};
@@ -31,6 +31,21 @@ class CrcMismatchException : public std::exception {
 };
 
 
+/// Thrown when device's reply is damaged so badly that no frame could be extracted from it.
+class CorruptedFrameException : public BaseException {
+ public:
+  CorruptedFrameException(std::string_view message) : BaseException(message) {}
+};
+
+
+/// Thrown when the link to the device is lost (e.g. the USB adapter is unplugged) and hasn't been
+/// restored yet. Unlike timeouts, such queries aren't retried.
+class DisconnectedException : public BaseException {
+ public:
+  DisconnectedException(std::string_view message) : BaseException(message) {}
+};
+
+
 /// Thrown when connecting to the device requires the usage of the protocol that is unsupported.
 class UnsupportedProtocolException : public BaseException {
  public:
@@ -45,3 +60,9 @@ class UnexpectedResponseException : public BaseException {
   UnexpectedResponseException(std::string_view reason)
       : BaseException(reason) {}
 };
+
+/// Thrown when a replayed session diverges from the capture or the capture is over.
+class ReplayException : public BaseException {
+ public:
+  ReplayException(std::string_view reason) : BaseException(reason) {}
+};
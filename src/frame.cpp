@@ -0,0 +1,73 @@
+#include "frame.hh"
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "CRC.h"
+#include "exceptions.h"
+
+namespace frame {
+namespace {
+
+bool IsFrameStart(std::string_view data, std::size_t position) {
+  if (data[position] == '(') return true;
+  if (data[position] != '^' || position + 1 >= data.length()) return false;
+  const char next = data[position + 1];
+  return next == 'D' || next == '0' || next == '1';
+}
+
+}  // namespace
+
+std::string GetCRC(std::string_view data) {
+  const uint16_t crc = CRC::Calculate(data.data(), data.length(), CRC::CRC_16_XMODEM());
+  return {static_cast<char>(crc >> 8), static_cast<char>(crc & 0xff)};
+}
+
+char GetCHK(std::string_view data) {
+  unsigned sum = 1;
+  for (const char c : data) {
+    sum += static_cast<unsigned char>(c);
+  }
+  return static_cast<char>(sum & 0xff);
+}
+
+bool CheckCRC(std::string_view frame) {
+  if (frame.length() < 3) return false;
+  const auto crc = GetCRC(frame.substr(0, frame.length() - 3));
+  return frame[frame.length() - 3] == crc[0] && frame[frame.length() - 2] == crc[1];
+}
+
+bool CheckChecksum(std::string_view frame, Checksum checksum) {
+  if (checksum == Checksum::kCrc) return CheckCRC(frame);
+  return frame.length() >= 2 &&
+         frame[frame.length() - 2] == GetCHK(frame.substr(0, frame.length() - 2));
+}
+
+std::string_view ToString(Corruption corruption) {
+  switch (corruption) {
+    case Corruption::kLeadingGarbage: return "leading garbage";
+    case Corruption::kTrailingGarbage: return "trailing garbage";
+    case Corruption::kNoFrameStart: return "no frame start";
+    case Corruption::kCrcMismatch: return "CRC mismatch";
+    case Corruption::kOverflow: return "overflow";
+  }
+  throw std::runtime_error("unreachable");
+}
+
+std::size_t FindFrameStart(std::string_view data, Checksum checksum) {
+  bool start_found = false;
+  for (std::size_t position = 0; position + GetLength(checksum) + 1 <= data.length(); ++position) {
+    if (!IsFrameStart(data, position)) continue;
+    start_found = true;
+    if (CheckChecksum(data.substr(position), checksum)) {
+      return position;
+    }
+  }
+
+  if (!start_found) {
+    throw CorruptedFrameException("No frame start in the reply");
+  }
+  throw CrcMismatchException();
+}
+
+}  // namespace frame
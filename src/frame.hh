@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/// Routines to deal with raw frames sent to and received from the inverter.
+/// Each frame looks like: <payload><CRC><cr>, where CRC is 2 bytes of CRC-16/XMODEM (or a single
+/// byte of CHK, see Checksum).
+namespace frame {
+
+/// What a reply has between its payload and the carriage return.
+enum class Checksum : char {
+  kCrc,  // CRC-16/XMODEM, see GetCRC().
+  kChk,  // A single byte of some PI30 inverters, see GetCHK().
+};
+
+/// @returns the number of bytes of the @a checksum.
+constexpr std::size_t GetLength(Checksum checksum) { return checksum == Checksum::kChk ? 1 : 2; }
+
+/// @returns 2 bytes of CRC-16/XMODEM calculated for @a data.
+std::string GetCRC(std::string_view data);
+
+/// @returns the checksum some PI30 inverters expect instead of CRC: the sum of the bytes of @a data
+///          plus one, truncated to a single byte.
+char GetCHK(std::string_view data);
+
+/// @param frame - the whole frame, including CRC and carriage return (<cr>).
+/// @returns true if the CRC stored in the @a frame matches its payload.
+bool CheckCRC(std::string_view frame);
+
+/// @param frame - the whole frame, including the checksum and carriage return (<cr>).
+/// @returns true if the @a checksum stored in the @a frame matches its payload.
+bool CheckChecksum(std::string_view frame, Checksum checksum);
+
+/// Kinds of damage that can be detected in the inverter's replies.
+enum class Corruption : char {
+  kLeadingGarbage,   // Some bytes before the start of the frame were discarded.
+  kTrailingGarbage,  // Some bytes arrived after the carriage return and were discarded.
+  kNoFrameStart,     // Reply contains no plausible frame start ("(" or "^D").
+  kCrcMismatch,      // Frame start is found, but CRC doesn't match.
+  kOverflow,         // Too much data received without a carriage return.
+};
+constexpr std::size_t kCorruptionKinds = 5;
+
+std::string_view ToString(Corruption);
+
+/// Looks for a valid frame in @a data. Replies from the inverter start with "(" (PI30) or "^D"
+/// (PI18), whereas PI18 command acknowledgements are "^0" and "^1". Everything before the frame
+/// start is considered as a garbage left from previous (corrupted) replies and is skipped.
+/// Since CRC bytes may accidentally look like a frame start, all candidates are tried one by one
+/// and the first one with matching CRC wins.
+/// @param data - received bytes, ending with carriage return (<cr>).
+/// @param checksum - what the frame is expected to end with.
+/// @returns offset of the frame in @a data.
+/// @throws CorruptedFrameException if there is no plausible frame start in the @a data.
+/// @throws CrcMismatchException if none of the candidates has a valid checksum.
+std::size_t FindFrameStart(std::string_view data, Checksum checksum = Checksum::kCrc);
+
+}  // namespace frame
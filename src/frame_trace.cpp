@@ -0,0 +1,31 @@
+#include "frame_trace.hh"
+
+#include <algorithm>
+#include <cstring>
+
+void FrameTrace::Record(Direction direction, std::string_view frame) {
+  const auto length = std::min(frame.length(), kMaxFrameLength);
+  std::lock_guard lock(mutex_);
+  auto& entry = entries_[recorded_++ % kCapacity];
+  entry.time = std::chrono::steady_clock::now();
+  entry.direction = direction;
+  entry.length = static_cast<std::uint16_t>(length);
+  std::memcpy(entry.bytes.data(), frame.data(), length);
+}
+
+void FrameTrace::Dump(std::string_view reason) {
+  std::lock_guard lock(mutex_);
+  const auto n_entries = std::min(recorded_, kCapacity);
+  spdlog::warn("{}. The last {} frames:", reason, n_entries);
+
+  const auto now = std::chrono::steady_clock::now();
+  for (auto i = recorded_ - n_entries; i < recorded_; ++i) {
+    const auto& entry = entries_[i % kCapacity];
+    const std::string_view bytes{entry.bytes.data(), entry.length};
+    const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - entry.time);
+    spdlog::warn("  {:>6} ms ago {}: '{}', hex: {}.", age.count(),
+                 entry.direction == Direction::kSent ? "sent" : "received",
+                 EscapedBytes{bytes}, HexBytes{bytes});
+  }
+  recorded_ = 0;
+}
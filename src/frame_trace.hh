@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
+#include "spdlog/spdlog.h"
+#include "utils.h"
+
+
+/// Wrappers that allow to log raw bytes lazily: they are formatted only if the message is actually
+/// going to be logged, e.g. spdlog::debug("Read: {}", HexBytes{data}) costs nothing at info level.
+struct HexBytes { std::string_view bytes; };
+struct EscapedBytes { std::string_view bytes; };
+
+template<>
+struct fmt::formatter<HexBytes> {
+  constexpr auto parse(fmt::format_parse_context& ctx) { return ctx.begin(); }
+
+  template<typename FormatContext>
+  auto format(const HexBytes& value, FormatContext& ctx) const {
+    return utils::WriteBytesAsHex(value.bytes, ctx.out());
+  }
+};
+
+template<>
+struct fmt::formatter<EscapedBytes> {
+  constexpr auto parse(fmt::format_parse_context& ctx) { return ctx.begin(); }
+
+  template<typename FormatContext>
+  auto format(const EscapedBytes& value, FormatContext& ctx) const {
+    return utils::WriteEscaped(value.bytes, ctx.out());
+  }
+};
+
+
+/// Keeps the last raw frames sent to and received from the device in a fixed-size ring, so they can
+/// be dumped to the log when something goes wrong (CRC mismatch, unparsable reply etc.) even if
+/// debug logging is off.
+/// Every Transport has its own ring, so the frames of different devices don't mix in the gateway
+/// mode. This class is thread-safe.
+class FrameTrace {
+ public:
+  enum class Direction : char { kSent, kReceived };
+
+  /// Remember the frame. Frames longer than kMaxFrameLength are truncated.
+  void Record(Direction, std::string_view frame);
+
+  /// Log all the remembered frames (as warnings) and forget them.
+  void Dump(std::string_view reason);
+
+ private:
+  static constexpr std::size_t kCapacity = 16;
+  static constexpr std::size_t kMaxFrameLength = 256;
+
+  struct Entry {
+    std::chrono::steady_clock::time_point time;
+    Direction direction;
+    std::uint16_t length;
+    std::array<char, kMaxFrameLength> bytes;
+  };
+
+  std::mutex mutex_;
+  std::array<Entry, kCapacity> entries_;
+  /// Total number of recorded frames since the last dump.
+  std::size_t recorded_ = 0;
+};
@@ -0,0 +1,268 @@
+#include "history.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <format>
+#include <system_error>
+
+#include "mqtt/json.hh"
+#include "spdlog/spdlog.h"
+
+namespace history {
+namespace {
+
+constexpr std::array<char, 8> kMagic = {'I', 'N', 'V', 'H', 'I', 'S', 'T', '1'};
+
+/// The duration of a bucket of each resolution, in seconds. 0 means "a bucket per sample".
+constexpr std::array<std::uint32_t, kResolutionsCount> kPeriod = {0, 60, 3600};
+
+constexpr std::array<std::string_view, kResolutionsCount> kResolutionNames = {"raw", "1m", "1h"};
+
+[[noreturn]] void ThrowSystemError(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+/// @returns @a value with "%XX" sequences and '+' decoded. Malformed sequences are kept as is.
+std::string DecodeComponent(std::string_view value) {
+  std::string result;
+  result.reserve(value.length());
+  for (std::size_t i = 0; i < value.length(); ++i) {
+    unsigned char byte;
+    if (value[i] == '+') {
+      result += ' ';
+    } else if (value[i] == '%' && i + 2 < value.length() &&
+               std::from_chars(value.data() + i + 1, value.data() + i + 3, byte, 16).ptr ==
+               value.data() + i + 3) {
+      result += static_cast<char>(byte);
+      i += 2;
+    } else {
+      result += value[i];
+    }
+  }
+  return result;
+}
+
+/// @returns the decoded value of @a key in a query like "a=1&b=2", or an empty string.
+std::string GetParameter(std::string_view query, std::string_view key) {
+  while (!query.empty()) {
+    const auto end = query.find('&');
+    const auto parameter = query.substr(0, end);
+    if (parameter.starts_with(key) && parameter.substr(key.length()).starts_with('=')) {
+      return DecodeComponent(parameter.substr(key.length() + 1));
+    }
+    if (end == std::string_view::npos) break;
+    query.remove_prefix(end + 1);
+  }
+  return {};
+}
+
+std::uint32_t ToTime(std::string_view str, std::uint32_t default_value) {
+  std::uint32_t result = default_value;
+  std::from_chars(str.data(), str.data() + str.length(), result);
+  return result;
+}
+
+}  // namespace
+
+
+/// Is followed by the rings of buckets, one per resolution.
+struct Series::Header {
+  std::array<char, 8> magic;
+  std::uint32_t bucket_size;
+  std::array<std::uint32_t, kResolutionsCount> capacity;
+  /// The number of buckets ever written into each ring.
+  std::array<std::uint64_t, kResolutionsCount> written;
+};
+
+Series::Series(const std::filesystem::path& filename) {
+  size_ = sizeof(Header);
+  for (const auto capacity : kCapacity) {
+    size_ += capacity * sizeof(Bucket);
+  }
+
+  file_descriptor_ = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (file_descriptor_ < 0) ThrowSystemError("open " + filename.string());
+  // Whatever is in the file isn't used, unless it has the very same layout.
+  const Header expected{.magic = kMagic, .bucket_size = sizeof(Bucket), .capacity = kCapacity};
+  Header existing{};
+  const bool compatible = pread(file_descriptor_, &existing, sizeof(existing), 0) == sizeof(existing)
+                          && existing.magic == kMagic && existing.bucket_size == sizeof(Bucket)
+                          && existing.capacity == kCapacity;
+  if (!compatible && ftruncate(file_descriptor_, 0) != 0) ThrowSystemError("ftruncate");
+  // The file is sparse, the disk space is taken as the rings are filled.
+  if (ftruncate(file_descriptor_, size_) != 0) ThrowSystemError("ftruncate");
+
+  void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+  if (data == MAP_FAILED) {
+    const std::system_error error(errno, std::generic_category(), "mmap " + filename.string());
+    close(file_descriptor_);
+    throw error;
+  }
+  header_ = static_cast<Header*>(data);
+  if (!compatible) {
+    *header_ = expected;
+  }
+}
+
+Series::~Series() {
+  munmap(header_, size_);
+  close(file_descriptor_);
+}
+
+Bucket* Series::GetRing(Resolution resolution) const {
+  auto* ring = reinterpret_cast<Bucket*>(header_ + 1);
+  for (std::size_t i = 0; i < static_cast<std::size_t>(resolution); ++i) {
+    ring += kCapacity[i];
+  }
+  return ring;
+}
+
+void Series::Add(std::chrono::system_clock::time_point time, float value) {
+  const auto seconds = static_cast<std::uint32_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count());
+
+  std::lock_guard lock(mutex_);
+  for (std::size_t i = 0; i < kResolutionsCount; ++i) {
+    auto* ring = GetRing(static_cast<Resolution>(i));
+    auto& written = header_->written[i];
+    const auto bucket_time = kPeriod[i] ? seconds - seconds % kPeriod[i] : seconds;
+
+    auto& last = ring[(written + kCapacity[i] - 1) % kCapacity[i]];
+    if (kPeriod[i] && written && last.time == bucket_time) {
+      ++last.count;
+      last.min = std::min(last.min, value);
+      last.max = std::max(last.max, value);
+      last.mean += (value - last.mean) / last.count;
+      last.last = value;
+    } else {
+      ring[written % kCapacity[i]] = {.time = bucket_time, .count = 1, .min = value, .max = value,
+                                      .mean = value, .last = value};
+      ++written;
+    }
+  }
+}
+
+std::vector<Bucket> Series::Get(Resolution resolution, std::uint32_t from,
+                                std::uint32_t to) const {
+  const auto i = static_cast<std::size_t>(resolution);
+  const auto* ring = GetRing(resolution);
+
+  std::lock_guard lock(mutex_);
+  const auto written = header_->written[i];
+  std::vector<Bucket> result;
+  for (auto n = written - std::min<std::uint64_t>(written, kCapacity[i]); n < written; ++n) {
+    const auto& bucket = ring[n % kCapacity[i]];
+    if (bucket.time >= from && bucket.time <= to) {
+      result.push_back(bucket);
+    }
+  }
+  return result;
+}
+
+std::uint32_t Series::GetOldestTime(Resolution resolution) const {
+  const auto i = static_cast<std::size_t>(resolution);
+  std::lock_guard lock(mutex_);
+  const auto written = header_->written[i];
+  if (written == 0) return 0;
+  const auto oldest = written - std::min<std::uint64_t>(written, kCapacity[i]);
+  return GetRing(resolution)[oldest % kCapacity[i]].time;
+}
+
+
+History& History::Instance() {
+  static History instance;
+  return instance;
+}
+
+void History::Open(const std::filesystem::path& directory) {
+  std::filesystem::create_directories(directory);
+  std::lock_guard lock(mutex_);
+  directory_ = directory;
+  spdlog::info("Keeping history of sensors in {}", directory.string());
+}
+
+Series* History::GetSeries(std::string_view sensor) {
+  std::lock_guard lock(mutex_);
+  if (directory_.empty()) return nullptr;
+
+  auto series = series_.find(sensor);
+  if (series == series_.end()) {
+    std::unique_ptr<Series> new_series;
+    try {
+      const auto filename = directory_ / std::format("{}.ring", sensor);
+      // Sensors of several devices are kept in subdirectories, e.g. "<serial number>/<sensor>".
+      std::filesystem::create_directories(filename.parent_path());
+      new_series = std::make_unique<Series>(filename);
+    } catch (const std::exception& e) {
+      spdlog::error("No history for {}: {}", sensor, e.what());
+    }
+    series = series_.emplace(sensor, std::move(new_series)).first;
+  }
+  return series->second.get();
+}
+
+HttpServer::Response History::HandleQuery(std::string_view query) {
+  const auto sensor = GetParameter(query, "sensor");
+  std::lock_guard lock(mutex_);
+  if (sensor.empty()) {
+    mqtt::JsonWriter body(series_.size() * 32 + 16);
+    body.BeginObject().Key("sensors").BeginArray();
+    for (const auto& [name, series] : series_) {
+      if (series) body.String(name);
+    }
+    body.EndArray().EndObject();
+    return {.content_type = "application/json", .body = std::move(body).Release() + '\n'};
+  }
+
+  const auto series = series_.find(sensor);
+  if (series == series_.end() || !series->second) {
+    return {.status = 404, .body = std::format("No history for '{}'\n", sensor)};
+  }
+
+  const auto now = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count());
+  const auto from = ToTime(GetParameter(query, "from"), 0);
+  const auto to = ToTime(GetParameter(query, "to"), now);
+
+  auto resolution = Resolution::kHour;
+  if (const auto name = GetParameter(query, "resolution"); !name.empty()) {
+    const auto found = std::ranges::find(kResolutionNames, name);
+    if (found == kResolutionNames.end()) {
+      return {.status = 400, .body = std::format("Unknown resolution '{}'\n", name)};
+    }
+    resolution = static_cast<Resolution>(found - kResolutionNames.begin());
+  } else {
+    for (const auto r : {Resolution::kRaw, Resolution::kMinute}) {
+      const auto oldest = series->second->GetOldestTime(r);
+      if (oldest && oldest <= from) {
+        resolution = r;
+        break;
+      }
+    }
+  }
+
+  const auto buckets = series->second->Get(resolution, from, to);
+  mqtt::JsonWriter body(buckets.size() * 48 + 128);
+  body.BeginObject();
+  body.Key("sensor").String(sensor);
+  body.Key("resolution").String(kResolutionNames[static_cast<std::size_t>(resolution)]);
+  body.Key("columns").BeginArray();
+  for (const auto column : {"time", "min", "max", "mean", "last"}) {
+    body.String(column);
+  }
+  body.EndArray();
+  body.Key("points").BeginArray();
+  for (const auto& bucket : buckets) {
+    body.BeginArray().Number(bucket.time).Number(bucket.min).Number(bucket.max)
+        .Number(bucket.mean).Number(bucket.last).EndArray();
+  }
+  body.EndArray().EndObject();
+  return {.content_type = "application/json", .body = std::move(body).Release() + '\n'};
+}
+
+}  // namespace history
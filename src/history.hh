@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http_server.hh"
+
+/// Local history of numeric sensors, so that long ranges can be loaded without Home Assistant's
+/// recorder. Every sensor has a file with fixed-size rings of samples at several resolutions. Files
+/// are memory-mapped, so adding a sample is just a few stores, and the history survives restarts.
+namespace history {
+
+enum class Resolution {
+  kRaw,     // every sample
+  kMinute,  // aggregated per minute
+  kHour,    // aggregated per hour
+};
+constexpr std::size_t kResolutionsCount = 3;
+
+/// Aggregate of the samples within a time slot (a single sample for Resolution::kRaw).
+struct Bucket {
+  /// Unix time of the beginning of the slot, in seconds.
+  std::uint32_t time;
+  std::uint32_t count;
+  float min;
+  float max;
+  float mean;
+  float last;
+};
+
+/// History of a single sensor. This class is thread-safe.
+class Series {
+ public:
+  /// Rings' sizes: 4 hours of samples (at the default polling interval of 5 seconds), 2 days of
+  /// minutes and a year of hours. It's ~350 KiB per sensor.
+  static constexpr std::array<std::uint32_t, kResolutionsCount> kCapacity = {2880, 2880, 8760};
+
+  /// Open the file or create it, if it doesn't exist or has an incompatible layout.
+  /// @throws std::system_error if the file can't be created or mapped.
+  explicit Series(const std::filesystem::path& filename);
+  ~Series();
+
+  Series(const Series&) = delete;
+  Series& operator=(const Series&) = delete;
+
+  void Add(std::chrono::system_clock::time_point, float value);
+
+  /// @returns buckets within [from, to], ordered by time.
+  std::vector<Bucket> Get(Resolution, std::uint32_t from, std::uint32_t to) const;
+
+  /// @returns the time of the oldest bucket of the given resolution, or 0 if there are none.
+  std::uint32_t GetOldestTime(Resolution) const;
+
+ private:
+  struct Header;
+
+  Bucket* GetRing(Resolution) const;
+
+  mutable std::mutex mutex_;
+  int file_descriptor_ = -1;
+  std::size_t size_ = 0;
+  Header* header_ = nullptr;
+};
+
+class History {
+ public:
+  static History& Instance();
+
+  /// Enable the history, keeping files in @a directory (it's created if needed).
+  /// @throws std::filesystem::filesystem_error if the directory can't be created.
+  void Open(const std::filesystem::path& directory);
+
+  /// This function is thread-safe.
+  /// @param sensor - the name of the sensor, prefixed with "<serial number>/" in the gateway mode.
+  /// @returns the series of @a sensor, creating it if needed, or nullptr if the history is disabled
+  ///          or the file can't be created.
+  Series* GetSeries(std::string_view sensor);
+
+  /// Handles "GET /history?sensor=<name>[&from=<unix time>][&to=<unix time>][&resolution=<raw|1m|1h>]"
+  /// with a JSON of the buckets. If the resolution isn't given, the finest one that still covers
+  /// the requested range is used. Without parameters, lists the sensors.
+  HttpServer::Response HandleQuery(std::string_view query);
+
+ private:
+  History() = default;
+
+  std::mutex mutex_;
+  std::filesystem::path directory_;
+  std::map<std::string, std::unique_ptr<Series>, std::less<>> series_;
+};
+
+}  // namespace history
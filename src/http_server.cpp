@@ -0,0 +1,213 @@
+#include "http_server.hh"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <format>
+#include <system_error>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+/// Requests are tiny: a request line and a few headers. Anything bigger is dropped.
+constexpr std::size_t kMaxRequestSize = 8 * 1024;
+constexpr std::size_t kMaxConnections = 16;
+/// The time a client has to send its request and receive the response.
+constexpr std::chrono::seconds kConnectionTimeout{5};
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+void SetNonBlocking(int fd) {
+  const auto flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) ThrowSystemError("fcntl");
+}
+
+std::string_view GetReasonPhrase(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    default: return "Internal Server Error";
+  }
+}
+
+std::string ToHttp(const HttpServer::Response& response) {
+  return std::format("HTTP/1.0 {} {}\r\n"
+                     "Content-Type: {}\r\n"
+                     "Content-Length: {}\r\n"
+                     "Connection: close\r\n"
+                     "\r\n"
+                     "{}",
+                     response.status, GetReasonPhrase(response.status), response.content_type,
+                     response.body.size(), response.body);
+}
+
+}  // namespace
+
+
+HttpServer::HttpServer(int port) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) ThrowSystemError("socket");
+  const int enable = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  sockaddr_in address{.sin_family = AF_INET, .sin_port = htons(port)};
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    close(listen_fd_);
+    ThrowSystemError("bind");
+  }
+  if (listen(listen_fd_, SOMAXCONN) != 0 || pipe(stop_pipe_) != 0) {
+    close(listen_fd_);
+    ThrowSystemError("listen");
+  }
+  spdlog::info("Serving HTTP on port {}", port);
+}
+
+HttpServer::~HttpServer() {
+  if (thread_.joinable()) {
+    const char stop = 0;
+    (void) !write(stop_pipe_[1], &stop, 1);
+    thread_.join();
+  }
+  for (const auto& connection : connections_) {
+    close(connection.fd);
+  }
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+  close(listen_fd_);
+}
+
+void HttpServer::Handle(std::string path, Handler handler) {
+  handlers_.insert_or_assign(std::move(path), std::move(handler));
+}
+
+void HttpServer::Start() {
+  thread_ = std::thread(&HttpServer::Run, this);
+}
+
+void HttpServer::Run() {
+  std::vector<pollfd> fds;
+  while (true) {
+    fds.clear();
+    fds.push_back({.fd = stop_pipe_[0], .events = POLLIN});
+    // Stop accepting while all the slots are busy, the kernel keeps the backlog meanwhile.
+    fds.push_back({.fd = connections_.size() < kMaxConnections ? listen_fd_ : -1,
+                   .events = POLLIN});
+    for (const auto& connection : connections_) {
+      fds.push_back({.fd = connection.fd,
+                     .events = static_cast<short>(connection.response.empty() ? POLLIN : POLLOUT)});
+    }
+
+    if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+      spdlog::error("HTTP server stopped: poll failed with {}", errno);
+      return;
+    }
+    if (fds[0].revents) return;
+
+    const auto now = std::chrono::steady_clock::now();
+    // Connections accepted below are at the end and have no events yet.
+    const auto n_polled = connections_.size();
+    if (fds[1].revents & POLLIN) {
+      Accept();
+    }
+    for (std::size_t i = 0, polled = 0; i < connections_.size(); ++polled) {
+      auto& connection = connections_[i];
+      const short revents = polled < n_polled ? fds[polled + 2].revents : 0;
+      bool keep = now < connection.deadline;
+      if (keep && (revents & POLLIN)) {
+        keep = OnReadable(connection);
+      } else if (keep && (revents & POLLOUT)) {
+        keep = OnWritable(connection);
+      } else if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        keep = false;
+      }
+
+      if (keep) {
+        ++i;
+      } else {
+        close(connection.fd);
+        connections_.erase(connections_.begin() + i);
+      }
+    }
+  }
+}
+
+void HttpServer::Accept() {
+  while (connections_.size() < kMaxConnections) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        spdlog::warn("HTTP server: accept failed with {}", errno);
+      }
+      return;
+    }
+    connections_.push_back(
+        {.fd = fd, .deadline = std::chrono::steady_clock::now() + kConnectionTimeout});
+  }
+}
+
+bool HttpServer::OnReadable(Connection& connection) {
+  char buffer[1024];
+  const auto n_bytes = read(connection.fd, buffer, sizeof(buffer));
+  if (n_bytes < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+  if (n_bytes == 0) return false;  // The client has gone before sending the whole request.
+
+  connection.request.append(buffer, n_bytes);
+  if (connection.request.find("\r\n\r\n") == std::string::npos) {
+    return connection.request.size() < kMaxRequestSize;
+  }
+  const std::string_view request(connection.request);
+  connection.response = HandleRequest(request.substr(0, request.find("\r\n")));
+  return OnWritable(connection);
+}
+
+bool HttpServer::OnWritable(Connection& connection) {
+  const auto n_bytes = send(connection.fd, connection.response.data() + connection.sent,
+                            connection.response.size() - connection.sent, MSG_NOSIGNAL);
+  if (n_bytes < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+  connection.sent += n_bytes;
+  return connection.sent < connection.response.size();
+}
+
+std::string HttpServer::HandleRequest(std::string_view request_line) const {
+  // E.g. "GET /metrics?foo=bar HTTP/1.1".
+  const auto method_end = request_line.find(' ');
+  const auto target_end = request_line.find(' ', method_end + 1);
+  if (method_end == std::string_view::npos || target_end == std::string_view::npos) {
+    return ToHttp({.status = 400, .body = "Malformed request\n"});
+  }
+  if (request_line.substr(0, method_end) != "GET") {
+    return ToHttp({.status = 405, .body = "Only GET is supported\n"});
+  }
+
+  auto path = request_line.substr(method_end + 1, target_end - method_end - 1);
+  std::string_view query;
+  if (const auto query_start = path.find('?'); query_start != std::string_view::npos) {
+    query = path.substr(query_start + 1);
+    path = path.substr(0, query_start);
+  }
+
+  const auto handler = handlers_.find(path);
+  if (handler == handlers_.end()) {
+    return ToHttp({.status = 404, .body = "Not found\n"});
+  }
+  try {
+    return ToHttp(handler->second(query));
+  } catch (const std::exception& e) {
+    spdlog::error("HTTP server: failed to handle {}: {}", path, e.what());
+    return ToHttp({.status = 500, .body = "Internal error\n"});
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/// A minimal HTTP/1.0 server for local tools (e.g. Prometheus scrapes): GET requests only, one
+/// request per connection. All the connections are served by a single thread with non-blocking
+/// sockets, so a slow or stuck client never delays the others, nor the poller.
+class HttpServer {
+ public:
+  struct Response {
+    int status = 200;
+    std::string content_type = "text/plain; charset=utf-8";
+    std::string body;
+  };
+  /// Is called on the server's thread, so it should be fast and must not block.
+  /// @param query - the part of the request target after '?', if any.
+  using Handler = std::function<Response(std::string_view query)>;
+
+  /// Starts listening on @a port on all the interfaces.
+  /// @throws std::system_error if the port couldn't be bound.
+  explicit HttpServer(int port);
+  ~HttpServer();
+
+  HttpServer(const HttpServer&) = delete;
+  HttpServer& operator=(const HttpServer&) = delete;
+
+  /// Serve GET requests to @a path with @a handler. Must be called before Start().
+  void Handle(std::string path, Handler handler);
+
+  /// Start serving requests in the background thread.
+  void Start();
+
+ private:
+  struct Connection {
+    int fd;
+    std::string request;
+    std::string response;
+    std::size_t sent = 0;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  void Run();
+  void Accept();
+  /// @returns false if the connection should be closed.
+  bool OnReadable(Connection&);
+  bool OnWritable(Connection&);
+  std::string HandleRequest(std::string_view request_line) const;
+
+  int listen_fd_ = -1;
+  /// Wakes the server's thread up on shutdown.
+  int stop_pipe_[2] = {-1, -1};
+  std::map<std::string, Handler, std::less<>> handlers_;
+  std::vector<Connection> connections_;
+  std::thread thread_;
+};
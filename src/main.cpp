@@ -5,13 +5,29 @@
 // ------------------------------------------------------------------------
 
 #include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "configuration.h"
+#include "console.hh"
+#include "control_server.hh"
+#include "history.hh"
+#include "http_server.hh"
+#include "metrics/registry.hh"
 #include "mqtt/mqtt.hh"
-#include "protocols/protocol_adapter.hh"
+#include "poller.hh"
+#include "reactor.hh"
+#include "replay_transport.hh"
+#include "serial_port.hh"
 #include "spdlog/spdlog.h"
+#include "trace.hh"
 
 
 void PrintHelp() {
@@ -19,11 +35,18 @@ void PrintHelp() {
   std::cout <<
 "\nUSAGE:  ./inverter_poller <options>"
 "\nOPTIONS:"
-"\n    -r <raw-command>    Send 'raw' command to the inverter. Commands for a particular protocol could be found in \"documentation\" directory."
+"\n    -r <raw-command>    Send 'raw' command to the inverter (the first one, if several are configured). Commands for a particular protocol could be found in \"documentation\" directory. If the poller is running, the command is sent through its control_socket."
 "\n    --crc               Append CRC to the raw command."
+"\n    --chk               Append the single byte checksum (CHK) of some PI30 inverters instead of CRC, with --repl or --script."
+"\n    --repl              Read raw commands from the terminal and send them one by one over the same link, printing the latency and CRC status of each. Type :crc, :chk or :none to switch the framing."
+"\n    --script <file>     The same as --repl, but read the commands from the file. Exits with 1 if any of them has failed."
 "\n    -h | --help         This Help Message."
 "\n    -1 | --run-once     Poll all inverter data once, then exit."
 "\n    -c                  Optional path to the configuration file (default: ./inverter.conf)."
+"\n    --capture <file>    Record all the frames sent to and received from the inverter into the file."
+"\n    --replay <file>     Don't use the inverter, replay a session recorded with --capture instead."
+"\n    --fast              Replay as fast as possible instead of keeping the recorded timing."
+"\n    --trace <file>      Write timings of the poll cycles into the file, in Chrome trace format."
 "\n    -d                  Enable additional debug logging.\n";
 }
 
@@ -41,9 +64,116 @@ void InitLogging(const CommandLineArguments& arguments) {
   }
 }
 
-std::unique_ptr<ProtocolAdapter> GetProtocolAdapter(SerialPort& port) {
-  // TODO: save/read protocol to/from a file.
-  return DetectProtocol(port);
+std::unique_ptr<Transport> GetTransport(const CommandLineArguments& arguments,
+                                        const DeviceSettings& device) {
+  if (arguments.IsSet("--replay")) {
+    return std::make_unique<ReplayTransport>(arguments.Get("--replay"),
+                                             arguments.IsSet("--fast")
+                                             ? ReplayTransport::Speed::kFastest
+                                             : ReplayTransport::Speed::kRecorded);
+  }
+  auto port = std::make_unique<SerialPort>(device.path, Settings::Instance().retry_policy);
+  if (arguments.IsSet("--capture")) {
+    port->StartCapture(arguments.Get("--capture"));
+  }
+  return port;
+}
+
+/// @returns pollers of the configured devices. In the gateway mode, a device that can't be
+///          recognized is skipped, so that it doesn't prevent polling of the others.
+std::vector<std::unique_ptr<Poller>> GetPollers(const CommandLineArguments& arguments) {
+  const auto& settings = Settings::Instance();
+  std::vector<std::unique_ptr<Poller>> pollers;
+  if (!settings.IsGateway()) {
+    const auto& device = settings.devices.front();
+    pollers.push_back(std::make_unique<Poller>(device, GetTransport(arguments, device)));
+    return pollers;
+  }
+
+  if (arguments.IsSet("--capture") || arguments.IsSet("--replay")) {
+    throw std::runtime_error("ERROR. --capture and --replay support a single device only.");
+  }
+  for (const auto& device : settings.devices) {
+    try {
+      pollers.push_back(std::make_unique<Poller>(device, GetTransport(arguments, device)));
+    } catch (const std::exception& e) {
+      spdlog::error("Skipping device {} on {}: {}", device.name, device.path, e.what());
+    }
+  }
+  if (pollers.empty()) {
+    throw std::runtime_error("ERROR. None of the devices could be recognized.");
+  }
+  return pollers;
+}
+
+/// @returns the server of Prometheus metrics and the history, or nullptr if it's disabled.
+std::unique_ptr<HttpServer> StartMetricsServer() {
+  const auto port = Settings::Instance().metrics_port;
+  if (port == 0) return nullptr;
+
+  auto server = std::make_unique<HttpServer>(port);
+  server->Handle("/metrics", [](std::string_view) {
+    return HttpServer::Response{.content_type = "text/plain; version=0.0.4; charset=utf-8",
+                                .body = metrics::Registry::Instance().Render()};
+  });
+  server->Handle("/history", [](std::string_view query) {
+    return history::History::Instance().HandleQuery(query);
+  });
+  server->Start();
+  return server;
+}
+
+/// @returns the server of raw commands to the devices of @a pollers, or nullptr if it's disabled.
+std::unique_ptr<ControlServer> StartControlServer(
+    const std::vector<std::unique_ptr<Poller>>& pollers) {
+  const auto& path = Settings::Instance().control_socket;
+  if (path.empty()) return nullptr;
+
+  auto server = std::make_unique<ControlServer>(
+      path, [&pollers](std::string_view device_path, bool with_crc, std::string_view command) {
+    for (const auto& poller : pollers) {
+      if (poller->GetDevice().path == device_path) return poller->RawQuery(command, with_crc);
+    }
+    throw std::runtime_error(std::format("No inverter is polled on {}", device_path));
+  });
+  server->Start();
+  return server;
+}
+
+/// Send the raw command of '-r' to the inverter, through the running poller if there is one (it
+/// holds the serial port), or directly otherwise.
+/// @returns the inverter's reply.
+std::string SendRawCommand(const CommandLineArguments& arguments) {
+  const auto& device = Settings::Instance().devices.front();
+  const auto& command = arguments.Get("-r");
+  const bool with_crc = arguments.IsSet("--crc");
+  if (const auto& path = Settings::Instance().control_socket;
+      !path.empty() && !arguments.IsSet("--replay")) {
+    if (auto reply = ControlServer::Query(path, device.path, with_crc, command)) {
+      return *reply;
+    }
+  }
+  return GetTransport(arguments, device)->Query(command, with_crc);
+}
+
+/// Run the commands of --repl or --script over the link to the (first) inverter. Unlike '-r', it's
+/// opened directly, so the poller must not be running.
+/// @returns the exit code.
+int RunConsole(const CommandLineArguments& arguments) {
+  const console::Options options{
+      .framing = arguments.IsSet("--chk") ? console::Framing::kChk
+                 : arguments.IsSet("--crc") ? console::Framing::kCrc
+                 : console::Framing::kNone,
+      .interactive = arguments.IsSet("--repl")};
+  const auto transport = GetTransport(arguments, Settings::Instance().devices.front());
+  if (options.interactive) {
+    return console::Run(*transport, std::cin, std::cout, options) > 0 ? 1 : 0;
+  }
+  std::ifstream script(arguments.Get("--script"));
+  if (!script) {
+    throw std::runtime_error(std::format("ERROR. Unable to open {}", arguments.Get("--script")));
+  }
+  return console::Run(*transport, script, std::cout, options) > 0 ? 1 : 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -54,34 +184,56 @@ int main(int argc, char* argv[]) {
   }
   InitLogging(arguments);
   Settings::LoadFromFile(GetConfigurationFileName(arguments));
-  SerialPort port(Settings::Instance().device.path);
+  if (const auto& data_directory = Settings::Instance().data_directory; !data_directory.empty()) {
+    history::History::Instance().Open(std::filesystem::path(data_directory) / "history");
+  }
+  if (arguments.IsSet("--trace")) {
+    trace::Start(arguments.Get("--trace"));
+  }
 
   // Logic to send 'raw commands' to the inverter.
   if (arguments.IsSet("-r")) {
-    const auto reply = port.Query(arguments.Get("-r"), arguments.IsSet("--crc"));
+    const auto reply = SendRawCommand(arguments);
     printf("Reply:  %s\n", reply.c_str());
     return 0;
   }
+  if (arguments.IsSet("--repl") || arguments.IsSet("--script")) {
+    return RunConsole(arguments);
+  }
 
-  auto adapter = GetProtocolAdapter(port);
-  const auto serial_number = adapter->GetSerialNumber();
-  Settings::SetDeviceSerialNumber(serial_number);
-  MqttClient::Init(Settings::Instance().mqtt, serial_number);
+  const bool use_reactor = Settings::Instance().polling_engine == Settings::PollingEngine::kEpoll &&
+                           !arguments.IsSet("--replay");
+  // Outlives the pollers, since their timers are registered in it.
+  std::optional<Reactor> reactor;
+  if (use_reactor) {
+    reactor.emplace();
+  }
+  const auto pollers = GetPollers(arguments);
+  // All the devices share a single connection to the broker.
+  MqttClient::Init(Settings::Instance().mqtt, pollers.front()->GetDevice().serial_number);
+  const auto metrics_server = StartMetricsServer();
+  // A replayed session has no inverter to send commands to.
+  const auto control_server = arguments.IsSet("--replay") ? nullptr : StartControlServer(pollers);
 
   const bool run_once = arguments.IsSet("-1", "--run-once");
-  while (true) {
-    // TODO: query rated info only when changes are expected.
-    adapter->GetRatedInfo();
-    adapter->GetStatusInfo();
-
-    if (run_once) {
-      break;
+  if (use_reactor) {
+    // All the devices are driven by this thread.
+    auto running = pollers.size();
+    for (const auto& poller : pollers) {
+      poller->Start(*reactor, run_once, [&] {
+        if (--running == 0) reactor->Stop();
+      });
+    }
+    reactor->Run();
+  } else {
+    // A thread per device, so that a slow or silent one doesn't delay the others. They are joined
+    // at the end of the scope.
+    std::vector<std::jthread> workers;
+    for (const auto& poller : pollers) {
+      workers.emplace_back([&poller, run_once] { poller->Run(run_once); });
     }
-
-    const auto polling_interval = Settings::Instance().polling_interval;
-    spdlog::info("Wait for {} seconds before the next poll...", polling_interval);
-    sleep(polling_interval);
   }
 
+  trace::Stop();
   return 0;
 }
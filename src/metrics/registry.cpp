@@ -0,0 +1,110 @@
+#include "registry.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <format>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+namespace metrics {
+namespace {
+
+/// https://prometheus.io/docs/concepts/data_model/#metric-names-and-labels
+std::string ToMetricName(std::string_view name, Type type) {
+  std::string result = "inverter_";
+  for (const char c : name) {
+    const auto uc = static_cast<unsigned char>(c);
+    result += std::isalnum(uc) ? static_cast<char>(std::tolower(uc)) : '_';
+  }
+  if (type == Type::kCounter) {
+    result += "_total";
+  }
+  return result;
+}
+
+/// https://prometheus.io/docs/instrumenting/exposition_formats/#comments-help-text-and-type-information
+std::string_view ToString(Type type) {
+  switch (type) {
+    case Type::kGauge: return "gauge";
+    case Type::kCounter: return "counter";
+  }
+  return "untyped";
+}
+
+std::string EscapeLabelValue(std::string_view value) {
+  std::string result;
+  for (const char c : value) {
+    if (c == '\\' || c == '"') result += '\\';
+    if (c == '\n') {
+      result += "\\n";
+      continue;
+    }
+    result += c;
+  }
+  return result;
+}
+
+}  // namespace
+
+
+Registry& Registry::Instance() {
+  static Registry instance;
+  return instance;
+}
+
+Registry::Registry() : metrics_(std::make_unique<std::optional<Metric>[]>(kCapacity)) {}
+
+Metric* Registry::Add(std::string_view name, Type type, StateFormatter state_formatter,
+                      std::string_view device) {
+  std::lock_guard lock(add_mutex_);
+  const auto size = size_.load(std::memory_order_relaxed);
+  if (size == kCapacity) {
+    spdlog::warn("Too many metrics, {} isn't exported", name);
+    return nullptr;
+  }
+  auto& metric = metrics_[size].emplace(ToMetricName(name, type), type, state_formatter,
+                                              std::string(device));
+  // Publish the constructed element to Render().
+  size_.store(size + 1, std::memory_order_release);
+  return &metric;
+}
+
+std::string Registry::Render() const {
+  const auto size = size_.load(std::memory_order_acquire);
+  // Metrics of the same name (i.e. of different devices) must go together, after a single TYPE.
+  std::vector<const Metric*> metrics;
+  metrics.reserve(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    const auto& metric = *metrics_[i];
+    if (metric.has_value_.load(std::memory_order_acquire)) metrics.push_back(&metric);
+  }
+  std::ranges::stable_sort(metrics, {}, &Metric::name_);
+
+  std::string result;
+  std::string_view previous_name;
+  for (const auto* metric : metrics) {
+    if (metric->name_ != previous_name) {
+      result += std::format("# TYPE {} {}\n", metric->name_, ToString(metric->type_));
+      previous_name = metric->name_;
+    }
+
+    std::string labels;
+    if (!metric->device_.empty()) {
+      labels = std::format("device=\"{}\"", EscapeLabelValue(metric->device_));
+    }
+    const auto value = metric->value_.load(std::memory_order_relaxed);
+    if (metric->state_formatter_) {
+      const auto state = metric->state_formatter_(static_cast<int>(value));
+      result += std::format("{}{{{}{}state=\"{}\"}} 1\n", metric->name_, labels,
+                            labels.empty() ? "" : ",", EscapeLabelValue(state));
+    } else if (!labels.empty()) {
+      result += std::format("{}{{{}}} {}\n", metric->name_, labels, value);
+    } else {
+      result += std::format("{} {}\n", metric->name_, value);
+    }
+  }
+  return result;
+}
+
+}  // namespace metrics
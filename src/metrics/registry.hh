@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace metrics {
+
+/// https://prometheus.io/docs/concepts/metric_types/
+enum class Type {
+  kGauge,
+  kCounter,
+};
+
+/// Turns the numeric value of an enumeration into its name, e.g. 3 -> "Battery".
+using StateFormatter = std::string (*)(int);
+
+/// A single time series. Written by its owner, read by scrapes; neither of them ever waits.
+class Metric {
+ public:
+  Metric(std::string name, Type type, StateFormatter state_formatter, std::string device)
+      : name_(std::move(name)), type_(type), state_formatter_(state_formatter),
+        device_(std::move(device)) {}
+
+  void Set(double value) {
+    value_.store(value, std::memory_order_relaxed);
+    has_value_.store(true, std::memory_order_release);
+  }
+
+ private:
+  friend class Registry;
+
+  const std::string name_;
+  const Type type_;
+  /// If set, the value is exposed as a label ({state="..."}) rather than a number.
+  const StateFormatter state_formatter_;
+  /// If set, it's exposed as a label ({device="..."}) to tell apart the metrics of several devices.
+  const std::string device_;
+  std::atomic<double> value_ = 0;
+  std::atomic<bool> has_value_ = false;
+};
+
+/// All the metrics of the process, exposed in Prometheus text format.
+/// Metrics live in a preallocated array and are never removed, so scrapes read them without
+/// locking: only the (rare) registration of new metrics is serialized.
+class Registry {
+ public:
+  static constexpr std::size_t kCapacity = 1024;
+
+  static Registry& Instance();
+
+  /// Thread-safe.
+  /// @param name - an arbitrary name, e.g. "Battery_voltage". It's converted to a valid metric name
+  ///        with "inverter_" prefix, e.g. "inverter_battery_voltage".
+  /// @param device - optional, the serial number of the device the metric belongs to. Several
+  ///        metrics may have the same name if they belong to different devices.
+  /// @returns the metric that is valid until the end of the program, or nullptr if there is no
+  ///          room for it.
+  Metric* Add(std::string_view name, Type type = Type::kGauge,
+              StateFormatter state_formatter = nullptr, std::string_view device = "");
+
+  /// Thread-safe and lock-free: doesn't wait for Add() or Metric::Set().
+  /// @returns all the metrics that have a value, in Prometheus text format (version 0.0.4).
+  std::string Render() const;
+
+ private:
+  Registry();
+
+  std::mutex add_mutex_;
+  std::unique_ptr<std::optional<Metric>[]> metrics_;
+  /// The number of constructed elements of metrics_.
+  std::atomic<std::size_t> size_ = 0;
+};
+
+}  // namespace metrics
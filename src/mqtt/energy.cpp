@@ -0,0 +1,100 @@
+#include "energy.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <iterator>
+
+#include "configuration.h"
+#include "spdlog/spdlog.h"
+#include "utils.h"
+
+namespace mqtt {
+
+void EnergyCounter::AddPowerSample(float power, Clock::time_point now) {
+  if (!loaded_) {
+    damaged_ = !Load();
+    loaded_ = true;
+  }
+  if (damaged_) return;
+
+  power = std::max(power, 0.f);
+  if (last_sample_time_ && now - *last_sample_time_ <= kMaxGap) {
+    const std::chrono::duration<double, std::ratio<3600>> hours = now - *last_sample_time_;
+    energy_ += (last_power_ + power) / 2 * hours.count();
+  }
+  last_sample_time_ = now;
+  last_power_ = power;
+
+  // Watt-hours are enough, finer changes would only cause publishing.
+  Update(std::round(energy_) / 1000);
+  if (now - last_save_time_ >= kSaveInterval) {
+    Save();
+    last_save_time_ = now;
+  }
+}
+
+std::optional<std::filesystem::path> EnergyCounter::GetFileName() const {
+  const auto& settings = Settings::Instance();
+  if (settings.data_directory.empty()) return std::nullopt;
+  auto directory = std::filesystem::path(settings.data_directory) / "energy";
+  if (settings.IsGateway()) {
+    directory /= Settings::CurrentDevice().serial_number;
+  }
+  return directory / GetName();
+}
+
+bool EnergyCounter::Load() {
+  const auto filename = GetFileName();
+  if (!filename || !std::filesystem::exists(*filename)) return true;
+
+  std::ifstream file(*filename);
+  const std::string content{std::istreambuf_iterator<char>(file), {}};
+  const auto end = content.data() + content.find_last_not_of(" \n") + 1;
+  double energy = 0;
+  const auto [parsed_end, error] = std::from_chars(content.data(), end, energy);
+  if (!file.bad() && !content.empty() && error == std::errc() && parsed_end == end &&
+      std::isfinite(energy) && energy >= 0) {
+    energy_ = energy;
+    spdlog::info("{}: restored {} Wh", GetName(), energy_);
+    return true;
+  }
+  spdlog::error("{}: {} is damaged, the energy isn't counted until it's fixed or removed",
+                GetName(), filename->string());
+  return false;
+}
+
+void EnergyCounter::Save() {
+  const auto filename = GetFileName();
+  if (!filename) return;
+  try {
+    std::filesystem::create_directories(filename->parent_path());
+    utils::ReplaceFile(*filename, std::format("{}\n", energy_));
+  } catch (const std::exception& e) {
+    spdlog::error("{}: failed to save: {}", GetName(), e.what());
+  }
+}
+
+
+EnergyMeters::EnergyMeters(SensorValues& values)
+    : battery_power_(values, SensorId::kBatteryPower),
+      pv_energy_(values, SensorId::kPvEnergy),
+      output_energy_(values, SensorId::kOutputEnergy),
+      battery_charge_energy_(values, SensorId::kBatteryChargeEnergy),
+      battery_discharge_energy_(values, SensorId::kBatteryDischargeEnergy) {}
+
+void EnergyMeters::Update(float pv_power, float output_power, float battery_voltage,
+                          float battery_charge_current, float battery_discharge_current) {
+  const auto battery_power = battery_voltage * (battery_charge_current - battery_discharge_current);
+  battery_power_.Update(static_cast<int>(std::lround(battery_power)));
+
+  const auto now = EnergyCounter::Clock::now();
+  pv_energy_.AddPowerSample(pv_power, now);
+  output_energy_.AddPowerSample(output_power, now);
+  battery_charge_energy_.AddPowerSample(battery_power, now);
+  battery_discharge_energy_.AddPowerSample(-battery_power, now);
+}
+
+}  // namespace mqtt
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+#include "sensor.hh"
+
+namespace mqtt {
+
+/// Energy in kWh, integrated on the device from power samples with the trapezoidal rule, so it
+/// doesn't depend on how often Home Assistant gets state updates.
+/// If data_directory is set, the accumulated energy is saved there and survives restarts.
+class EnergyCounter : public TypedSensor<double> {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  EnergyCounter(SensorValues& values, SensorDescriptor<double> descriptor)
+      : TypedSensor(values, descriptor) {}
+
+  /// @param power - in watts. Negative values are counted as zero.
+  void AddPowerSample(float power, Clock::time_point now = Clock::now());
+
+ private:
+  /// Nothing is known about the power between samples that are too far apart (e.g. the inverter
+  /// didn't reply for a while, or the poller was stopped), so such intervals aren't integrated.
+  static constexpr auto kMaxGap = std::chrono::minutes(5);
+  /// The accumulated energy is saved not more often than that, to spare SD cards.
+  static constexpr auto kSaveInterval = std::chrono::minutes(1);
+
+  /// @returns the file to keep the accumulated energy in, or nothing if data_directory isn't set.
+  std::optional<std::filesystem::path> GetFileName() const;
+  /// @returns false if the file is damaged.
+  bool Load();
+  void Save();
+
+  /// In watt-hours.
+  double energy_ = 0;
+  bool loaded_ = false;
+  /// The saved energy couldn't be read. Starting from zero would reset the counter in Home
+  /// Assistant's statistics and overwrite the file, so the counter stays unavailable instead.
+  bool damaged_ = false;
+  std::optional<Clock::time_point> last_sample_time_;
+  float last_power_ = 0;
+  Clock::time_point last_save_time_;
+};
+
+/// Energy flows of the inverter, integrated from the instant power readings.
+class EnergyMeters {
+ public:
+  explicit EnergyMeters(SensorValues&);
+
+  /// @param battery_charge_current, battery_discharge_current - in amps.
+  void Update(float pv_power, float output_power, float battery_voltage,
+              float battery_charge_current, float battery_discharge_current);
+
+ private:
+  TypedSensor<int> battery_power_;
+
+  EnergyCounter pv_energy_;
+  EnergyCounter output_energy_;
+  EnergyCounter battery_charge_energy_;
+  EnergyCounter battery_discharge_energy_;
+};
+
+}  // namespace mqtt
@@ -0,0 +1,76 @@
+#include "json.hh"
+
+namespace mqtt {
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+  Separate();
+  out_ += '"';
+  WriteEscaped(key);
+  out_ += "\":";
+  // The value goes right after the colon.
+  has_previous_ = false;
+  return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+  Separate();
+  out_ += '"';
+  WriteEscaped(value);
+  out_ += '"';
+  return *this;
+}
+
+JsonWriter& JsonWriter::Raw(std::string_view json) {
+  Separate();
+  out_.append(json);
+  return *this;
+}
+
+void JsonWriter::Separate() {
+  if (has_previous_) {
+    out_ += ',';
+  }
+  has_previous_ = true;
+}
+
+// https://www.rfc-editor.org/rfc/rfc8259#section-7
+void JsonWriter::WriteEscaped(std::string_view str) {
+  static constexpr char kHexChar[] = "0123456789abcdef";
+  // Most strings need no escaping, so they are copied by runs rather than by characters.
+  auto run_start = str.begin();
+  for (auto it = str.begin(); it != str.end(); ++it) {
+    const auto byte = static_cast<unsigned char>(*it);
+    if (byte >= 0x20 && byte != '"' && byte != '\\') continue;
+
+    out_.append(run_start, it);
+    run_start = it + 1;
+    out_ += '\\';
+    switch (byte) {
+      case '"': out_ += '"'; break;
+      case '\\': out_ += '\\'; break;
+      case '\n': out_ += 'n'; break;
+      case '\r': out_ += 'r'; break;
+      case '\t': out_ += 't'; break;
+      default:
+        out_ += "u00";
+        out_ += kHexChar[byte / 16];
+        out_ += kHexChar[byte % 16];
+    }
+  }
+  out_.append(run_start, str.end());
+}
+
+JsonWriter& JsonWriter::Open(char bracket) {
+  Separate();
+  out_ += bracket;
+  has_previous_ = false;
+  return *this;
+}
+
+JsonWriter& JsonWriter::Close(char bracket) {
+  out_ += bracket;
+  has_previous_ = true;
+  return *this;
+}
+
+}  // namespace mqtt
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <string>
+#include <string_view>
+
+namespace mqtt {
+
+/// Writes compact JSON (no whitespace) into a single buffer, reserved up front, so a payload is
+/// built without temporary strings. Commas are inserted by the writer itself.
+/// The writer doesn't check the structure: keys are expected inside objects only, and every
+/// Begin*() must have its End*().
+class JsonWriter {
+ public:
+  /// @param capacity - the expected size of the document, to build it without reallocations.
+  explicit JsonWriter(std::size_t capacity) { out_.reserve(capacity); }
+
+  JsonWriter& BeginObject() { return Open('{'); }
+  JsonWriter& EndObject() { return Close('}'); }
+  JsonWriter& BeginArray() { return Open('['); }
+  JsonWriter& EndArray() { return Close(']'); }
+
+  /// The next value is written as the value of @a key.
+  JsonWriter& Key(std::string_view key);
+
+  /// Write @a value quoted and escaped.
+  JsonWriter& String(std::string_view value);
+
+  /// NaN and infinities are written as null, JSON has no numbers for them.
+  template<typename T>
+    requires std::integral<T> || std::floating_point<T>
+  JsonWriter& Number(T value) {
+    Separate();
+    if constexpr (std::floating_point<T>) {
+      if (!std::isfinite(value)) {
+        out_ += "null";
+        return *this;
+      }
+    }
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out_.append(buffer, result.ptr);
+    return *this;
+  }
+
+  /// Write @a json as is, e.g. a part of the document that is made once and cached.
+  JsonWriter& Raw(std::string_view json);
+
+  std::string_view View() const { return out_; }
+  std::string Release() && { return std::move(out_); }
+
+ private:
+  /// Put a comma if it isn't the first value of the object or the array.
+  void Separate();
+  void WriteEscaped(std::string_view);
+  JsonWriter& Open(char bracket);
+  JsonWriter& Close(char bracket);
+
+  std::string out_;
+  /// Whether the next value (or key) follows another one.
+  bool has_previous_ = false;
+};
+
+}  // namespace mqtt
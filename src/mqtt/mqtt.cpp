@@ -5,7 +5,9 @@
 #include <mutex>
 #include <unordered_map>
 
+#include "mqtt/async_client.h"
 #include "spdlog/spdlog.h"
+#include "trace.hh"
 
 namespace {
 
@@ -20,10 +22,27 @@ auto GetBrokerAddress(const MqttSettings& mqtt_settings) {
   return std::format("mqtt://{}:{}", mqtt_settings.server, mqtt_settings.port);
 }
 
+class PahoMqttClient : public MqttClient {
+ public:
+  PahoMqttClient(const MqttSettings&, const std::string& client_id);
+  ~PahoMqttClient() override;
+
+  void Publish(const std::string& sub_topic, std::string_view payload,
+               int qos, bool retain) override;
+  void Subscribe(std::string topic, SubscriptionCalllback&&) override;
+  Statistics GetStatistics() const override;
+
+ private:
+  void SubscriptionHandler();
+
+  mqtt::async_client client_;
+  std::atomic<std::uint64_t> published_messages_ = 0;
+};
+
 }  // namespace
 
 
-MqttClient::MqttClient(const MqttSettings& settings, const std::string& client_id)
+PahoMqttClient::PahoMqttClient(const MqttSettings& settings, const std::string& client_id)
     : client_(GetBrokerAddress(settings), client_id) {
 
   mqtt::connect_options_builder options;
@@ -41,42 +60,37 @@ MqttClient::MqttClient(const MqttSettings& settings, const std::string& client_i
   client_.start_consuming();
 }
 
-MqttClient::~MqttClient() {
+PahoMqttClient::~PahoMqttClient() {
   client_.disconnect();
 }
 
-MqttClient& MqttClient::Instance() {
-  return *mqtt_;
-}
-
-void MqttClient::Init(const MqttSettings& settings, const std::string& client_id) {
-  mqtt_ = std::unique_ptr<MqttClient>(new MqttClient(settings, client_id));
-}
-
-std::string_view MqttClient::GetPrefix() {
-  return Settings::Instance().mqtt.discovery_prefix;
-}
-
-void MqttClient::Publish(const std::string& topic, std::string_view payload, int qos, bool retain) {
+void PahoMqttClient::Publish(const std::string& topic, std::string_view payload, int qos, bool retain) {
+  TRACE_SPAN("MqttClient::Publish", topic);
   spdlog::debug("Publish to {}, payload: {}", topic, payload);
   client_.publish(topic, payload.data(), payload.size(), qos, retain);
+  ++published_messages_;
 }
 
-void MqttClient::Subscribe(std::string topic, SubscriptionCalllback&& callback) {
-  spdlog::debug("Subscribing to {}...", topic);
-  if (!subscription_handler_) {
-    subscription_handler_ = std::make_unique<std::thread>([this]() { SubscriptionHandler(); });
-  }
+MqttClient::Statistics PahoMqttClient::GetStatistics() const {
+  return {.published_messages = published_messages_,
+          .pending_messages = client_.get_pending_delivery_tokens().size()};
+}
 
+void PahoMqttClient::Subscribe(std::string topic, SubscriptionCalllback&& callback) {
+  spdlog::debug("Subscribing to {}...", topic);
   {
+    // Pollers of several devices may subscribe at the same time.
     std::lock_guard lock(subscriptions_mutex_);
+    if (!subscription_handler_) {
+      subscription_handler_ = std::make_unique<std::thread>([this]() { SubscriptionHandler(); });
+    }
     subscriptions_storage_.insert(subscriptions_storage_.end(), std::move(callback));
     subscriptions_[topic] = &subscriptions_storage_.back();
   }
   client_.subscribe(topic, 0);
 }
 
-void MqttClient::SubscriptionHandler() {
+void PahoMqttClient::SubscriptionHandler() {
   while (true) {
     auto message = client_.consume_message();
     if (!message) {
@@ -97,3 +111,19 @@ void MqttClient::SubscriptionHandler() {
     }
   }
 }
+
+MqttClient& MqttClient::Instance() {
+  return *mqtt_;
+}
+
+void MqttClient::Init(const MqttSettings& settings, const std::string& client_id) {
+  Install(std::make_unique<PahoMqttClient>(settings, client_id));
+}
+
+void MqttClient::Install(std::unique_ptr<MqttClient> client) {
+  mqtt_ = std::move(client);
+}
+
+std::string_view MqttClient::GetPrefix() {
+  return Settings::Instance().mqtt.discovery_prefix;
+}
@@ -1,31 +1,38 @@
 #pragma once
 
+#include <cstdint>
 #include <format>
+#include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
 
 #include "configuration.h"
-#include "mqtt/async_client.h"
 
 class MqttClient {
  public:
   static MqttClient& Instance();
+  /// Connect to the broker with the paho client.
   static void Init(const MqttSettings&, const std::string& client_id);
+  /// Use the given client instead of the paho one, e.g. a stub in benchmarks.
+  static void Install(std::unique_ptr<MqttClient>);
 
-  ~MqttClient();
+  virtual ~MqttClient() = default;
 
   /// @param retain Whether the message should be retained by the broker.
   /// @param qos https://www.hivemq.com/blog/mqtt-essentials-part-6-mqtt-quality-of-service-levels/
-  void Publish(const std::string& sub_topic, std::string_view payload,
-               int qos = 1, bool retain = false);
+  virtual void Publish(const std::string& sub_topic, std::string_view payload,
+                       int qos = 1, bool retain = false) = 0;
   static std::string_view GetPrefix();
 
   using SubscriptionCalllback = std::function<void(std::string)>;
-  void Subscribe(std::string topic, SubscriptionCalllback&&);
-
- private:
-  MqttClient(const MqttSettings&, const std::string& client_id);
-  void SubscriptionHandler();
-
-  mqtt::async_client client_;
+  virtual void Subscribe(std::string topic, SubscriptionCalllback&&) = 0;
+
+  struct Statistics {
+    /// The number of Publish() calls since the start.
+    std::uint64_t published_messages = 0;
+    /// Messages that haven't been delivered to the broker yet.
+    std::size_t pending_messages = 0;
+  };
+  virtual Statistics GetStatistics() const = 0;
 };
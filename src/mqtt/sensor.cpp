@@ -1,8 +1,11 @@
 #include "sensor.hh"
+#include "json.hh"
 #include "mqtt.hh"
 #include "configuration.h"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <array>
 #include <format>
 #include <ranges>
 #include <stdexcept>
@@ -10,177 +13,306 @@
 namespace mqtt {
 namespace {
 
-constexpr std::string_view ToString(Sensor::Kind d) {
+constexpr std::string_view ToString(SensorKind d) {
   switch (d) {
-    case Sensor::Kind::kVoltage: return "voltage";
-    case Sensor::Kind::kCurrent: return "current";
-    case Sensor::Kind::kFrequency: return "frequency";
-    case Sensor::Kind::kPower: return "power";
-    case Sensor::Kind::kApparentPower: return "apparent_power";
-    case Sensor::Kind::kEnergy: return "energy";
-    case Sensor::Kind::kPercent: return "";
-    case Sensor::Kind::kTemperature: return "temperature";
-    case Sensor::Kind::kBattery: return "battery";
-    case Sensor::Kind::kNone: return "";
+    case SensorKind::kVoltage: return "voltage";
+    case SensorKind::kCurrent: return "current";
+    case SensorKind::kFrequency: return "frequency";
+    case SensorKind::kPower: return "power";
+    case SensorKind::kApparentPower: return "apparent_power";
+    case SensorKind::kEnergy: return "energy";
+    case SensorKind::kPercent: return "";
+    case SensorKind::kTemperature: return "temperature";
+    case SensorKind::kBattery: return "battery";
+    case SensorKind::kDuration: return "duration";
+    case SensorKind::kDataSize: return "data_size";
+    case SensorKind::kProblem: return "problem";
+    case SensorKind::kNone: return "";
   }
   throw std::runtime_error("unreachable");
 }
 
-constexpr std::string_view GetMeasurement(Sensor::Kind d) {
+constexpr std::string_view GetMeasurement(SensorKind d) {
   switch (d) {
-    case Sensor::Kind::kVoltage: return "V";
-    case Sensor::Kind::kCurrent: return "A";
-    case Sensor::Kind::kFrequency: return "Hz";
-    case Sensor::Kind::kPower: return "W";
-    case Sensor::Kind::kApparentPower: return "VA";
-    case Sensor::Kind::kEnergy: return "kWh";
-    case Sensor::Kind::kPercent: return "%";
-    case Sensor::Kind::kTemperature: return "°C";
-    case Sensor::Kind::kBattery: return "%";
-    case Sensor::Kind::kNone: return "";
+    case SensorKind::kVoltage: return "V";
+    case SensorKind::kCurrent: return "A";
+    case SensorKind::kFrequency: return "Hz";
+    case SensorKind::kPower: return "W";
+    case SensorKind::kApparentPower: return "VA";
+    case SensorKind::kEnergy: return "kWh";
+    case SensorKind::kPercent: return "%";
+    case SensorKind::kTemperature: return "°C";
+    case SensorKind::kBattery: return "%";
+    case SensorKind::kDuration: return "ms";
+    case SensorKind::kDataSize: return "MiB";
+    case SensorKind::kProblem: return "";
+    case SensorKind::kNone: return "";
   }
   throw std::runtime_error("unreachable");
 }
 
-std::string_view GetDeviceInfo() {
-  static std::string info;
-  if (info.empty()) {
-    const auto& device = Settings::Instance().device;
-    info = std::format(
-        R"({{"ids":"{}","mf":"{}","mdl":"{}","name":"{}"}})",
-        device.serial_number, device.manufacturer, device.model, device.name);
+constexpr std::string_view ToString(SensorPlatform p) {
+  switch (p) {
+    case SensorPlatform::kSensor: return "sensor";
+    case SensorPlatform::kBinarySensor: return "binary_sensor";
+    case SensorPlatform::kSelect: return "select";
+    case SensorPlatform::kSwitch: return "switch";
   }
-  return info;
+  throw std::runtime_error("unreachable");
 }
 
-std::string_view GetDeviceId() {
-  static std::string id;
-  if (id.empty()) {
-    const auto& device = Settings::Instance().device;
-    id = std::format("{}_{}", device.name, device.serial_number);
+/// @returns the members of the discovery payload that depend only on the description of the
+///          sensor, comma-separated, e.g. "device_class":"voltage","name":"Grid voltage",...
+///          The name and the icon are expected to need no escaping, see IsPlain().
+constexpr std::string DescribeSensor(const SensorInfo& info) {
+  std::string result;
+  const auto add = [&result](std::string_view key, std::string_view value, bool quoted = true) {
+    if (!result.empty()) result += ',';
+    result += '"';
+    result += key;
+    result += "\":";
+    if (quoted) result += '"';
+    result += value;
+    if (quoted) result += '"';
+  };
+
+  const auto device_class = ToString(info.kind);
+  if (!device_class.empty()) {
+    add("device_class", device_class);
+  }
+  // If NOT "None", the sensor is assumed to be numerical and will be displayed as a line-chart in
+  // the frontend instead of as discrete values.
+  // https://developers.home-assistant.io/docs/core/entity/sensor/#available-state-classes
+  if (info.is_counter) {
+    add("state_class", "total_increasing");
+  } else if (!device_class.empty() && info.platform == SensorPlatform::kSensor) {
+    add("state_class", "measurement");
   }
-  return id;
-}
 
-}  // namespace
+  if (!info.icon.empty()) {
+    add("icon", std::string("mdi:") + std::string(info.icon));
+  }
+  std::string control_name(info.name);
+  std::ranges::replace(control_name, '_', ' ');  // replace underscores with whitespaces
+  add("name", control_name);
 
-std::string Sensor::TopicRoot() const {
-  const auto mqtt_prefix = MqttClient::GetPrefix();
-  return std::format("{}/{}/{}/{}", mqtt_prefix, Type(), GetDeviceId(), name_);
+  const auto unit_of_measurement = GetMeasurement(info.kind);
+  if (!unit_of_measurement.empty()) {
+    add("unit_of_measurement", unit_of_measurement);
+  }
+  if (info.is_diagnostic) {
+    add("entity_category", "diagnostic");
+  }
+  switch (info.platform) {
+    case SensorPlatform::kBinarySensor:
+      add("payload_on", "1");
+      add("payload_off", "0");
+      break;
+    case SensorPlatform::kSwitch:
+      add("payload_on", "1", false);
+      add("payload_off", "0", false);
+      break;
+    case SensorPlatform::kSensor:
+    case SensorPlatform::kSelect:
+      break;
+  }
+  return result;
 }
 
-std::string Sensor::StateTopic() const {
-  return std::format("{}/state", TopicRoot());
-}
+/// DescribeSensor() of every sensor of the catalogue, made at compile time: the descriptions one
+/// after another, and the offsets of them.
+template<std::size_t kLength>
+struct Descriptions {
+  std::array<char, kLength> text{};
+  std::array<std::size_t, kSensorCount + 1> offsets{};
 
-void Sensor::Register() {
-  std::string payload = "{\n";
-  payload.append(std::format("\t\"device\":{}", GetDeviceInfo()));
-  const auto device_class = ToString(device_class_);
-  if (!device_class.empty()) {
-    payload.append(std::format(",\n\t\"device_class\":\"{}\"", device_class));
+  constexpr std::string_view Get(SensorId id) const {
+    const auto index = ToIndex(id);
+    return {text.data() + offsets[index], offsets[index + 1] - offsets[index]};
+  }
+};
 
-    // If NOT "None", the sensor is assumed to be numerical and will be displayed as a line-chart in
-    // the frontend instead of as discrete values.
-    // https://developers.home-assistant.io/docs/core/entity/sensor/#available-state-classes
-    payload.append(",\n\t").append(R"("state_class":"measurement")");
+consteval std::size_t GetDescriptionsLength() {
+  std::size_t length = 0;
+  for (const auto& entry : kCatalogue) {
+    length += DescribeSensor(entry.info).length();
   }
+  return length;
+}
 
-  if (auto icon = Icon(); !icon.empty()) {
-    payload.append(",\n\t").append(std::format(R"("icon":"mdi:{}")", icon));
+constexpr auto kDescriptions = [] {
+  Descriptions<GetDescriptionsLength()> result;
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < kSensorCount; ++i) {
+    result.offsets[i] = offset;
+    for (const char c : DescribeSensor(kCatalogue[i].info)) {
+      result.text[offset++] = c;
+    }
   }
-  std::string control_name(name_);
-  std::ranges::replace(control_name, '_', ' ');  // replace underscores with whitespaces
-  payload.append(",\n\t").append(std::format(R"("name":"{}")", control_name));
-  payload.append(",\n\t").append(std::format(R"("state_topic":"{}")", StateTopic()));
+  result.offsets[kSensorCount] = offset;
+  return result;
+}();
+
+/// Caches a string made of the current device's settings. The cache is per thread, and it's rebuilt
+/// when the thread switches to another device.
+template<typename Maker>
+std::string_view GetCached(Maker&& make) {
+  thread_local const DeviceSettings* device = nullptr;
+  thread_local std::string value;
+  const auto& current = Settings::CurrentDevice();
+  if (device != &current || value.empty()) {
+    device = &current;
+    value = make(current);
+  }
+  return value;
+}
 
-  auto unique_id = std::format("{}_{}", Settings::Instance().device.serial_number, name_);
-  payload.append(",\n\t").append(std::format(R"("unique_id":"{}")", unique_id));
+/// The largest discovery payloads (selectors) are about 400 bytes.
+constexpr std::size_t kDiscoveryPayloadCapacity = 512;
 
-  const auto unit_of_measurement = GetMeasurement(device_class_);
-  if (!unit_of_measurement.empty()) {
-    payload.append(",\n\t").append(std::format(R"("unit_of_measurement":"{}")", unit_of_measurement));
+std::string_view GetDeviceInfo() {
+  return GetCached([](const DeviceSettings& device) {
+    JsonWriter info(128);
+    info.BeginObject();
+    info.Key("ids").String(device.serial_number);
+    info.Key("mf").String(device.manufacturer);
+    info.Key("mdl").String(device.model);
+    info.Key("name").String(device.name);
+    info.EndObject();
+    return std::move(info).Release();
+  });
+}
+
+std::string_view GetDeviceId() {
+  return GetCached([](const DeviceSettings& device) {
+    return std::format("{}_{}", device.name, device.serial_number);
+  });
+}
+
+std::string TopicRoot(const SensorInfo& info) {
+  const auto mqtt_prefix = MqttClient::GetPrefix();
+  return std::format("{}/{}/{}/{}", mqtt_prefix, ToString(info.platform), GetDeviceId(),
+                     info.name);
+}
+
+/// @param description - see DescribeSensor().
+/// @param options - the options of a selector.
+void PublishDiscovery(const SensorInfo& info, std::string_view description,
+                      std::span<const std::string> options) {
+  JsonWriter payload(kDiscoveryPayloadCapacity);
+  payload.BeginObject();
+  payload.Key("device").Raw(GetDeviceInfo());
+  payload.Key("state_topic").String(implementation_details::StateTopic(info));
+  payload.Key("unique_id").String(
+      std::format("{}_{}", Settings::CurrentDevice().serial_number, info.name));
+  if (info.platform == SensorPlatform::kSelect || info.platform == SensorPlatform::kSwitch) {
+    payload.Key("command_topic").String(implementation_details::CommandTopic(info));
   }
-  const auto additional_info = AdditionalRegistrationOptions();
-  if (!additional_info.empty()) {
-    payload.append(std::format(",\n\t{}", additional_info));
+  payload.Raw(description);
+  if (info.platform == SensorPlatform::kSelect) {
+    payload.Key("options").BeginArray();
+    for (const auto& option : options) {
+      payload.String(option);
+    }
+    payload.EndArray();
   }
-  payload += "\n}";
+  payload.EndObject();
+
+  MqttClient::Instance().Publish(std::format("{}/config", TopicRoot(info)), payload.View(), 1,
+                                 true);
+}
+
+}  // namespace
+
+namespace implementation_details {
+
+void Register(SensorId id, std::span<const std::string> options) {
+  PublishDiscovery(GetEntry(id).info, kDescriptions.Get(id), options);
+}
+
+void Register(const SensorInfo& info) {
+  PublishDiscovery(info, DescribeSensor(info), {});
+}
+
+std::string StateTopic(const SensorInfo& info) {
+  return std::format("{}/state", TopicRoot(info));
+}
 
-  MqttClient::Instance().Publish(std::format("{}/config", TopicRoot()), payload, 1, true);
-  OnRegisterSuccessful();
+std::string CommandTopic(const SensorInfo& info) {
+  // Selectors are commanded through their state topic.
+  if (info.platform == SensorPlatform::kSelect) return StateTopic(info);
+  return std::format("{}/command", TopicRoot(info));
 }
 
-void Sensor::Publish() const {
-  const auto value_str = ValueToString();
-  spdlog::info("{}: {}", name_, value_str);
+void Publish(const SensorInfo& info, std::string_view value) {
+  spdlog::info("{}: {}", info.name, value);
 
   // Using "retain" always is just easier. If not retain messages then Home Assistant often skips
   // the first message sensor update after the sensor is created (because HA needs some time to
   // create the sensor). If retain only the first sensor update, then some tricky situations are
   // possible with "select" sensors.
-  MqttClient::Instance().Publish(StateTopic(), value_str, 0, true);
+  MqttClient::Instance().Publish(StateTopic(info), value, 0, true);
 }
 
-namespace implementation_details {
+metrics::Metric* AddMetric(const SensorInfo& info, metrics::StateFormatter state_formatter) {
+  const auto device = Settings::Instance().IsGateway() ? Settings::CurrentDevice().serial_number
+                                                       : "";
+  return metrics::Registry::Instance().Add(
+      info.name, info.is_counter ? metrics::Type::kCounter : metrics::Type::kGauge,
+      state_formatter, device);
+}
+
+history::Series* GetHistory(const SensorInfo& info) {
+  if (Settings::Instance().IsGateway()) {
+    return history::History::Instance().GetSeries(
+        std::format("{}/{}", Settings::CurrentDevice().serial_number, info.name));
+  }
+  return history::History::Instance().GetSeries(info.name);
+}
 
 void SubscribeToTopic(const std::string& topic, std::function<void(const std::string)>&& callback) {
-  MqttClient::Instance().Subscribe(topic, std::move(callback));
+  // Callbacks are run by the MQTT thread, on behalf of the device that has subscribed.
+  MqttClient::Instance().Subscribe(
+      topic, [&device = Settings::CurrentDevice(), callback = std::move(callback)](
+          const std::string& payload) {
+        DeviceScope scope(device);
+        callback(payload);
+      });
 }
 
 }  // namespace implementation_details
 
-namespace {
-
-/// For 12V inverters.
-struct BatteryStopChargingVoltageWithGrid12v : public BatteryStopChargingVoltageWithGrid {
-  BatteryStopChargingVoltageWithGrid12v(OnSelectedCallback&& callback)
-      : BatteryStopChargingVoltageWithGrid(
-      {0, 120, 123, 125, 128, 130, 133, 135, 138, 140, 143, 145}, std::move(callback)) {}
-};
-
-/// For 24V inverters.
-struct BatteryStopChargingVoltageWithGrid24v : public BatteryStopChargingVoltageWithGrid {
-  BatteryStopChargingVoltageWithGrid24v(OnSelectedCallback&& callback)
-      : BatteryStopChargingVoltageWithGrid(
-      {0, 240, 245, 250, 255, 260, 265, 270, 275, 280, 285, 290}, std::move(callback)) {}
-};
-
-/// For 48V inverters.
-struct BatteryStopChargingVoltageWithGrid48v : public BatteryStopChargingVoltageWithGrid {
-  BatteryStopChargingVoltageWithGrid48v(OnSelectedCallback&& callback)
-      : BatteryStopChargingVoltageWithGrid(
-      {0, 480, 490, 500, 510, 520, 530, 540, 550, 560, 570, 580}, std::move(callback)) {}
-};
-
-}  // namespace
+BatteryStopChargingVoltageWithGrid::BatteryStopChargingVoltageWithGrid(
+    SensorValues& values, const std::vector<int>& voltages, OnSelectedCallback&& callback)
+    : Selector<int>(values, SensorId::kBatteryStopChargingVoltageWithGrid, voltages,
+                    std::move(callback), &ValueToString, &ValueFromString) {}
 
 std::unique_ptr<BatteryStopChargingVoltageWithGrid> BatteryStopChargingVoltageWithGrid::Create(
-    int inverter_voltage, OnSelectedCallback&& callback) {
+    SensorValues& values, int inverter_voltage, OnSelectedCallback&& callback) {
+  std::vector<int> voltages;
   switch (inverter_voltage) {
-    case 12: return std::make_unique<BatteryStopChargingVoltageWithGrid12v>(std::move(callback));
-    case 24: return std::make_unique<BatteryStopChargingVoltageWithGrid24v>(std::move(callback));
-    case 48: return std::make_unique<BatteryStopChargingVoltageWithGrid48v>(std::move(callback));
+    case 12: voltages = {0, 120, 123, 125, 128, 130, 133, 135, 138, 140, 143, 145}; break;
+    case 24: voltages = {0, 240, 245, 250, 255, 260, 265, 270, 275, 280, 285, 290}; break;
+    case 48: voltages = {0, 480, 490, 500, 510, 520, 530, 540, 550, 560, 570, 580}; break;
+    default:
+      throw std::runtime_error(std::format("Unknown inverter voltage: {}", inverter_voltage));
   }
-  throw std::runtime_error(std::format("Unknown inverter voltage: {}", inverter_voltage));
+  // The constructor isn't public.
+  return std::unique_ptr<BatteryStopChargingVoltageWithGrid>(
+      new BatteryStopChargingVoltageWithGrid(values, voltages, std::move(callback)));
 }
 
-std::string BatteryStopChargingVoltageWithGrid::ValueToString(const int& value, bool for_json) const
-{
-  std::string result;
-  if (value == 0) {
-    result = "0";
-  } else {
-    const auto truncated_value = value / 10;
-    const auto remnant = value % 10;
-    result = (remnant == 0)
-           ? std::format("{}", truncated_value)
-           : std::format("{}.{}", truncated_value, remnant);
-  }
-  return for_json ? std::format("\"{}\"", result) : result;
+std::string BatteryStopChargingVoltageWithGrid::ValueToString(const int& value) {
+  if (value == 0) return "0";
+
+  const auto truncated_value = value / 10;
+  const auto remnant = value % 10;
+  return (remnant == 0)
+         ? std::format("{}", truncated_value)
+         : std::format("{}.{}", truncated_value, remnant);
 }
 
-int BatteryStopChargingVoltageWithGrid::ValueFromString(const std::string& str) const {
+int BatteryStopChargingVoltageWithGrid::ValueFromString(const std::string& str) {
   return std::stof(str) * 10;
 }
 
@@ -1,193 +1,335 @@
 #pragma once
 
+#include <array>
+#include <bitset>
 #include <functional>
 #include <format>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
 #include <type_traits>
 #include <vector>
 
+#include "history.hh"
+#include "metrics/registry.hh"
 #include "protocols/types.hh"
+#include "sensors.hh"
 #include "spdlog/spdlog.h"
 #include "utils.h"
 
 namespace mqtt {
 
+/// How values are published to MQTT.
+template<typename ValueType>
+std::string ValueToString(const ValueType& value) {
+  if constexpr (std::is_same_v<ValueType, bool>) {
+    return value ? "1" : "0";
+  } else if constexpr (std::is_arithmetic_v<ValueType>) {
+    return std::format("{}", value);
+  } else if constexpr (std::is_enum_v<ValueType>) {
+    return std::string(ToString(value));
+  } else if constexpr (std::is_same_v<ValueType, std::string>) {
+    return value;
+  } else {
+    throw std::runtime_error("Unknown type");
+  }
+}
 
-/// https://www.home-assistant.io/integrations/mqtt/#mqtt-discovery
-/// https://www.home-assistant.io/integrations/sensor.mqtt/
-class Sensor {
- public:
-  enum class Kind {
-    kVoltage, // in volts (V)
-    kCurrent, // in amps (A)
-    kFrequency, // in hertz (Hz)
-    kPower, // in watts (W)
-    kApparentPower, // in volt-amperes (VA)
-    kEnergy, // kilo watt hour, kWh
-    kPercent, // no class, measurement is %
-    kTemperature, // celsius, °C
-    kBattery, // in %
-    kNone, // no class
-  };
-
-  virtual ~Sensor() = default;
-
-  constexpr std::string_view GetName() const { return name_; }
-
- protected:
-  /// @param device_class Optional. One of https://www.home-assistant.io/integrations/sensor/#device-class
-  /// @param icon Optional. https://www.home-assistant.io/docs/configuration/customizing-devices/#icon
-  constexpr Sensor(std::string_view name, Kind device_class)
-      : name_(name), device_class_(device_class) {}
+/// The opposite of ValueToString(), for the values set from Home Assistant.
+template<typename ValueType>
+ValueType ValueFromString(const std::string& str) {
+  if constexpr (std::is_same_v<ValueType, bool>) {
+    return str == "1";
+  } else if constexpr (std::is_integral_v<ValueType>) {
+    return std::stoi(str);
+  } else if constexpr (std::is_floating_point_v<ValueType>) {
+    return std::stof(str);
+  } else if constexpr (std::is_enum_v<ValueType>) {
+    ValueType result;
+    FromString(str, result);
+    return result;
+  } else if constexpr (std::is_same_v<ValueType, std::string>) {
+    return str;
+  } else {
+    throw std::runtime_error("Unknown sensor type");
+  }
+}
 
-  std::string TopicRoot() const;
-  std::string StateTopic() const;
+template<typename ValueType>
+using ValueFormatter = std::string (*)(const ValueType&);
+template<typename ValueType>
+using ValueParser = ValueType (*)(const std::string&);
 
-  /// Register the sensor in MQTT so that Home Assistant is able to see it.
-  /// @see https://www.home-assistant.io/integrations/mqtt/#mqtt-discovery
-  void Register();
-  void Publish() const;
+namespace implementation_details {
 
-  constexpr virtual std::string_view Type() const { return "sensor"; }
-  constexpr virtual std::string_view Icon() const { return ""; }
-  constexpr virtual std::string AdditionalRegistrationOptions() const { return ""; }
-  constexpr virtual void OnRegisterSuccessful() {}
+/// Register a sensor of the catalogue in MQTT so that Home Assistant is able to see it. The most
+/// of the discovery payload is made of kCatalogue at compile time.
+/// @see https://www.home-assistant.io/integrations/mqtt/#mqtt-discovery
+/// @param options - the options of a selector, empty for other sensors.
+void Register(SensorId, std::span<const std::string> options = {});
+/// The same for a sensor described at runtime, see NamedSensor.
+void Register(const SensorInfo&);
 
-  inline static std::mutex mutex_;
+std::string StateTopic(const SensorInfo&);
+std::string CommandTopic(const SensorInfo&);
+void Publish(const SensorInfo&, std::string_view value);
 
- private:
-  virtual std::string ValueToString() const = 0;
+/// Export the sensor to Prometheus, see metrics::Registry. Only numbers and enumerations could be
+/// scraped, nullptr for other types.
+template<typename ValueType>
+metrics::Metric* AddMetric(const SensorInfo&);
+metrics::Metric* AddMetric(const SensorInfo&, metrics::StateFormatter);
+/// @returns nullptr if the history is disabled or the values aren't numbers.
+template<typename ValueType>
+history::Series* GetHistory(const SensorInfo&);
+history::Series* GetHistory(const SensorInfo&);
 
-  const std::string_view name_;
-  const Kind device_class_;
-};
+void SubscribeToTopic(const std::string&, std::function<void(const std::string)>&&);
 
+template<typename ValueType>
+metrics::Metric* AddMetric(const SensorInfo& info) {
+  if constexpr (std::is_arithmetic_v<ValueType>) {
+    return AddMetric(info, nullptr);
+  } else if constexpr (std::is_enum_v<ValueType>) {
+    return AddMetric(info, [](int value) -> std::string {
+      return std::string(ToString(static_cast<ValueType>(value)));
+    });
+  } else {
+    return nullptr;
+  }
+}
 
 template<typename ValueType>
-class TypedSensor : public Sensor {
- public:
-  constexpr TypedSensor(std::string_view name, Kind device_class = Kind::kNone)
-      : Sensor(name, device_class) {}
+history::Series* GetHistory(const SensorInfo& info) {
+  if constexpr (std::is_arithmetic_v<ValueType>) {
+    return GetHistory(info);
+  } else {
+    return nullptr;
+  }
+}
 
-  std::optional<ValueType> GetValue() const {
-    std::lock_guard lock(mutex_);
-    return value_;
+consteval std::size_t CountTextSensors() {
+  std::size_t count = 0;
+  for (const auto& entry : kCatalogue) {
+    if (entry.type == ValueType::kString) ++count;
+  }
+  return count;
+}
+
+/// The position of every text sensor among the text sensors of the catalogue.
+consteval std::array<std::size_t, kSensorCount> GetTextIndices() {
+  std::array<std::size_t, kSensorCount> result{};
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < kSensorCount; ++i) {
+    result[i] = count;
+    if (kCatalogue[i].type == ValueType::kString) ++count;
   }
+  return result;
+}
 
-  /// Set and update sensor's value in HomeAssistant.
-  /// Does nothing if the new value is the same as the previous one.
-  void Update(ValueType new_value) {
+inline constexpr std::size_t kTextSensorCount = CountTextSensors();
+inline constexpr auto kTextIndices = GetTextIndices();
+
+}  // namespace implementation_details
+
+
+/// Values of the sensors of the catalogue (see sensors.hh) of a device. They are kept in flat
+/// arrays indexed by SensorId, rather than by the sensors themselves, which are just handles (see
+/// TypedSensor): numbers, enumerations and booleans are all stored as doubles, which hold them
+/// exactly, and texts are stored apart.
+/// This class is thread-safe: values set from Home Assistant are updated by the MQTT thread.
+class SensorValues {
+ public:
+  template<typename ValueType>
+  std::optional<ValueType> Get(SensorDescriptor<ValueType> sensor) const {
     std::lock_guard lock(mutex_);
+    return Load(sensor);
+  }
 
-    if (!value_.has_value()) {
-      Register();
-    } else if (new_value == value_) {
-      return;
+  /// Set the value of the @a sensor and publish it in Home Assistant, unless it's the same as the
+  /// previous one. The sensor is registered with its first value.
+  /// @param format - turns the value into the MQTT payload.
+  /// @param options - the options of a selector, see Register().
+  /// @returns whether the sensor has been registered by this call.
+  template<typename ValueType>
+  bool Update(SensorDescriptor<ValueType> sensor, ValueType new_value,
+              ValueFormatter<ValueType> format = &ValueToString<ValueType>,
+              std::span<const std::string> options = {}) {
+    std::lock_guard lock(mutex_);
+    const auto& info = sensor.GetInfo();
+    const auto index = ToIndex(sensor.id);
+    const auto previous_value = Load(sensor);
+
+    if (!previous_value) {
+      implementation_details::Register(sensor.id, options);
+      metrics_[index] = implementation_details::AddMetric<ValueType>(info);
+      series_[index] = implementation_details::GetHistory<ValueType>(info);
+    }
+    if constexpr (std::is_arithmetic_v<ValueType>) {
+      // Every sample goes to the history (unlike to MQTT), otherwise averages would be skewed.
+      if (series_[index]) {
+        series_[index]->Add(std::chrono::system_clock::now(), static_cast<float>(new_value));
+      }
+    }
+    if (new_value == previous_value) {
+      return false;
     }
 
-    value_ = new_value;
-    Publish();
+    Store(sensor, new_value);
+    if constexpr (std::is_arithmetic_v<ValueType> || std::is_enum_v<ValueType>) {
+      if (metrics_[index]) metrics_[index]->Set(numbers_[index]);
+    }
+    implementation_details::Publish(info, format(new_value));
+    return !previous_value;
   }
 
- protected:
-  std::string ValueToString() const final { return ValueToString(*value_, false); }
+  /// Publish the current value of the @a sensor again, e.g. after Home Assistant has failed to
+  /// change it.
+  template<typename ValueType>
+  void Republish(SensorDescriptor<ValueType> sensor, ValueFormatter<ValueType> format) const {
+    std::lock_guard lock(mutex_);
+    if (const auto value = Load(sensor)) {
+      implementation_details::Publish(sensor.GetInfo(), format(*value));
+    }
+  }
 
-  virtual std::string ValueToString(const ValueType& value, bool for_json) const {
-    if constexpr (std::is_same_v<ValueType, bool>) {
-      return value ? "1" : "0";
-    } else if constexpr (std::is_arithmetic_v<ValueType>) {
-      return std::format("{}", value);
+ private:
+  template<typename ValueType>
+  std::optional<ValueType> Load(SensorDescriptor<ValueType> sensor) const {
+    const auto index = ToIndex(sensor.id);
+    if (!known_[index]) return std::nullopt;
+    if constexpr (std::is_same_v<ValueType, std::string>) {
+      return texts_[implementation_details::kTextIndices[index]];
     } else if constexpr (std::is_enum_v<ValueType>) {
-      return for_json ? std::format("\"{}\"", ToString(value)) : ToString(value);
-    } else if constexpr (std::is_same_v<ValueType, std::string>) {
-      return for_json ? std::format("\"{}\"", value) : value;
+      return static_cast<ValueType>(static_cast<std::underlying_type_t<ValueType>>(numbers_[index]));
     } else {
-      throw std::runtime_error("Unknown type");
+      return static_cast<ValueType>(numbers_[index]);
     }
   }
 
-  virtual ValueType ValueFromString(const std::string& str) const {
-    if constexpr (std::is_same_v<ValueType, bool>) {
-      return str == "1";
-    } else if constexpr (std::is_integral_v<ValueType>) {
-      return std::stoi(str);
-    } else if constexpr (std::is_floating_point_v<ValueType>) {
-      return std::stof(str);
+  template<typename ValueType>
+  void Store(SensorDescriptor<ValueType> sensor, const ValueType& value) {
+    const auto index = ToIndex(sensor.id);
+    known_.set(index);
+    if constexpr (std::is_same_v<ValueType, std::string>) {
+      texts_[implementation_details::kTextIndices[index]] = value;
     } else if constexpr (std::is_enum_v<ValueType>) {
-      ValueType result;
-      FromString(str, result);
-      return result;
-    } else if constexpr (std::is_same_v<ValueType, std::string>) {
-      return str;
+      numbers_[index] = static_cast<std::underlying_type_t<ValueType>>(value);
     } else {
-      throw std::runtime_error("Unknown sensor type");
+      numbers_[index] = static_cast<double>(value);
     }
   }
 
- private:
-  std::optional<ValueType> value_;
+  mutable std::mutex mutex_;
+  /// Whether a sensor has a value, i.e. it's been registered.
+  std::bitset<kSensorCount> known_;
+  std::array<double, kSensorCount> numbers_{};
+  std::array<std::string, implementation_details::kTextSensorCount> texts_;
+  /// Scrapes read the values from there, so they never take mutex_.
+  std::array<metrics::Metric*, kSensorCount> metrics_{};
+  /// Only numbers have history, nullptr for other types.
+  std::array<history::Series*, kSensorCount> series_{};
 };
 
-namespace implementation_details {
 
-void SubscribeToTopic(const std::string&, std::function<void(const std::string)>&&);
+/// A read-only sensor of the catalogue, i.e. a handle to its value in SensorValues.
+template<typename ValueType>
+class TypedSensor {
+ public:
+  constexpr TypedSensor(SensorValues& values, SensorDescriptor<ValueType> descriptor)
+      : values_(values), descriptor_(descriptor) {}
 
-}  // namespace implementation_details
+  constexpr std::string_view GetName() const { return descriptor_.GetInfo().name; }
+
+  std::optional<ValueType> GetValue() const { return values_.Get(descriptor_); }
+
+  /// Set and update sensor's value in HomeAssistant.
+  /// Does nothing if the new value is the same as the previous one.
+  void Update(ValueType new_value) { values_.Update(descriptor_, new_value); }
+
+ private:
+  SensorValues& values_;
+  const SensorDescriptor<ValueType> descriptor_;
+};
 
 
-/// Base class for sensors that allow to change it's state from Home Assistant interface.
+/// A sensor of the catalogue that allows to change its state from Home Assistant interface, i.e. a
+/// selector or a switch (see SensorPlatform).
 template<typename ValueType>
-class InteractiveTypedSensor : public TypedSensor<ValueType> {
+class InteractiveTypedSensor {
  public:
   /// @return true, if successful, false otherwise
   using OnChangedCallback = std::function<bool(ValueType)>;
+
+  constexpr std::string_view GetName() const { return descriptor_.GetInfo().name; }
+
+  std::optional<ValueType> GetValue() const { return values_.Get(descriptor_); }
+
+  /// Set and update sensor's value in HomeAssistant, see TypedSensor::Update().
+  void Update(ValueType new_value) {
+    if (values_.Update(descriptor_, new_value, format_, options_)) {
+      // Home Assistant sends the commands once it knows the sensor.
+      implementation_details::SubscribeToTopic(
+          implementation_details::CommandTopic(descriptor_.GetInfo()),
+          [this](const std::string& payload) { OnCommand(payload); });
+    }
+  }
+
  protected:
-  constexpr InteractiveTypedSensor(std::string_view name, OnChangedCallback&& on_value_changed)
-      : TypedSensor<ValueType>(name),
-        on_value_changed_(std::move(on_value_changed)) {}
-
-  virtual std::string_view Type() const = 0;
-  virtual std::string AdditionalRegistrationOptions() const = 0;
-  virtual std::string CommandTopic() const { return std::format("{}/command", this->TopicRoot()); }
-
-  void OnRegisterSuccessful() final {
-    auto OnMessageArrived = [this](const std::string& new_value) {
-      auto selected_value = this->ValueFromString(new_value);
-      auto previous_value = this->GetValue();
-      if (!previous_value.has_value() || previous_value == selected_value) return;
-
-      spdlog::warn("Set {} to {}", this->GetName(), new_value);
-      if (on_value_changed_(selected_value)) {
-        // Value has been successfully changed. Update it.
-        this->Update(selected_value);
-      } else {
-        // Failed to change the value. Publish the previous one.
-        spdlog::error("Failed to set {} to {}.", this->GetName(), new_value);
-        std::lock_guard lock(Sensor::mutex_);
-        this->Publish();
-      }
-    };
-    implementation_details::SubscribeToTopic(this->CommandTopic(), std::move(OnMessageArrived));
+  /// @param selectable_options - the options of a selector, nothing for a switch.
+  /// @param format, parse - for the values that aren't published as is.
+  InteractiveTypedSensor(SensorValues& values, SensorDescriptor<ValueType> descriptor,
+                         OnChangedCallback&& on_value_changed,
+                         const std::vector<ValueType>& selectable_options = {},
+                         ValueFormatter<ValueType> format = &ValueToString<ValueType>,
+                         ValueParser<ValueType> parse = &ValueFromString<ValueType>)
+      : values_(values),
+        descriptor_(descriptor),
+        on_value_changed_(std::move(on_value_changed)),
+        format_(format),
+        parse_(parse) {
+    // Home Assistant expects the options as strings, the same as the states.
+    for (const auto& value : selectable_options) {
+      options_.push_back(format_(value));
+    }
   }
 
+ private:
+  void OnCommand(const std::string& new_value) {
+    auto selected_value = parse_(new_value);
+    auto previous_value = GetValue();
+    if (!previous_value.has_value() || previous_value == selected_value) return;
+
+    spdlog::warn("Set {} to {}", GetName(), new_value);
+    if (on_value_changed_(selected_value)) {
+      // Value has been successfully changed. Update it.
+      Update(selected_value);
+    } else {
+      // Failed to change the value. Publish the previous one.
+      spdlog::error("Failed to set {} to {}.", GetName(), new_value);
+      values_.Republish(descriptor_, format_);
+    }
+  }
+
+  SensorValues& values_;
+  const SensorDescriptor<ValueType> descriptor_;
   OnChangedCallback on_value_changed_;
+  const ValueFormatter<ValueType> format_;
+  const ValueParser<ValueType> parse_;
+  std::vector<std::string> options_;
 };
 
 
 /// https://www.home-assistant.io/integrations/switch.mqtt/
 class Switch : public InteractiveTypedSensor<bool> {
  public:
-  Switch(std::string_view name, OnChangedCallback&& value_selected_callback)
-      : InteractiveTypedSensor<bool>(name, std::move(value_selected_callback)) {}
-
- protected:
-  constexpr std::string_view Type() const final { return "switch"; }
-  std::string AdditionalRegistrationOptions() const final {
-    return std::format(R"("command_topic":"{}","payload_on":1,"payload_off":0)", CommandTopic());
-  }
+  Switch(SensorValues& values, SensorDescriptor<bool> descriptor,
+         OnChangedCallback&& value_selected_callback)
+      : InteractiveTypedSensor<bool>(values, descriptor, std::move(value_selected_callback)) {}
 };
 
 
@@ -195,294 +337,119 @@ class Switch : public InteractiveTypedSensor<bool> {
 template<typename ValueType>
 class Selector : public InteractiveTypedSensor<ValueType> {
  public:
-  using Items = std::initializer_list<ValueType>;
   using OnSelectedCallback = InteractiveTypedSensor<ValueType>::OnChangedCallback;
- protected:
-  constexpr Selector(std::string_view name,
-                     std::vector<ValueType>&& selectable_options,
-                     OnSelectedCallback&& value_selected_callback)
-      : InteractiveTypedSensor<ValueType>(name, std::move(value_selected_callback)),
-        selectable_options_(std::move(selectable_options)) {}
-
-  constexpr std::string_view Type() const final { return "select"; }
-  std::string CommandTopic() const final { return this->StateTopic(); }
-
-  std::string AdditionalRegistrationOptions() const final {
-    // Join options to a string with comma separator.
-    std::string options;
-    for (const auto& value : selectable_options_) {
-      if (!options.empty()) {
-        options += ',';
-      }
-      options.append(this->ValueToString(value, true));
-    }
-
-    return std::format(R"("command_topic":"{}", "options":[{}])", this->CommandTopic(), options);
-  }
 
- private:
-  const std::vector<ValueType> selectable_options_;
+  Selector(SensorValues& values, SensorDescriptor<ValueType> descriptor,
+           const std::vector<ValueType>& selectable_options,
+           OnSelectedCallback&& value_selected_callback,
+           ValueFormatter<ValueType> format = &ValueToString<ValueType>,
+           ValueParser<ValueType> parse = &ValueFromString<ValueType>)
+      : InteractiveTypedSensor<ValueType>(values, descriptor, std::move(value_selected_callback),
+                                          selectable_options, format, parse) {}
 };
 
-class AcVoltageSensor : public TypedSensor<float> {
- protected:
-  constexpr AcVoltageSensor(std::string_view name) : TypedSensor(name, Kind::kVoltage) {}
-};
-
-class DcVoltageSensor : public TypedSensor<float> {
- protected:
-  constexpr DcVoltageSensor(std::string_view name) : TypedSensor(name, Kind::kVoltage) {}
-  constexpr std::string_view Icon() const override { return "current-dc"; }
-};
 
-class DcCurrentSensor : public TypedSensor<int> {
- protected:
-  constexpr DcCurrentSensor(std::string_view name) : TypedSensor(name, Kind::kCurrent) {}
-  constexpr std::string_view Icon() const override { return "current-dc"; }
-};
-
-class FrequencySensor : public TypedSensor<float> {
- protected:
-  constexpr FrequencySensor(std::string_view name) : TypedSensor(name, Kind::kFrequency) {}
-};
-
-class PowerSensor : public TypedSensor<int> {
- protected:
-  constexpr PowerSensor(std::string_view name) : TypedSensor(name, Kind::kPower) {}
-};
-
-class ApparentPowerSensor : public TypedSensor<int> {
- protected:
-  constexpr ApparentPowerSensor(std::string_view name) : TypedSensor(name, Kind::kApparentPower) {}
-};
-
-class TemperatureSensor : public TypedSensor<int> {
- protected:
-  constexpr TemperatureSensor(std::string_view name) : TypedSensor(name, Kind::kTemperature) {}
-};
-
-///=================================================================================================
-/// INFO ABOUT GRID.
-///=================================================================================================
-
-struct GridVoltage : public AcVoltageSensor {
-  constexpr GridVoltage() : AcVoltageSensor("Grid_voltage") {}
-};
-
-struct GridFrequency : public FrequencySensor {
-  constexpr GridFrequency() : FrequencySensor("Grid_frequency") {}
-};
-
-///=================================================================================================
-/// INFO ABOUT THE OUTPUT.
-///=================================================================================================
-struct OutputVoltage : public AcVoltageSensor {
-  constexpr OutputVoltage() : AcVoltageSensor("Output_voltage") {}
-};
-
-struct OutputFrequency : public FrequencySensor {
-  constexpr OutputFrequency() : FrequencySensor("Output_frequency") {}
-};
-
-struct OutputApparentPower : public ApparentPowerSensor {
-  constexpr OutputApparentPower() : ApparentPowerSensor("Output_apparent_power") {}
-};
-
-struct OutputActivePower : public PowerSensor {
-  constexpr OutputActivePower() : PowerSensor("Output_active_power") {}
-};
-
-struct OutputLoadPercent : public TypedSensor<int> {
-  constexpr OutputLoadPercent() : TypedSensor("Output_load_percent", Kind::kPercent) {}
-
-  constexpr std::string_view Icon() const override { return "percent"; }
-};
+/// A sensor whose name is made at runtime, e.g. one of the sensors of a particular unit of a
+/// parallel system. Such sensors aren't in the catalogue, so each of them keeps its value and its
+/// description.
+template<typename ValueType>
+class NamedSensor {
+ public:
+  /// @throws std::invalid_argument if the name isn't valid, see SensorInfo::name.
+  explicit NamedSensor(std::string name, SensorKind kind = SensorKind::kNone)
+      : NamedSensor(std::move(name), SensorInfo{.kind = kind}) {}
 
-///=================================================================================================
-/// INFO ABOUT BATTERIES.
-///=================================================================================================
+  // The info refers to the name.
+  NamedSensor(const NamedSensor&) = delete;
+  NamedSensor& operator=(const NamedSensor&) = delete;
 
-struct BatteryType : public Selector<::BatteryType> {
-  constexpr BatteryType(Items types, OnSelectedCallback&& callback)
-      : Selector("Battery_type", types, std::move(callback)) {}
+  std::string_view GetName() const { return name_; }
 
-  constexpr std::string_view Icon() const override { return "car-battery"; }
-};
+  std::optional<ValueType> GetValue() const {
+    std::lock_guard lock(mutex_);
+    return value_;
+  }
 
-struct BatteryCapacity : public TypedSensor<int> {
-  constexpr BatteryCapacity() : TypedSensor("Battery_capacity", Kind::kBattery) {}
-};
+  /// See TypedSensor::Update().
+  void Update(ValueType new_value) {
+    std::lock_guard lock(mutex_);
 
-/// Nominal voltage of the battery, which is the voltage level at which it is designed to operate.
-/// For example, a 12-volt lead-acid battery has a rating voltage of 12 volts.
-struct BatteryVoltage : public DcVoltageSensor {
-  constexpr BatteryVoltage() : DcVoltageSensor("Battery_voltage") {}
-};
+    if (!value_.has_value()) {
+      implementation_details::Register(info_);
+      metric_ = implementation_details::AddMetric<ValueType>(info_);
+      series_ = implementation_details::GetHistory<ValueType>(info_);
+    }
+    if constexpr (std::is_arithmetic_v<ValueType>) {
+      if (series_) series_->Add(std::chrono::system_clock::now(), static_cast<float>(new_value));
+    }
+    if (new_value == value_) {
+      return;
+    }
 
-struct BatteryVoltageFromScc : public DcVoltageSensor {
-  constexpr BatteryVoltageFromScc() : DcVoltageSensor("Battery_voltage_from_SCC") {}
-};
+    value_ = new_value;
+    if constexpr (std::is_arithmetic_v<ValueType> || std::is_enum_v<ValueType>) {
+      if (metric_) metric_->Set(static_cast<double>(new_value));
+    }
+    implementation_details::Publish(info_, ValueToString(new_value));
+  }
 
-struct BatteryVoltageFromScc2 : public DcVoltageSensor {
-  constexpr BatteryVoltageFromScc2() : DcVoltageSensor("Battery_voltage_from_SCC2") {}
-};
+ protected:
+  /// @param info - the description besides the name.
+  NamedSensor(std::string name, const SensorInfo& info) : name_(std::move(name)), info_(info) {
+    if (!IsValidName(name_)) {
+      throw std::invalid_argument(std::format("Invalid sensor name: {}", name_));
+    }
+    info_.name = name_;
+  }
 
-struct BatteryDischargeCurrent : public DcCurrentSensor {
-  constexpr BatteryDischargeCurrent() : DcCurrentSensor("Battery_discharge_current") {}
-};
+ private:
+  inline static std::mutex mutex_;
 
-struct BatteryChargeCurrent : public DcCurrentSensor {
-  constexpr BatteryChargeCurrent() : DcCurrentSensor("Battery_charge_current") {}
+  const std::string name_;
+  SensorInfo info_;
+  std::optional<ValueType> value_;
+  metrics::Metric* metric_ = nullptr;
+  history::Series* series_ = nullptr;
 };
 
-/// Nominal voltage of the battery, which is the voltage level at which it is designed to operate.
-/// For example, a 12-volt lead-acid battery has a rating voltage of 12 volts.
-struct BatteryNominalVoltage : public DcVoltageSensor {
-  constexpr BatteryNominalVoltage() : DcVoltageSensor("Battery_nominal_voltage") {}
-};
 
-/// Cut off voltage, i.e. the voltage level at which the inverter will shut off to protect the
-/// battery from over-discharging.
-/// It is typically set slightly above the battery re-discharge voltage to provide a buffer.
-struct BatteryUnderVoltage : public DcVoltageSensor {
-  constexpr BatteryUnderVoltage() : DcVoltageSensor("Battery_under_voltage") {}
+/// https://www.home-assistant.io/integrations/binary_sensor.mqtt/
+/// Indicates a problem when it is on.
+class ProblemSensor : public NamedSensor<bool> {
+ public:
+  explicit ProblemSensor(std::string name)
+      : NamedSensor<bool>(std::move(name), {.kind = SensorKind::kProblem,
+                                            .platform = SensorPlatform::kBinarySensor}) {}
 };
 
-/// Voltage level at which the inverter maintains a constant voltage to keep the battery fully
-/// charged.
-struct BatteryFloatVoltage : public DcVoltageSensor {
-  constexpr BatteryFloatVoltage() : DcVoltageSensor("Battery_float_voltage") {}
-};
 
-/// Voltage level at which the inverter delivers maximum charging current to the battery during
-/// the bulk charging phase.
-/// @note that's not batteries' voltage. It's the voltage that the inverter uses to charge them.
-/// The bulk charging phase is the initial stage of battery charging where the inverter delivers
-/// maximum charging current to the battery to quickly charge it.
-struct BatteryBulkVoltage : public DcVoltageSensor {
-  constexpr BatteryBulkVoltage() : DcVoltageSensor("Battery_bulk_voltage") {}
+/// Describes the poller itself rather than the inverter: link quality, timings, resource usage.
+template<typename ValueType>
+class DiagnosticSensor : public NamedSensor<ValueType> {
+ public:
+  /// @param is_counter - see SensorInfo::is_counter.
+  DiagnosticSensor(std::string name, SensorKind kind = SensorKind::kNone, bool is_counter = false)
+      : NamedSensor<ValueType>(std::move(name), {.kind = kind, .is_counter = is_counter,
+                                                 .is_diagnostic = true}) {}
 };
 
-/// Battery stop discharging voltage when grid is available.
-/// Also called "battery recharge voltage". Apparently used, when the inverter is instructed to
-/// drain the batteries even when the grid is available (Solar -> Battery -> Utility).
-//12V unit: 11V/11.3V/11.5V/11.8V/12V/12.3V/12.5V/12.8V
-//24V unit: 22V/22.5V/23V/23.5V/24V/24.5V/25V/25.5V
-//48V unit: 44V/45V/46V/47V/48V/49V/50V/51V
-//00.0V means battery is full(charging in float mode).
-struct BatteryStopDischargingVoltageWithGrid : public DcVoltageSensor {
-  constexpr BatteryStopDischargingVoltageWithGrid()
-      : DcVoltageSensor("Battery_stop_discharging_voltage_with_grid") {}
-};
 
 /// Battery stop charging voltage when grid is available.
 /// Also called "battery re-discharge voltage".
 /// @note value is stored internally and is expected to be set as int in 0.1V to avoid
 ///       float-point-related effects.
 /// 00.0V means battery is full(charging in float mode).
-struct BatteryStopChargingVoltageWithGrid : public Selector<int> {
+class BatteryStopChargingVoltageWithGrid : public Selector<int> {
  public:
-  static std::unique_ptr<BatteryStopChargingVoltageWithGrid> Create(int inverter_voltage,
+  static std::unique_ptr<BatteryStopChargingVoltageWithGrid> Create(SensorValues&,
+                                                                    int inverter_voltage,
                                                                     OnSelectedCallback&& callback);
  protected:
-  BatteryStopChargingVoltageWithGrid(std::vector<int>&& voltages, OnSelectedCallback&& callback)
-      : Selector<int>("Battery_stop_charging_voltage_with_grid",
-                      std::move(voltages), std::move(callback)) {}
-
-
-  std::string ValueToString(const int&, bool) const override;
-  int ValueFromString(const std::string&) const override;
-};
-
-///=================================================================================================
-/// PV (Photovoltaics, i.e. solar panels) data.
-///=================================================================================================
-
-struct PvWatts : public PowerSensor { constexpr PvWatts() : PowerSensor("PV_watts") {} };
-struct PvWatts2 : public PowerSensor { constexpr PvWatts2() : PowerSensor("PV2_watts") {} };
-
-struct PvVoltage : public DcVoltageSensor {
-  constexpr PvVoltage() : DcVoltageSensor("PV_voltage") {}
-};
-
-struct Pv2Voltage : public DcVoltageSensor {
-  constexpr Pv2Voltage() : DcVoltageSensor("PV2_voltage") {}
-};
-
-struct PvBusVoltage : public DcVoltageSensor {
-  constexpr PvBusVoltage() : DcVoltageSensor("PV_bus_voltage") {}
-};
-
-struct PvTotalGeneratedEnergy : public TypedSensor<int> {
-  constexpr PvTotalGeneratedEnergy() : TypedSensor("PV_total_generated_energy", Kind::kEnergy) {}
-};
-
-///=================================================================================================
-/// Mode & status & priorities.
-///=================================================================================================
-
-struct InverterMode : public TypedSensor<DeviceMode> {
-  constexpr InverterMode() : TypedSensor("Mode") {}
-};
-
-// TODO That will be a selector
-struct MachineTypeSelector : public TypedSensor<MachineType> {
-  constexpr MachineTypeSelector() : TypedSensor("Machine_type") {}
-};
-
-/// The AC-Input terminal of the off-grid inverters accepts a wide range of sinusoidal voltages.
-/// The APL and UPS modes will allow a wider or narrower selection of voltages.
-struct AcInputVoltageRangeSelector : public Selector<InputVoltageRange> {
-  constexpr AcInputVoltageRangeSelector(Items ranges, OnSelectedCallback&& callback)
-      : Selector("AC_input_voltage_range", ranges, std::move(callback)) {}
-
-  constexpr std::string_view Icon() const override { return "sine-wave"; }
-};
-
-struct OutputSourcePrioritySelector : public Selector<OutputSourcePriority> {
-  constexpr OutputSourcePrioritySelector(Items priorities, OnSelectedCallback&& callback)
-      : Selector("Output_source_priority", priorities, std::move(callback)) {}
-};
-
-struct ChargerSourcePrioritySelector : public Selector<ChargerPriority> {
-  ChargerSourcePrioritySelector(Items priorities, OnSelectedCallback&& callback)
-      : Selector("Charger_source_priority", priorities, std::move(callback)) {}
-};
-
-struct SolarPowerPrioritySelector : public Selector<SolarPowerPriority> {
-  SolarPowerPrioritySelector(Items priorities, OnSelectedCallback&& callback)
-      : Selector("Solar_power_priority", priorities, std::move(callback)) {}
-};
-
-///=================================================================================================
-/// Various info.
-///=================================================================================================
-
-struct HeatsinkTemperature : public TemperatureSensor {
-  constexpr HeatsinkTemperature() : TemperatureSensor("Heatsink_temperature") {}
-};
-
-struct Mptt1ChargerTemperature : public TemperatureSensor {
-  constexpr Mptt1ChargerTemperature() : TemperatureSensor("Mptt1_charger_temperature") {}
-};
-
-struct Mptt2ChargerTemperature : public TemperatureSensor {
-  constexpr Mptt2ChargerTemperature() : TemperatureSensor("Mptt2_charger_temperature") {}
-};
-
-struct WarningsSensor : public TypedSensor<std::string> {
-  constexpr WarningsSensor() : TypedSensor("Warnings") {}
-  constexpr std::string_view Icon() const override { return "alert"; }
-};
-
-///=================================================================================================
-/// Various settings.
-///=================================================================================================
+  BatteryStopChargingVoltageWithGrid(SensorValues&, const std::vector<int>& voltages,
+                                     OnSelectedCallback&& callback);
 
-struct BacklightSwitch : public Switch {
-  BacklightSwitch(OnChangedCallback&& value_selected_callback)
-      : Switch("Backlight", std::move(value_selected_callback)) {}
-  constexpr std::string_view Icon() const override { return "television-ambient-light"; }
+  static std::string ValueToString(const int&);
+  static int ValueFromString(const std::string&);
 };
 
 }  // namespace mqtt
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "protocols/types.hh"
+
+/// The catalogue of the sensors known at compile time: a constexpr table indexed by SensorId. The
+/// values of these sensors are kept by SensorValues (see sensor.hh) and their discovery payloads
+/// are made of the table at compile time. E.g.
+///   mqtt::TypedSensor<float> grid_voltage_{sensor_values_, mqtt::SensorId::kGridVoltage};
+/// The value type of a sensor must match the table, it's checked by the compiler.
+namespace mqtt {
+
+/// Kinds of values, which define the device class and the unit of measurement of a sensor.
+enum class SensorKind : std::uint8_t {
+  kVoltage, // in volts (V)
+  kCurrent, // in amps (A)
+  kFrequency, // in hertz (Hz)
+  kPower, // in watts (W)
+  kApparentPower, // in volt-amperes (VA)
+  kEnergy, // kilo watt hour, kWh
+  kPercent, // no class, measurement is %
+  kTemperature, // celsius, °C
+  kBattery, // in %
+  kDuration, // in milliseconds, ms
+  kDataSize, // in mebibytes, MiB
+  kProblem, // on means a problem, for binary sensors
+  kNone, // no class
+};
+
+/// Home Assistant's entity types.
+enum class SensorPlatform : std::uint8_t {
+  kSensor, // https://www.home-assistant.io/integrations/sensor.mqtt/
+  kBinarySensor, // https://www.home-assistant.io/integrations/binary_sensor.mqtt/
+  kSelect, // https://www.home-assistant.io/integrations/select.mqtt/
+  kSwitch, // https://www.home-assistant.io/integrations/switch.mqtt/
+};
+
+/// Types of the values of sensors, see SensorDescriptor.
+enum class ValueType : std::uint8_t {
+  kBool,
+  kInt,
+  kUnsigned,
+  kFloat,
+  kDouble,
+  kString,
+  kDeviceMode,
+  kMachineType,
+  kBatteryType,
+  kInputVoltageRange,
+  kOutputSourcePriority,
+  kChargerPriority,
+  kSolarPowerPriority,
+  kOutputMode,
+};
+
+template<typename T>
+consteval ValueType GetValueType() {
+  if constexpr (std::is_same_v<T, bool>) return ValueType::kBool;
+  else if constexpr (std::is_same_v<T, int>) return ValueType::kInt;
+  else if constexpr (std::is_same_v<T, unsigned>) return ValueType::kUnsigned;
+  else if constexpr (std::is_same_v<T, float>) return ValueType::kFloat;
+  else if constexpr (std::is_same_v<T, double>) return ValueType::kDouble;
+  else if constexpr (std::is_same_v<T, std::string>) return ValueType::kString;
+  else if constexpr (std::is_same_v<T, DeviceMode>) return ValueType::kDeviceMode;
+  else if constexpr (std::is_same_v<T, MachineType>) return ValueType::kMachineType;
+  else if constexpr (std::is_same_v<T, BatteryType>) return ValueType::kBatteryType;
+  else if constexpr (std::is_same_v<T, InputVoltageRange>) return ValueType::kInputVoltageRange;
+  else if constexpr (std::is_same_v<T, OutputSourcePriority>) {
+    return ValueType::kOutputSourcePriority;
+  } else if constexpr (std::is_same_v<T, ChargerPriority>) return ValueType::kChargerPriority;
+  else if constexpr (std::is_same_v<T, SolarPowerPriority>) return ValueType::kSolarPowerPriority;
+  else if constexpr (std::is_same_v<T, OutputMode>) return ValueType::kOutputMode;
+  else static_assert(!sizeof(T), "Unsupported value type of a sensor");
+}
+
+/// Everything about a sensor but its value and the type of it.
+struct SensorInfo {
+  /// The name is a part of MQTT topics and of the unique id, so it's limited to letters, digits and
+  /// underscores (see IsValidName()).
+  std::string_view name;
+  SensorKind kind = SensorKind::kNone;
+  /// Optional. https://www.home-assistant.io/docs/configuration/customizing-devices/#icon
+  std::string_view icon;
+  /// Whether the value only grows (e.g. the number of errors since the start). Such sensors have
+  /// "total_increasing" state class in Home Assistant and are counters in Prometheus.
+  bool is_counter = false;
+  SensorPlatform platform = SensorPlatform::kSensor;
+  /// Describes the poller itself rather than the inverter.
+  /// https://developers.home-assistant.io/docs/core/entity/#registry-properties
+  bool is_diagnostic = false;
+};
+
+/// @returns whether @a str consists of letters, digits and @a extra characters only, so it needs
+///          no escaping in JSON.
+constexpr bool IsPlain(std::string_view str, std::string_view extra) {
+  for (const char c : str) {
+    if (!(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9') &&
+        extra.find(c) == std::string_view::npos) {
+      return false;
+    }
+  }
+  return true;
+}
+
+constexpr bool IsValidName(std::string_view name) { return !name.empty() && IsPlain(name, "_"); }
+
+/// The icon of DC voltages and currents.
+inline constexpr std::string_view kDcIcon = "current-dc";
+
+/// Sensors of the catalogue, in the order of kCatalogue.
+enum class SensorId : std::uint8_t {
+  // Info about grid.
+  kGridVoltage,
+  kGridFrequency,
+
+  // Info about the output.
+  kOutputVoltage,
+  kOutputFrequency,
+  kOutputApparentPower,
+  kOutputActivePower,
+  kOutputLoadPercent,
+
+  // Info about batteries.
+  kBatteryType,
+  kBatteryCapacity,
+  kBatteryVoltage,
+  kBatteryVoltageFromScc,
+  kBatteryVoltageFromScc2,
+  kBatteryDischargeCurrent,
+  kBatteryChargeCurrent,
+  /// Nominal voltage of the battery, which is the voltage level at which it is designed to operate.
+  /// For example, a 12-volt lead-acid battery has a rating voltage of 12 volts.
+  kBatteryNominalVoltage,
+  /// Cut off voltage, i.e. the voltage level at which the inverter will shut off to protect the
+  /// battery from over-discharging.
+  /// It is typically set slightly above the battery re-discharge voltage to provide a buffer.
+  kBatteryUnderVoltage,
+  /// Voltage level at which the inverter maintains a constant voltage to keep the battery fully
+  /// charged.
+  kBatteryFloatVoltage,
+  /// Voltage level at which the inverter delivers maximum charging current to the battery during
+  /// the bulk charging phase.
+  /// @note that's not batteries' voltage. It's the voltage that the inverter uses to charge them.
+  /// The bulk charging phase is the initial stage of battery charging where the inverter delivers
+  /// maximum charging current to the battery to quickly charge it.
+  kBatteryBulkVoltage,
+  /// Battery stop discharging voltage when grid is available.
+  /// Also called "battery recharge voltage". Apparently used, when the inverter is instructed to
+  /// drain the batteries even when the grid is available (Solar -> Battery -> Utility).
+  //12V unit: 11V/11.3V/11.5V/11.8V/12V/12.3V/12.5V/12.8V
+  //24V unit: 22V/22.5V/23V/23.5V/24V/24.5V/25V/25.5V
+  //48V unit: 44V/45V/46V/47V/48V/49V/50V/51V
+  //00.0V means battery is full(charging in float mode).
+  kBatteryStopDischargingVoltageWithGrid,
+  /// See BatteryStopChargingVoltageWithGrid.
+  kBatteryStopChargingVoltageWithGrid,
+  /// Estimated as voltage × current. Positive when the battery is charged, negative otherwise.
+  kBatteryPower,
+
+  // PV (Photovoltaics, i.e. solar panels) data.
+  kPvWatts,
+  kPvWatts2,
+  kPvVoltage,
+  kPv2Voltage,
+  kPvBusVoltage,
+  kPvTotalGeneratedEnergy,
+
+  // Energy, see EnergyMeters and Pi18EnergyHistory.
+  kPvEnergy,
+  kOutputEnergy,
+  kBatteryChargeEnergy,
+  kBatteryDischargeEnergy,
+  /// Reported by the inverter. Drop to zero when the next period starts, which Home Assistant treats
+  /// as a meter reset.
+  kPvEnergyToday,
+  kPvEnergyThisMonth,
+  kPvEnergyThisYear,
+
+  // Mode & status & priorities.
+  kMode,
+  // TODO That will be a selector
+  kMachineType,
+  /// The AC-Input terminal of the off-grid inverters accepts a wide range of sinusoidal voltages.
+  /// The APL and UPS modes will allow a wider or narrower selection of voltages.
+  kAcInputVoltageRange,
+  kOutputSourcePriority,
+  kChargerSourcePriority,
+  kSolarPowerPriority,
+
+  // Various info.
+  kHeatsinkTemperature,
+  kMptt1ChargerTemperature,
+  kMptt2ChargerTemperature,
+  kWarnings,
+
+  // Parallel and three-phase systems: the totals over all the units.
+  kParallelUnits,
+  kParallelOutputActivePower,
+  kParallelPvWatts,
+  /// Active power of the units that feed a particular phase of a three-phase system.
+  kPhaseL1Load,
+  kPhaseL2Load,
+  kPhaseL3Load,
+
+  // Various settings.
+  kBacklight,
+  kLoadConnection,
+};
+
+/// A row of kCatalogue.
+struct CatalogueEntry {
+  SensorId id;
+  ValueType type;
+  SensorInfo info;
+};
+
+inline constexpr CatalogueEntry kCatalogue[] = {
+    {SensorId::kGridVoltage, ValueType::kFloat, {"Grid_voltage", SensorKind::kVoltage}},
+    {SensorId::kGridFrequency, ValueType::kFloat, {"Grid_frequency", SensorKind::kFrequency}},
+
+    {SensorId::kOutputVoltage, ValueType::kFloat, {"Output_voltage", SensorKind::kVoltage}},
+    {SensorId::kOutputFrequency, ValueType::kFloat, {"Output_frequency", SensorKind::kFrequency}},
+    {SensorId::kOutputApparentPower, ValueType::kInt,
+     {"Output_apparent_power", SensorKind::kApparentPower}},
+    {SensorId::kOutputActivePower, ValueType::kInt, {"Output_active_power", SensorKind::kPower}},
+    {SensorId::kOutputLoadPercent, ValueType::kInt,
+     {"Output_load_percent", SensorKind::kPercent, "percent"}},
+
+    {SensorId::kBatteryType, ValueType::kBatteryType,
+     {.name = "Battery_type", .icon = "car-battery", .platform = SensorPlatform::kSelect}},
+    {SensorId::kBatteryCapacity, ValueType::kInt, {"Battery_capacity", SensorKind::kBattery}},
+    {SensorId::kBatteryVoltage, ValueType::kFloat,
+     {"Battery_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryVoltageFromScc, ValueType::kFloat,
+     {"Battery_voltage_from_SCC", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryVoltageFromScc2, ValueType::kFloat,
+     {"Battery_voltage_from_SCC2", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryDischargeCurrent, ValueType::kInt,
+     {"Battery_discharge_current", SensorKind::kCurrent, kDcIcon}},
+    {SensorId::kBatteryChargeCurrent, ValueType::kInt,
+     {"Battery_charge_current", SensorKind::kCurrent, kDcIcon}},
+    {SensorId::kBatteryNominalVoltage, ValueType::kFloat,
+     {"Battery_nominal_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryUnderVoltage, ValueType::kFloat,
+     {"Battery_under_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryFloatVoltage, ValueType::kFloat,
+     {"Battery_float_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryBulkVoltage, ValueType::kFloat,
+     {"Battery_bulk_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryStopDischargingVoltageWithGrid, ValueType::kFloat,
+     {"Battery_stop_discharging_voltage_with_grid", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kBatteryStopChargingVoltageWithGrid, ValueType::kInt,
+     {.name = "Battery_stop_charging_voltage_with_grid", .platform = SensorPlatform::kSelect}},
+    {SensorId::kBatteryPower, ValueType::kInt, {"Battery_power", SensorKind::kPower}},
+
+    {SensorId::kPvWatts, ValueType::kInt, {"PV_watts", SensorKind::kPower}},
+    {SensorId::kPvWatts2, ValueType::kInt, {"PV2_watts", SensorKind::kPower}},
+    {SensorId::kPvVoltage, ValueType::kFloat, {"PV_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kPv2Voltage, ValueType::kFloat, {"PV2_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kPvBusVoltage, ValueType::kFloat,
+     {"PV_bus_voltage", SensorKind::kVoltage, kDcIcon}},
+    {SensorId::kPvTotalGeneratedEnergy, ValueType::kInt,
+     {"PV_total_generated_energy", SensorKind::kEnergy, "", true}},
+
+    {SensorId::kPvEnergy, ValueType::kDouble, {"PV_energy", SensorKind::kEnergy, "", true}},
+    {SensorId::kOutputEnergy, ValueType::kDouble,
+     {"Output_energy", SensorKind::kEnergy, "", true}},
+    {SensorId::kBatteryChargeEnergy, ValueType::kDouble,
+     {"Battery_charge_energy", SensorKind::kEnergy, "", true}},
+    {SensorId::kBatteryDischargeEnergy, ValueType::kDouble,
+     {"Battery_discharge_energy", SensorKind::kEnergy, "", true}},
+    {SensorId::kPvEnergyToday, ValueType::kDouble,
+     {"PV_energy_today", SensorKind::kEnergy, "", true}},
+    {SensorId::kPvEnergyThisMonth, ValueType::kDouble,
+     {"PV_energy_this_month", SensorKind::kEnergy, "", true}},
+    {SensorId::kPvEnergyThisYear, ValueType::kDouble,
+     {"PV_energy_this_year", SensorKind::kEnergy, "", true}},
+
+    {SensorId::kMode, ValueType::kDeviceMode, {"Mode"}},
+    {SensorId::kMachineType, ValueType::kMachineType, {"Machine_type"}},
+    {SensorId::kAcInputVoltageRange, ValueType::kInputVoltageRange,
+     {.name = "AC_input_voltage_range", .icon = "sine-wave", .platform = SensorPlatform::kSelect}},
+    {SensorId::kOutputSourcePriority, ValueType::kOutputSourcePriority,
+     {.name = "Output_source_priority", .platform = SensorPlatform::kSelect}},
+    {SensorId::kChargerSourcePriority, ValueType::kChargerPriority,
+     {.name = "Charger_source_priority", .platform = SensorPlatform::kSelect}},
+    {SensorId::kSolarPowerPriority, ValueType::kSolarPowerPriority,
+     {.name = "Solar_power_priority", .platform = SensorPlatform::kSelect}},
+
+    {SensorId::kHeatsinkTemperature, ValueType::kInt,
+     {"Heatsink_temperature", SensorKind::kTemperature}},
+    {SensorId::kMptt1ChargerTemperature, ValueType::kInt,
+     {"Mptt1_charger_temperature", SensorKind::kTemperature}},
+    {SensorId::kMptt2ChargerTemperature, ValueType::kInt,
+     {"Mptt2_charger_temperature", SensorKind::kTemperature}},
+    {SensorId::kWarnings, ValueType::kString, {"Warnings", SensorKind::kNone, "alert"}},
+
+    {SensorId::kParallelUnits, ValueType::kInt,
+     {"Parallel_units", SensorKind::kNone, "server-network"}},
+    {SensorId::kParallelOutputActivePower, ValueType::kInt,
+     {"Parallel_output_active_power", SensorKind::kPower}},
+    {SensorId::kParallelPvWatts, ValueType::kInt, {"Parallel_PV_watts", SensorKind::kPower}},
+    {SensorId::kPhaseL1Load, ValueType::kInt, {"Phase_L1_load", SensorKind::kPower}},
+    {SensorId::kPhaseL2Load, ValueType::kInt, {"Phase_L2_load", SensorKind::kPower}},
+    {SensorId::kPhaseL3Load, ValueType::kInt, {"Phase_L3_load", SensorKind::kPower}},
+
+    {SensorId::kBacklight, ValueType::kBool,
+     {.name = "Backlight", .icon = "television-ambient-light",
+      .platform = SensorPlatform::kSwitch}},
+    {SensorId::kLoadConnection, ValueType::kBool,
+     {.name = "Load_connection", .platform = SensorPlatform::kSwitch}},
+};
+
+inline constexpr std::size_t kSensorCount = std::size(kCatalogue);
+
+constexpr std::size_t ToIndex(SensorId id) { return static_cast<std::size_t>(id); }
+
+constexpr const CatalogueEntry& GetEntry(SensorId id) { return kCatalogue[ToIndex(id)]; }
+
+/// A sensor of the catalogue with values of ValueType. It's made of a SensorId implicitly, and
+/// the compiler rejects the ids of the sensors of other types.
+template<typename ValueType>
+struct SensorDescriptor {
+  consteval SensorDescriptor(SensorId id) : id(id) {
+    if (GetEntry(id).type != GetValueType<ValueType>()) {
+      throw "The value type of the sensor doesn't match the catalogue";
+    }
+  }
+
+  constexpr const SensorInfo& GetInfo() const { return GetEntry(id).info; }
+
+  SensorId id;
+};
+
+namespace implementation_details {
+
+consteval bool IsOrderedById() {
+  for (std::size_t i = 0; i < kSensorCount; ++i) {
+    if (ToIndex(kCatalogue[i].id) != i) return false;
+  }
+  return true;
+}
+
+consteval bool HasUniqueNames() {
+  for (std::size_t i = 0; i < kSensorCount; ++i) {
+    for (std::size_t j = i + 1; j < kSensorCount; ++j) {
+      if (kCatalogue[i].info.name == kCatalogue[j].info.name) return false;
+    }
+  }
+  return true;
+}
+
+consteval bool HasValidNamesAndIcons() {
+  for (const auto& entry : kCatalogue) {
+    if (!IsValidName(entry.info.name) || !IsPlain(entry.info.icon, "-")) return false;
+  }
+  return true;
+}
+
+}  // namespace implementation_details
+
+static_assert(implementation_details::IsOrderedById(),
+              "The catalogue must list the sensors in the order of SensorId");
+// The names are the topics and the unique ids of the sensors, so they must not repeat.
+static_assert(implementation_details::HasUniqueNames(), "The names of the sensors must be unique");
+// The catalogue is turned into JSON at compile time, without escaping.
+static_assert(implementation_details::HasValidNamesAndIcons(),
+              "Names must consist of letters, digits and underscores, icons of letters, digits and "
+              "dashes");
+
+}  // namespace mqtt
@@ -0,0 +1,65 @@
+#include "warnings.hh"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+namespace mqtt {
+
+Warnings::Warnings(SensorValues& values, std::span<const WarningFlag> flags,
+                   FaultDescriber describe_fault)
+    : descriptions_(flags.first(std::min(flags.size(), Flags().size()))),
+      describe_fault_(describe_fault),
+      text_(values, SensorId::kWarnings) {
+  for (const auto& flag : descriptions_) {
+    flag_sensors_.push_back(flag.sensor_name.empty()
+                            ? nullptr
+                            : std::make_unique<ProblemSensor>(std::string(flag.sensor_name)));
+  }
+}
+
+void Warnings::Update(Flags flags, int fault_code) {
+  if (initialized_ && flags == flags_ && fault_code == fault_code_) return;
+
+  const auto changed = initialized_ ? (flags ^ flags_) : Flags().set();
+  initialized_ = true;
+  flags_ = flags;
+  fault_code_ = fault_code;
+
+  for (std::size_t i = 0; i < flag_sensors_.size(); ++i) {
+    if (changed[i] && flag_sensors_[i]) {
+      flag_sensors_[i]->Update(flags[i]);
+    }
+  }
+  text_.Update(Render());
+}
+
+std::string Warnings::Render() const {
+  std::string result;
+  if (fault_code_ != 0) {
+    result = describe_fault_ ? describe_fault_(fault_code_)
+                             : std::format("Fault code: {}", fault_code_);
+  }
+  for (std::size_t i = 0; i < descriptions_.size(); ++i) {
+    if (!flags_[i]) continue;
+    if (!result.empty()) {
+      result += '\n';
+    }
+    result.append(descriptions_[i].description);
+  }
+  return result;
+}
+
+Warnings::Flags Warnings::ParseBitString(std::string_view str) {
+  Flags result;
+  for (std::size_t i = 0; i < str.length() && i < result.size(); ++i) {
+    switch (str[i]) {
+      case '0': break;
+      case '1': result.set(i); break;
+      default: throw std::runtime_error(std::format("Unexpected warning flags: {}", str));
+    }
+  }
+  return result;
+}
+
+}  // namespace mqtt
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <bitset>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sensor.hh"
+
+namespace mqtt {
+
+/// Description of a single warning flag reported by the inverter.
+struct WarningFlag {
+  /// Human-readable description, e.g. "Line fail".
+  std::string_view description;
+  /// Name of the binary sensor that reflects the flag. Empty for reserved flags, which aren't
+  /// published.
+  std::string_view sensor_name;
+};
+
+
+/// Warning flags and the fault code of the inverter.
+/// The state is kept as a bitset and is compared as integers on each update, so the text of
+/// warnings is rendered and published only when something has actually changed. Besides the text,
+/// each flag is published as an individual binary sensor.
+class Warnings {
+ public:
+  using Flags = std::bitset<32>;
+  /// @returns the description of a non-zero fault code.
+  using FaultDescriber = std::string (*)(int fault_code);
+
+  /// @param flags - descriptions of the flags, the n-th description corresponds to the n-th bit.
+  Warnings(SensorValues&, std::span<const WarningFlag> flags,
+           FaultDescriber describe_fault = nullptr);
+
+  /// @param flags - the n-th bit is set if the n-th warning is active.
+  /// @param fault_code - 0 if there is no fault.
+  void Update(Flags flags, int fault_code = 0);
+
+  /// Parses a string like "0010...", where the n-th character represents the n-th flag.
+  static Flags ParseBitString(std::string_view);
+
+ private:
+  std::string Render() const;
+
+  const std::span<const WarningFlag> descriptions_;
+  const FaultDescriber describe_fault_;
+
+  bool initialized_ = false;
+  Flags flags_;
+  int fault_code_ = 0;
+
+  TypedSensor<std::string> text_;
+  /// The n-th item corresponds to the n-th flag; nullptr for reserved flags.
+  std::vector<std::unique_ptr<ProblemSensor>> flag_sensors_;
+};
+
+}  // namespace mqtt
@@ -0,0 +1,136 @@
+#include "poller.hh"
+
+#include <chrono>
+#include <thread>
+
+#include "replay_transport.hh"
+#include "spdlog/spdlog.h"
+#include "trace.hh"
+
+
+Poller::Poller(const DeviceSettings& device, std::unique_ptr<Transport> transport)
+    : device_(device), transport_(std::move(transport)) {
+  DeviceScope scope(device_);
+  transport_->SetQueryObserver(&response_cache_);
+  // TODO: save/read protocol to/from a file.
+  adapter_ = DetectProtocol(*transport_);
+  Settings::SetDeviceSerialNumber(adapter_->GetSerialNumber());
+  spdlog::info("Polling {} (serial number {}) on {}", device_.name, device_.serial_number,
+               device_.path);
+}
+
+void Poller::Run(bool run_once) {
+  DeviceScope scope(device_);
+  const auto* replay = dynamic_cast<const ReplayTransport*>(transport_.get());
+
+  while (true) {
+    const auto cycle_start = std::chrono::steady_clock::now();
+    {
+      TRACE_SPAN("PollCycle", device_.serial_number);
+      // TODO: query rated info only when changes are expected.
+      adapter_->GetRatedInfo();
+      adapter_->GetStatusInfo();
+    }
+    diagnostics_.Update(std::chrono::steady_clock::now() - cycle_start);
+    trace::Flush();
+    LogQueryMetrics();
+
+    if (run_once || (replay && replay->IsFinished())) {
+      break;
+    }
+    if (replay) {
+      // The replay keeps the recorded pace by itself.
+      continue;
+    }
+
+    const auto polling_interval = std::chrono::seconds(Settings::Instance().polling_interval);
+    const auto next_cycle = std::chrono::steady_clock::now() + polling_interval;
+    // Leave a margin, so that a slow background query doesn't delay the next cycle.
+    adapter_->RunBackgroundTasks(next_cycle - polling_interval / 4);
+    spdlog::info("Wait for {} seconds before the next poll of {}...", polling_interval.count(),
+                 device_.name);
+    std::this_thread::sleep_until(next_cycle);
+  }
+}
+
+void Poller::Start(Reactor& reactor, bool run_once, std::function<void()>&& on_finished) {
+  port_ = dynamic_cast<SerialPort*>(transport_.get());
+  if (!port_) {
+    throw std::runtime_error("ERROR. The epoll polling engine works with serial ports only.");
+  }
+  reactor_ = &reactor;
+  run_once_ = run_once;
+  on_finished_ = std::move(on_finished);
+  next_cycle_timer_ = std::make_unique<Reactor::Timer>(reactor, [this] { StartCycle(); });
+  StartCycle();
+}
+
+void Poller::StartCycle() {
+  DeviceScope scope(device_);
+  cycle_start_ = Clock::now();
+  cycle_.emplace(adapter_->StartCycle());
+  QueryNext();
+}
+
+void Poller::QueryNext() {
+  const auto query = cycle_->Next();
+  if (!query) {
+    FinishCycle();
+    return;
+  }
+  port_->QueryAsync(*reactor_, query->query, query->with_crc, query->expected_reply_length,
+                    [this](std::string reply, std::exception_ptr error) {
+    DeviceScope scope(device_);
+    if (!error) {
+      cycle_->OnReply(reply);
+    } else {
+      try {
+        std::rethrow_exception(error);
+      } catch (const DisconnectedException& e) {
+        cycle_->OnDisconnected(e.what());
+      } catch (const std::exception& e) {
+        cycle_->OnFailure(e.what());
+      }
+    }
+    QueryNext();
+  });
+}
+
+void Poller::FinishCycle() {
+  cycle_.reset();
+  diagnostics_.Update(Clock::now() - cycle_start_);
+  trace::Flush();
+  LogQueryMetrics();
+  if (run_once_) {
+    on_finished_();
+    return;
+  }
+
+  const auto polling_interval = std::chrono::seconds(Settings::Instance().polling_interval);
+  const auto next_cycle = Clock::now() + polling_interval;
+  // Skipped if the previous run is still in progress.
+  if (!background_running_.exchange(true)) {
+    const auto deadline = next_cycle - polling_interval / 4;
+    reactor_->RunBlocking([this, deadline] {
+      DeviceScope scope(device_);
+      adapter_->RunBackgroundTasks(deadline);
+      background_running_ = false;
+    });
+  }
+  spdlog::debug("Wait for {} seconds before the next poll of {}...", polling_interval.count(),
+                device_.name);
+  next_cycle_timer_->Arm(next_cycle);
+}
+
+void Poller::LogQueryMetrics() const {
+  if (!spdlog::should_log(spdlog::level::debug)) return;
+  for (const auto& [command, metrics] : transport_->GetMetrics()) {
+    const auto succeeded = metrics.queries - metrics.failures;
+    spdlog::debug("{} {}: {} queries ({} failed), {} attempts, {} CRC errors, {} timeouts, "
+                  "latency avg {} ms, max {} ms.",
+                  device_.name, command, metrics.queries, metrics.failures, metrics.attempts,
+                  metrics.crc_errors, metrics.timeouts,
+                  succeeded ? metrics.total_latency.count() / succeeded / 1000 : 0,
+                  metrics.max_latency.count() / 1000);
+  }
+}
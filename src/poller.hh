@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include "configuration.h"
+#include "diagnostics.hh"
+#include "protocols/protocol_adapter.hh"
+#include "reactor.hh"
+#include "response_cache.hh"
+#include "serial_port.hh"
+#include "transport.hh"
+
+/// Polls a single inverter: the link to it, its protocol adapter and diagnostics. In the gateway mode
+/// there is a poller per inverter, each running in its own thread (Run()), or all of them driven by
+/// a single Reactor (Start()).
+class Poller {
+ public:
+  /// Detects the protocol and the serial number of the device.
+  /// @throws std::exception if the device can't be recognized.
+  Poller(const DeviceSettings&, std::unique_ptr<Transport>);
+
+  const DeviceSettings& GetDevice() const { return device_; }
+
+  /// Poll the device every polling_interval, until the replayed session is over (if the transport
+  /// is a ReplayTransport) or forever. MqttClient must be initialized by then.
+  /// @param run_once - stop after the first poll cycle.
+  /// @note never throws.
+  void Run(bool run_once);
+
+  /// The same as Run(), but without blocking: each query is a step of a state machine driven by
+  /// @a reactor, so a single thread can poll many devices. Background tasks, that make blocking
+  /// queries, are run by Reactor::RunBlocking().
+  /// @param on_finished - is called by the reactor when polling is over (see Run()).
+  /// @throws std::runtime_error if the device isn't connected to a SerialPort.
+  void Start(Reactor& reactor, bool run_once, std::function<void()>&& on_finished);
+
+  /// Send a raw @a query to the device on behalf of another consumer (see ControlServer). It's made
+  /// in between the poll queries, since the transport serves one query at a time. Read-only
+  /// queries could be answered from the cache, see ResponseCache.
+  /// This function is thread-safe.
+  /// @throws std::exception if the query fails.
+  std::string RawQuery(std::string_view query, bool with_crc) {
+    return response_cache_.Get(query, [&] { return transport_->Query(query, with_crc); });
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void StartCycle();
+  void QueryNext();
+  void FinishCycle();
+  void LogQueryMetrics() const;
+
+  const DeviceSettings& device_;
+  /// Observes the poll queries as well. Outlives the transport, which refers to it.
+  ResponseCache response_cache_{Settings::Instance().control_cache_ttl};
+  const std::unique_ptr<Transport> transport_;
+  std::unique_ptr<ProtocolAdapter> adapter_;
+  Diagnostics diagnostics_{*transport_};
+
+  // The state of Start().
+  Reactor* reactor_ = nullptr;
+  SerialPort* port_ = nullptr;
+  bool run_once_ = false;
+  std::function<void()> on_finished_;
+  std::unique_ptr<Reactor::Timer> next_cycle_timer_;
+  std::optional<ProtocolAdapter::Cycle> cycle_;
+  Clock::time_point cycle_start_;
+  /// Whether the background tasks are being run by Reactor::RunBlocking().
+  std::atomic<bool> background_running_ = false;
+};
@@ -0,0 +1,252 @@
+#include "pi18_energy_history.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <format>
+#include <fstream>
+
+#include "configuration.h"
+#include "spdlog/spdlog.h"
+#include "utils.h"
+
+namespace {
+
+bool IsYear(const Pi18EnergyHistory::Period& period) { return period.month == 0; }
+bool IsMonth(const Pi18EnergyHistory::Period& period) { return period.month && !period.day; }
+
+unsigned GetDaysInMonth(int year, unsigned month) {
+  using namespace std::chrono;
+  return static_cast<unsigned>(
+      year_month_day_last(std::chrono::year(year), month_day_last(std::chrono::month(month))).day());
+}
+
+/// @returns the day of the year by the local time, to notice the midnight.
+int GetLocalDay() {
+  const auto now = std::time(nullptr);
+  std::tm local_time{};
+  localtime_r(&now, &local_time);
+  return local_time.tm_yday;
+}
+
+}  // namespace
+
+
+std::string Pi18EnergyHistory::Period::ToString() const {
+  if (month == 0) return std::format("{:04}", year);
+  if (day == 0) return std::format("{:04}-{:02}", year, month);
+  return std::format("{:04}-{:02}-{:02}", year, month, day);
+}
+
+Pi18EnergyHistory::Pi18EnergyHistory(mqtt::SensorValues& values, TimeGetter&& get_time,
+                                     EnergyGetter&& get_energy)
+    : get_time_(std::move(get_time)),
+      get_energy_(std::move(get_energy)),
+      today_energy_(values, mqtt::SensorId::kPvEnergyToday),
+      month_energy_(values, mqtt::SensorId::kPvEnergyThisMonth),
+      year_energy_(values, mqtt::SensorId::kPvEnergyThisYear) {}
+
+void Pi18EnergyHistory::Run(Clock::time_point deadline) {
+  if (!cache_loaded_) {
+    LoadCache();
+    cache_loaded_ = true;
+  }
+
+  while (Clock::now() >= next_attempt_ && Clock::now() + query_duration_ < deadline) {
+    const auto start = Clock::now();
+    bool has_run = false;
+    try {
+      has_run = RunOne();
+      retry_delay_ = Clock::duration::zero();
+    } catch (const std::exception& e) {
+      // The failed period stays queued, so it's retried later. A query that keeps failing (e.g.
+      // isn't supported) is retried less and less often, to not waste the pauses on it.
+      retry_delay_ = std::clamp<Clock::duration>(retry_delay_ * 2, kMinRetryDelay, kMaxRetryDelay);
+      next_attempt_ = Clock::now() + retry_delay_;
+      spdlog::warn("Failed to query the history of generated energy, retrying in {} s: {}",
+                   std::chrono::duration_cast<std::chrono::seconds>(retry_delay_).count(),
+                   e.what());
+    }
+    // Failed queries count too: timeouts with retries take the longest.
+    query_duration_ = std::max(query_duration_, Clock::now() - start);
+    if (!has_run) break;
+  }
+
+  if (cache_changed_) {
+    SaveCache();
+    cache_changed_ = false;
+  }
+}
+
+bool Pi18EnergyHistory::RunOne() {
+  const auto now = Clock::now();
+  const auto local_day = GetLocalDay();
+  if (local_day != local_day_) {
+    // Check the inverter's date right away, otherwise "today" and "this month" would be queried for
+    // the past day until the next check. Its clock may differ a bit, so it's checked often for a
+    // while, until the date changes.
+    local_day_ = local_day;
+    next_date_check_ = now;
+    frequent_date_checks_until_ = now + kDateCheckInterval;
+  }
+  if (!today_ || now >= next_date_check_) {
+    if (UpdateDate()) frequent_date_checks_until_ = Clock::time_point();
+    next_date_check_ = now + (now < frequent_date_checks_until_ ? kMidnightDateCheckInterval
+                                                               : kDateCheckInterval);
+    return true;
+  }
+
+  if (refresh_.empty() && now >= next_refresh_) {
+    refresh_ = {{today_->year, today_->month}, *today_};
+    next_refresh_ = now + kRefreshInterval;
+  }
+  if (!refresh_.empty()) {
+    const auto period = refresh_.front();
+    UpdateSensors(period, QueryEnergy(period));
+    refresh_.pop_front();
+    return true;
+  }
+
+  while (!backfill_.empty()) {
+    const auto period = backfill_.front();
+    const auto key = period.ToString();
+    const auto cached = cache_.find(key);
+    if (cached != cache_.end()) {
+      // Parts of the period may be missing still, if the backfill has been interrupted.
+      backfill_.pop_front();
+      OnBackfilled(period, cached->second);
+      continue;
+    }
+
+    const auto energy = QueryEnergy(period);
+    backfill_.pop_front();
+    cache_.emplace(key, energy);
+    cache_changed_ = true;
+    if (!energy && IsYear(period)) {
+      spdlog::info("No energy generated in {}, the history of generated energy is complete.", key);
+    }
+    OnBackfilled(period, energy);
+    return true;
+  }
+  return false;
+}
+
+void Pi18EnergyHistory::OnBackfilled(const Period& period, std::uint64_t energy) {
+  if (energy) {
+    QueueParts(period);
+  } else if (IsYear(period)) {
+    // The years before aren't in the cache, so they would be queried in vain after a restart.
+    std::erase_if(backfill_, [&](const Period& p) { return IsYear(p) && p.year < period.year; });
+  }
+}
+
+bool Pi18EnergyHistory::UpdateDate() {
+  // Response: YYYYMMDDHHMMSS
+  const auto time = get_time_();
+  Period today{};
+  if (sscanf(time.c_str(), "%4d%2u%2u", &today.year, &today.month, &today.day) != 3 ||
+      today.month < 1 || today.month > 12 || today.day < 1 || today.day > 31) {
+    throw std::runtime_error("Unexpected data in GetCurrentTime: " + time);
+  }
+  if (today_ && today_->ToString() == today.ToString()) return false;
+
+  today_ = today;
+  RestartBackfill();
+  // The current day and month have changed.
+  refresh_.clear();
+  next_refresh_ = Clock::now();
+  return true;
+}
+
+void Pi18EnergyHistory::RestartBackfill() {
+  backfill_.clear();
+  for (auto day = today_->day - 1; day > 0; --day) {
+    backfill_.push_back({today_->year, today_->month, day});
+  }
+  for (auto month = today_->month - 1; month > 0; --month) {
+    backfill_.push_back({today_->year, month});
+  }
+  for (auto year = today_->year - 1; year >= today_->year - kMaxYears; --year) {
+    backfill_.push_back({year});
+  }
+}
+
+void Pi18EnergyHistory::QueueParts(const Period& period) {
+  // The most recent parts go first.
+  if (IsYear(period)) {
+    for (unsigned month = 1; month <= 12; ++month) {
+      backfill_.push_front({period.year, month});
+    }
+  } else if (IsMonth(period)) {
+    for (unsigned day = 1; day <= GetDaysInMonth(period.year, period.month); ++day) {
+      backfill_.push_front({period.year, period.month, day});
+    }
+  }
+}
+
+std::uint64_t Pi18EnergyHistory::QueryEnergy(const Period& period) {
+  // Response: NNNNNNNN, unit: Wh
+  const auto response = get_energy_(period);
+  unsigned long long energy;
+  if (sscanf(response.c_str(), "%8llu", &energy) != 1) {
+    throw std::runtime_error(std::format("Unexpected energy of {}: {}", period.ToString(),
+                                         response));
+  }
+  return energy;
+}
+
+void Pi18EnergyHistory::UpdateSensors(const Period& period, std::uint64_t energy) {
+  if (!IsMonth(period)) {
+    today_energy_.Update(energy / 1000.);
+    return;
+  }
+
+  month_energy_.Update(energy / 1000.);
+  // The current year is the current month plus the past months (if they are known already).
+  for (unsigned month = 1; month < period.month; ++month) {
+    const auto cached = cache_.find(Period{period.year, month}.ToString());
+    if (cached == cache_.end()) return;
+    energy += cached->second;
+  }
+  year_energy_.Update(energy / 1000.);
+}
+
+std::optional<std::string> Pi18EnergyHistory::GetCacheFileName() const {
+  const auto& settings = Settings::Instance();
+  if (settings.data_directory.empty()) return std::nullopt;
+  return std::format("{}/pi18_energy_{}.csv", settings.data_directory,
+                     Settings::CurrentDevice().serial_number);
+}
+
+void Pi18EnergyHistory::LoadCache() {
+  const auto filename = GetCacheFileName();
+  if (!filename) return;
+  std::ifstream file(*filename);
+  std::string line;
+  while (std::getline(file, line)) {
+    const auto delimiter = line.find(',');
+    if (delimiter == std::string::npos) continue;
+    try {
+      cache_.emplace(line.substr(0, delimiter), std::stoull(line.substr(delimiter + 1)));
+    } catch (const std::exception&) {
+      // E.g. the header.
+    }
+  }
+  spdlog::debug("Loaded energy of {} past periods from {}", cache_.size(), *filename);
+}
+
+void Pi18EnergyHistory::SaveCache() {
+  const auto filename = GetCacheFileName();
+  if (!filename) return;
+  try {
+    std::filesystem::create_directories(std::filesystem::path(*filename).parent_path());
+    std::string content = "period,energy_wh\n";
+    for (const auto& [period, energy] : cache_) {
+      content += std::format("{},{}\n", period, energy);
+    }
+    utils::ReplaceFile(*filename, content);
+  } catch (const std::exception& e) {
+    spdlog::error("Failed to save the history of generated energy: {}", e.what());
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+
+#include "mqtt/energy.hh"
+
+/// PI18 inverters keep the energy generated per day, month and year. This class backfills that
+/// history once: past periods never change, so they are cached (in data_directory, if it's set) and
+/// never queried again. After that only today and the current month are re-queried.
+/// Queries are run in the pauses between poll cycles, one by one, so they never delay polling.
+class Pi18EnergyHistory {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /// A day, a month (day is 0) or a year (month and day are 0).
+  struct Period {
+    int year;
+    unsigned month = 0;
+    unsigned day = 0;
+
+    /// E.g. "2024", "2024-01" or "2024-01-31".
+    std::string ToString() const;
+  };
+
+  /// @returns the reply to "^P004T" (the inverter's time): "YYYYMMDDHHMMSS".
+  using TimeGetter = std::function<std::string()>;
+  /// @returns the reply to "^P009EY", "^P011EM" or "^P013ED" for the period: "NNNNNNNN" (in Wh).
+  using EnergyGetter = std::function<std::string(const Period&)>;
+
+  Pi18EnergyHistory(mqtt::SensorValues&, TimeGetter&&, EnergyGetter&&);
+
+  /// Query the inverter while the next query is expected to finish before @a deadline.
+  /// @note never throws: failed queries are retried later.
+  void Run(Clock::time_point deadline);
+
+ private:
+  /// How far back in time the history is looked for. The backfill stops earlier, at the first year
+  /// without any energy generated.
+  static constexpr int kMaxYears = 10;
+  /// How often today and the current month are re-queried.
+  static constexpr auto kRefreshInterval = std::chrono::minutes(5);
+  /// How often the inverter's date is checked (to notice that the day is over). It's also checked at
+  /// the local midnight, then every kMidnightDateCheckInterval until it changes, for at most
+  /// kDateCheckInterval.
+  static constexpr auto kDateCheckInterval = std::chrono::hours(1);
+  static constexpr auto kMidnightDateCheckInterval = std::chrono::minutes(1);
+  /// The pause after a failed query, doubled after each next failure in a row.
+  static constexpr auto kMinRetryDelay = std::chrono::minutes(1);
+  static constexpr auto kMaxRetryDelay = std::chrono::hours(1);
+
+  /// Does a single query, unless there is nothing to do.
+  /// @returns false if there was nothing to do.
+  bool RunOne();
+  /// @returns true if the inverter's date has changed.
+  bool UpdateDate();
+  /// Queue all the past periods, starting from the most recent ones.
+  void RestartBackfill();
+  /// Queue the days of a month or the months of a year.
+  void QueueParts(const Period&);
+  /// Continue the backfill with the parts of a past @a period, or stop it at the first year without
+  /// any energy generated.
+  void OnBackfilled(const Period&, std::uint64_t energy);
+  std::uint64_t QueryEnergy(const Period&);
+  void UpdateSensors(const Period&, std::uint64_t energy);
+
+  std::optional<std::string> GetCacheFileName() const;
+  void LoadCache();
+  void SaveCache();
+
+  const TimeGetter get_time_;
+  const EnergyGetter get_energy_;
+
+  /// The inverter's date.
+  std::optional<Period> today_;
+  std::deque<Period> backfill_;
+  std::deque<Period> refresh_;
+  Clock::time_point next_date_check_;
+  /// The local day of the year, to notice the midnight.
+  int local_day_ = -1;
+  Clock::time_point frequent_date_checks_until_;
+  Clock::time_point next_refresh_;
+  /// The longest query so far (including the failed ones), to predict whether the next one fits
+  /// before the deadline.
+  Clock::duration query_duration_ = std::chrono::seconds(1);
+  /// No queries until then, after a failure.
+  Clock::time_point next_attempt_;
+  Clock::duration retry_delay_{};
+
+  /// Energy of the past periods, in Wh, by Period::ToString().
+  std::map<std::string, std::uint64_t, std::less<>> cache_;
+  bool cache_loaded_ = false;
+  bool cache_changed_ = false;
+
+  mqtt::TypedSensor<double> today_energy_;
+  mqtt::TypedSensor<double> month_energy_;
+  mqtt::TypedSensor<double> year_energy_;
+};
@@ -7,17 +7,60 @@
 
 namespace {
 
-std::string Concatenate(const std::vector<std::string>& strings, char separator = ',') {
-  std::string result;
-  for (auto& s : strings) {
-    if (!result.empty()) {
-      result += separator;
-    }
-    result.append(s);
+std::string GetFaultCodeDescription(int code) {
+  switch (code) {
+    case 1: return "Fan is locked";
+    case 2: return "Over temperature";
+    case 3: return "Battery voltage is too high";
+    case 4: return "Battery voltage is too low";
+    case 5: return "Output short circuited or Over temperature";
+    case 6: return "Output voltage is too high";
+    case 7: return "Over load time out";
+    case 8: return "Bus voltage is too high";
+    case 9: return "Bus soft start failed";
+    case 11: return "Main relay failed";
+    case 51: return "Over current inverter";
+    case 52: return "Bus soft start failed";
+    case 53: return "Inverter soft start failed";
+    case 54: return "Self-test failed";
+    case 55: return "Over DC voltage on output of inverter";
+    case 56: return "Battery connection is open";
+    case 57: return "Current sensor failed";
+    case 58: return "Output voltage is too low";
+    case 60: return "Inverter negative power";
+    case 71: return "Parallel version different";
+    case 72: return "Output circuit failed";
+    case 80: return "CAN communication failed";
+    case 81: return "Parallel host line lost";
+    case 82: return "Parallel synchronized signal lost";
+    case 83: return "Parallel battery voltage detect different";
+    case 84: return "Parallel Line voltage or frequency detect different";
+    case 85: return "Parallel Line input current unbalanced";
+    case 86: return "Parallel output setting different";
+    default: return std::format("Unknown fault code: {}", code);
   }
-  return result;
 }
 
+/// Warning flags as they go in reply to ^P005FWS, see Pi18ProtocolAdapter::HandleWarnings().
+constexpr mqtt::WarningFlag kWarningFlags[] = {
+    {"Line fail", "Warning_line_fail"},
+    {"Output circuit short", "Warning_output_circuit_short"},
+    {"Inverter over temperature", "Warning_inverter_over_temperature"},
+    {"Fan lock", "Warning_fan_lock"},
+    {"Battery voltage high", "Warning_battery_voltage_high"},
+    {"Battery low", "Warning_battery_low"},
+    {"Battery under", "Warning_battery_under"},
+    {"Over load", "Warning_over_load"},
+    {"Eeprom fail", "Warning_eeprom_fail"},
+    {"Power limit", "Warning_power_limit"},
+    {"PV1 voltage high", "Warning_PV1_voltage_high"},
+    {"PV2 voltage high", "Warning_PV2_voltage_high"},
+    {"MPPT1 overload warning", "Warning_MPPT1_overload"},
+    {"MPPT2 overload warning", "Warning_MPPT2_overload"},
+    {"Battery too low to charge for SCC1", "Warning_battery_too_low_to_charge_SCC1"},
+    {"Battery too low to charge for SCC2", "Warning_battery_too_low_to_charge_SCC2"},
+};
+
 BatteryType GetBatteryType(int type) {
   switch (type) {
     case 0: return BatteryType::kAgm;
@@ -148,8 +191,21 @@ int GetSolarPowerPriority(SolarPowerPriority p) {
 }  // namespace
 
 
-Pi18ProtocolAdapter::Pi18ProtocolAdapter(const SerialPort& port)
-    : ProtocolAdapter(port) {}
+Pi18ProtocolAdapter::Pi18ProtocolAdapter(const Transport& transport)
+    : ProtocolAdapter(transport),
+      warnings_(sensor_values_, kWarningFlags, &GetFaultCodeDescription) {
+  // Special case. According to the protocol, the prefix is "^D085". But my inverter returns 89.
+  // Therefore I can't check it as a prefix and have to skip it in the handler.
+  AddRatedInfoTask("^P007PIRI", "^D0", [this](auto& r) { HandleRatedInformation(r); });
+
+  AddStatusInfoTask("^P005GS", "^D106", [this](auto& r) { HandleGeneralStatus(r); });
+  AddStatusInfoTask("^P005ET", "^D011", [this](auto& r) { HandleTotalGeneratedEnergy(r); });
+  AddStatusInfoTask("^P006MOD", "^D005", [this](auto& r) { HandleWorkingMode(r); });
+  AddStatusInfoTask("^P007FLAG", "^D020", [this](auto& r) { HandleFlagsStatus(r); });
+  // Special case. According to the protocol, the length is 34 (probably an error, should be 37).
+  // But my inverter returns 39. Therefore, the length is skipped in the handler.
+  AddStatusInfoTask("^P005FWS", "^D0", [this](auto& r) { HandleWarnings(r); });
+}
 
 std::string Pi18ProtocolAdapter::GetSerialNumber() {
   // Response: ^D025LLXXXXXXXXXXXXXXXXXXXX<CRC><cr>
@@ -179,6 +235,14 @@ std::string Pi18ProtocolAdapter::GetGeneratedEnergyOfDayRaw(
   return Query(std::format("^P013ED{}{}{}", year, month, day), "^D011");
 }
 
+std::string Pi18ProtocolAdapter::GetGeneratedEnergyRaw(const Pi18EnergyHistory::Period& period) {
+  const auto year = std::format("{:04}", period.year);
+  if (period.month == 0) return GetGeneratedEnergyOfYearRaw(year);
+  const auto month = std::format("{:02}", period.month);
+  if (period.day == 0) return GetGeneratedEnergyOfMonthRaw(year, month);
+  return GetGeneratedEnergyOfDayRaw(year, month, std::format("{:02}", period.day));
+}
+
 /// Depending of inverter's nominal battery voltage
 void Pi18ProtocolAdapter::SetBatteryStopChargingVoltageWithGrid(auto battery_nominal_voltage,
                                                                 int value) {
@@ -192,10 +256,9 @@ void Pi18ProtocolAdapter::SetBatteryStopChargingVoltageWithGrid(auto battery_nom
 //  battery_stop_charging_voltage_with_grid_->Update(value);
 }
 
-void Pi18ProtocolAdapter::GetRatedInfo() {
-  // Special case. According to the protocol, the length is 85. But my inverter returns 89.
-  // Therefore I can't check it as a prefix and have to skip it here.
-  auto response = GetRatedInformationRaw().substr(2);
+void Pi18ProtocolAdapter::HandleRatedInformation(const std::string& raw_response) {
+  // Skip the length (see the constructor).
+  auto response = raw_response.substr(2);
 
   // Response according to the protocol:
   // AAAA,BBB,CCCC,DDD,EEE,FFFF,GGGG,HHH,III,JJJ,KKK,LLL,MMM,N,OO,PPP,Q,R,S,T,U,V,W,Z,a
@@ -243,45 +306,9 @@ void Pi18ProtocolAdapter::GetRatedInfo() {
   // returns it.
 }
 
-static std::string_view GetFaultCodeDescription(int code) {
-  switch (code) {
-    case 1: return "Fan is locked";
-    case 2: return "Over temperature";
-    case 3: return "Battery voltage is too high";
-    case 4: return "Battery voltage is too low";
-    case 5: return "Output short circuited or Over temperature";
-    case 6: return "Output voltage is too high";
-    case 7: return "Over load time out";
-    case 8: return "Bus voltage is too high";
-    case 9: return "Bus soft start failed";
-    case 11: return "Main relay failed";
-    case 51: return "Over current inverter";
-    case 52: return "Bus soft start failed";
-    case 53: return "Inverter soft start failed";
-    case 54: return "Self-test failed";
-    case 55: return "Over DC voltage on output of inverter";
-    case 56: return "Battery connection is open";
-    case 57: return "Current sensor failed";
-    case 58: return "Output voltage is too low";
-    case 60: return "Inverter negative power";
-    case 71: return "Parallel version different";
-    case 72: return "Output circuit failed";
-    case 80: return "CAN communication failed";
-    case 81: return "Parallel host line lost";
-    case 82: return "Parallel synchronized signal lost";
-    case 83: return "Parallel battery voltage detect different";
-    case 84: return "Parallel Line voltage or frequency detect different";
-    case 85: return "Parallel Line input current unbalanced";
-    case 86: return "Parallel output setting different";
-    default: throw std::runtime_error(std::format("Unknown fault code: {}", code));
-  }
-}
-
-void Pi18ProtocolAdapter::GetWarnings() {
-  // Special case. According to the protocol, the length is 34 (probably an error, should be 37).
-  // But my inverter returns 39.
-  // Therefore, I can't check it as a prefix and have to skip it here.
-  auto str = GetFaultAndWarningStatusRaw().substr(2);
+void Pi18ProtocolAdapter::HandleWarnings(const std::string& response) {
+  // Skip the length (see the constructor).
+  auto str = response.substr(2);
 
   // Response according to the protocol:
   // AA,B,C,D,E,F,G,H,I,J,K,L,M,N,O,P,Q
@@ -292,35 +319,16 @@ void Pi18ProtocolAdapter::GetWarnings() {
                              &data[0], &data[1], &data[2], &data[3], &data[4], &data[5], &data[6], &data[7], &data[8],
                              &data[9], &data[10], &data[11], &data[12], &data[13], &data[14], &data[15], &data[16]);
   if (n_args < 17) {
-    throw std::runtime_error("Unexpected data in GetRatingInformation: " + str);
+    throw std::runtime_error("Unexpected data in GetFaultAndWarningStatus: " + str);
   }
-  std::vector<std::string> result;
-  if (data[0] != 0) {
-    result.emplace_back(GetFaultCodeDescription(data[0]));
+  mqtt::Warnings::Flags flags;
+  for (std::size_t i = 1; i < std::size(data); ++i) {
+    flags[i - 1] = data[i];
   }
-  if (data[1]) result.emplace_back("Line fail");
-  if (data[2]) result.emplace_back("Output circuit short");
-  if (data[3]) result.emplace_back("Inverter over temperature");
-  if (data[4]) result.emplace_back("Fan lock");
-  if (data[5]) result.emplace_back("Battery voltage high");
-  if (data[6]) result.emplace_back("Battery low");
-  if (data[7]) result.emplace_back("Battery under");
-  if (data[8]) result.emplace_back("Over load");
-  if (data[9]) result.emplace_back("Eeprom fail");
-  if (data[10]) result.emplace_back("Power limit");
-  if (data[11]) result.emplace_back("PV1 voltage high");
-  if (data[12]) result.emplace_back("PV2 voltage high");
-  if (data[13]) result.emplace_back("MPPT1 overload warning");
-  if (data[14]) result.emplace_back("MPPT2 overload warning");
-  if (data[15]) result.emplace_back("Battery too low to charge for SCC1");
-  if (data[16]) result.emplace_back("Battery too low to charge for SCC2");
-
-  warnings_.Update(Concatenate(result, '\n'));
-}
-
-void Pi18ProtocolAdapter::GetStatusInfo() {
-  auto str = GetGeneralStatusRaw();
+  warnings_.Update(flags, data[0]);
+}
 
+void Pi18ProtocolAdapter::HandleGeneralStatus(const std::string& str) {
   // Response according to the protocol:
   // Response: AAAA,BBB,CCCC,DDD,EEEE,FFFF,GGG,HHH,III,JJJ,KKK,LLL,MMM,NNN,OOO,PPP,QQQQ,RRRR,SSSS,TTTT,U,V,W,X,Y,Z,a,b
   int data[28];
@@ -355,6 +363,7 @@ void Pi18ProtocolAdapter::GetStatusInfo() {
   pv2_input_power_.Update(data[17]);
   pv_input_voltage_.Update(data[18] / 10.f);
   pv2_input_voltage_.Update(data[19] / 10.f);
+  energy_meters_.Update(data[16] + data[17], data[5], data[7] / 10.f, data[11], data[10]);
   // data[20] - Setting value configuration state (0: Nothing changed, 1: Something changed)
   // data[21] - MPPT1 charger status (0: abnormal, 1: normal but not charged, 2: charging)
   // data[22] - MPPT2 charger status (0: abnormal, 1: normal but not charged, 2: charging)
@@ -363,19 +372,14 @@ void Pi18ProtocolAdapter::GetStatusInfo() {
   // data[25] - DC/AC power direction (0: donothing, 1: AC-DC, 2: DC-AC)
   // data[26] - Line power direction (0: donothing, 1: input, 2: output)
   // data[27] - Local parallel ID (a: 0~(parallel number - 1))
+}
 
-  // Other status info.
-  // TODO: Total generated energy is temporarily disabled since at some point the inverter starts
-  //  sending rubbish with incorrect CRC.
-  // GetTotalGeneratedEnergy();
-  mode_.Update(GetDeviceMode(GetWorkingModeRaw()));
-  GetFlagsStatus();
-  GetWarnings();
+void Pi18ProtocolAdapter::HandleWorkingMode(const std::string& response) {
+  mode_.Update(GetDeviceMode(response));
 }
 
-void Pi18ProtocolAdapter::GetFlagsStatus() {
+void Pi18ProtocolAdapter::HandleFlagsStatus(const std::string& response) {
   // Response: ^D020A,B,C,D,E,F,G,H,I<CRC><cr>
-  auto response = Query("^P007FLAG", "^D020");
   int data[9];
   const auto n_args = sscanf(
       response.c_str(), "%1d,%1d,%1d,%1d,%1d,%1d,%1d,%1d,%1d",
@@ -394,9 +398,8 @@ void Pi18ProtocolAdapter::GetFlagsStatus() {
   // data[8] - Reserved
 }
 
-void Pi18ProtocolAdapter::GetTotalGeneratedEnergy() {
+void Pi18ProtocolAdapter::HandleTotalGeneratedEnergy(const std::string& str) {
   // Response: NNNNNNNN, unit: KWh
-  auto str = GetTotalGeneratedEnergyRaw();
   int result;
   if(sscanf(str.c_str(), "%8d", &result) != 1) {
     throw std::runtime_error("Unexpected data in GetTotalGeneratedEnergy: " + str);
@@ -2,22 +2,31 @@
 
 #include "protocol_adapter.hh"
 
+#include "pi18_energy_history.hh"
+#include "mqtt/energy.hh"
 #include "mqtt/sensor.hh"
+#include "mqtt/warnings.hh"
 
 class Pi18ProtocolAdapter : public ProtocolAdapter {
  public:
-  explicit Pi18ProtocolAdapter(const SerialPort&);
+  explicit Pi18ProtocolAdapter(const Transport&);
 
   std::string GetSerialNumber() override;
   void QueryProtocolId() override { GetProtocolIdRaw(); };
-  void GetRatedInfo() override;
-  void GetStatusInfo() override;
+  void RunBackgroundTasks(std::chrono::steady_clock::time_point deadline) override {
+    energy_history_.Run(deadline);
+  }
 
  protected:
   bool UseCrcInQueries() override { return true; }
-  void GetTotalGeneratedEnergy();
-  void GetWarnings();
-  void GetFlagsStatus();
+
+  // Handlers of the replies to the corresponding queries.
+  void HandleRatedInformation(const std::string&);
+  void HandleGeneralStatus(const std::string&);
+  void HandleTotalGeneratedEnergy(const std::string&);
+  void HandleWorkingMode(const std::string&);
+  void HandleWarnings(const std::string&);
+  void HandleFlagsStatus(const std::string&);
 
   bool SetInputVoltageRange(InputVoltageRange);
   bool SetChargerPriority(ChargerPriority);
@@ -35,6 +44,7 @@ class Pi18ProtocolAdapter : public ProtocolAdapter {
   std::string GetGeneratedEnergyOfMonthRaw(std::string_view year, std::string_view month);
   std::string GetGeneratedEnergyOfDayRaw(
       std::string_view year, std::string_view month, std::string_view day);
+  std::string GetGeneratedEnergyRaw(const Pi18EnergyHistory::Period&);
   std::string GetSeriesNumberRaw() { return Query("^P005ID", "^D025"); }
   std::string GetCpuVersionRaw() { return Query("^P006VFW", "^D020"); }
   std::string GetRatedInformationRaw() { return Query("^P007PIRI", "^D0"); }
@@ -54,74 +64,101 @@ class Pi18ProtocolAdapter : public ProtocolAdapter {
   void SetBatteryStopChargingVoltageWithGrid(auto battery_nominal_voltage, int value);
   bool SendCommand(std::string_view);
 
-  mqtt::InverterMode mode_;
+  mqtt::TypedSensor<DeviceMode> mode_{sensor_values_, mqtt::SensorId::kMode};
 
-  mqtt::BatteryNominalVoltage battery_nominal_voltage_;
-  mqtt::BatteryStopDischargingVoltageWithGrid battery_stop_discharging_voltage_with_grid_;
+  mqtt::TypedSensor<float> battery_nominal_voltage_{sensor_values_,
+                                                    mqtt::SensorId::kBatteryNominalVoltage};
+  mqtt::TypedSensor<float> battery_stop_discharging_voltage_with_grid_{
+      sensor_values_, mqtt::SensorId::kBatteryStopDischargingVoltageWithGrid};
   // TODO: implement. Requires simultaneous implementation for
   //  Battery re-charged and re-discharged voltage when utility is available
   // ^S014BUCDmmm,nnn<cr>
   // mmm Battery re-charged voltage when utility is available m: 0~9, unit: 0.1V
   // nnn Battery re-discharged voltage when utility is available n: 0~9, unit: 0.1V
 //  std::unique_ptr<mqtt::BatteryStopChargingVoltageWithGrid> battery_stop_charging_voltage_with_grid_;
-  mqtt::BatteryUnderVoltage battery_under_voltage_;
-  mqtt::BatteryBulkVoltage battery_bulk_voltage_;
-  mqtt::BatteryFloatVoltage battery_float_voltage_;
-  mqtt::BatteryType battery_type_{
+  mqtt::TypedSensor<float> battery_under_voltage_{sensor_values_,
+                                                  mqtt::SensorId::kBatteryUnderVoltage};
+  mqtt::TypedSensor<float> battery_bulk_voltage_{sensor_values_,
+                                                 mqtt::SensorId::kBatteryBulkVoltage};
+  mqtt::TypedSensor<float> battery_float_voltage_{sensor_values_,
+                                                  mqtt::SensorId::kBatteryFloatVoltage};
+  mqtt::Selector<BatteryType> battery_type_{
+      sensor_values_, mqtt::SensorId::kBatteryType,
       {BatteryType::kAgm, BatteryType::kFlooded, BatteryType::kUser},
       [this](BatteryType b) { return SetBatteryType(b); }
   };
 
-  mqtt::AcInputVoltageRangeSelector input_voltage_range_{
+  mqtt::Selector<InputVoltageRange> input_voltage_range_{
+      sensor_values_, mqtt::SensorId::kAcInputVoltageRange,
       {InputVoltageRange::kAppliance, InputVoltageRange::kUps},
       [this](InputVoltageRange r) { return SetInputVoltageRange(r); }
   };
 
-  mqtt::OutputSourcePrioritySelector output_source_priority_{
+  mqtt::Selector<OutputSourcePriority> output_source_priority_{
+      sensor_values_, mqtt::SensorId::kOutputSourcePriority,
       {OutputSourcePriority::kSolarUtilityBattery, OutputSourcePriority::kSolarBatteryUtility},
       [this](OutputSourcePriority p) { return SetOutputSourcePriority(p); }
   };
-  mqtt::ChargerSourcePrioritySelector charger_source_priority_{
+  mqtt::Selector<ChargerPriority> charger_source_priority_{
+      sensor_values_, mqtt::SensorId::kChargerSourcePriority,
       {ChargerPriority::kSolarFirst,
        ChargerPriority::kSolarAndUtility,
        ChargerPriority::kOnlySolar},
        [this](ChargerPriority p) { return SetChargerPriority(p); }
   };
 
-  mqtt::SolarPowerPrioritySelector solar_power_priority_{
+  mqtt::Selector<SolarPowerPriority> solar_power_priority_{
+      sensor_values_, mqtt::SensorId::kSolarPowerPriority,
       {SolarPowerPriority::kBatteryLoadUtility, SolarPowerPriority::kLoadBatteryUtility},
       [this](SolarPowerPriority p) { return SetSolarPowerPriority(p); }
   };
 
-  mqtt::MachineTypeSelector machine_type_;
+  mqtt::TypedSensor<MachineType> machine_type_{sensor_values_, mqtt::SensorId::kMachineType};
 
   // Instant metrics.
-  mqtt::GridVoltage grid_voltage_;
-  mqtt::GridFrequency grid_frequency_;
-  mqtt::OutputVoltage ac_output_voltage_;
-  mqtt::OutputFrequency ac_output_frequency_;
-  mqtt::OutputApparentPower ac_output_apparent_power_;
-  mqtt::OutputActivePower ac_output_active_power_;
-  mqtt::OutputLoadPercent output_load_percent_;
-
-  mqtt::BatteryVoltage battery_voltage_;
-  mqtt::BatteryVoltageFromScc battery_voltage_from_scc_;
-  mqtt::BatteryVoltageFromScc2 battery_voltage_from_scc2_;
-  mqtt::BatteryDischargeCurrent battery_discharge_current_;
-  mqtt::BatteryChargeCurrent battery_charging_current_;
-  mqtt::BatteryCapacity battery_capacity_;
-
-  mqtt::HeatsinkTemperature inverter_heat_sink_temperature_;
-  mqtt::Mptt1ChargerTemperature mptt1_charger_temperature_;
-  mqtt::Mptt2ChargerTemperature mptt2_charger_temperature_;
-  mqtt::PvWatts pv_input_power_;
-  mqtt::PvWatts2 pv2_input_power_;
-  mqtt::PvVoltage pv_input_voltage_;
-  mqtt::Pv2Voltage pv2_input_voltage_;
-  mqtt::PvTotalGeneratedEnergy total_energy_;
-
-  mqtt::WarningsSensor warnings_;
-
-  mqtt::BacklightSwitch backlight_{[this](bool state) { return TurnBacklight(state); }};
-  mqtt::Switch load_connection_{"Load_connection", [this](bool state) { return TurnLoadConnection(state); }};
+  mqtt::TypedSensor<float> grid_voltage_{sensor_values_, mqtt::SensorId::kGridVoltage};
+  mqtt::TypedSensor<float> grid_frequency_{sensor_values_, mqtt::SensorId::kGridFrequency};
+  mqtt::TypedSensor<float> ac_output_voltage_{sensor_values_, mqtt::SensorId::kOutputVoltage};
+  mqtt::TypedSensor<float> ac_output_frequency_{sensor_values_, mqtt::SensorId::kOutputFrequency};
+  mqtt::TypedSensor<int> ac_output_apparent_power_{sensor_values_,
+                                                   mqtt::SensorId::kOutputApparentPower};
+  mqtt::TypedSensor<int> ac_output_active_power_{sensor_values_,
+                                                 mqtt::SensorId::kOutputActivePower};
+  mqtt::TypedSensor<int> output_load_percent_{sensor_values_, mqtt::SensorId::kOutputLoadPercent};
+
+  mqtt::TypedSensor<float> battery_voltage_{sensor_values_, mqtt::SensorId::kBatteryVoltage};
+  mqtt::TypedSensor<float> battery_voltage_from_scc_{sensor_values_,
+                                                     mqtt::SensorId::kBatteryVoltageFromScc};
+  mqtt::TypedSensor<float> battery_voltage_from_scc2_{sensor_values_,
+                                                      mqtt::SensorId::kBatteryVoltageFromScc2};
+  mqtt::TypedSensor<int> battery_discharge_current_{sensor_values_,
+                                                    mqtt::SensorId::kBatteryDischargeCurrent};
+  mqtt::TypedSensor<int> battery_charging_current_{sensor_values_,
+                                                   mqtt::SensorId::kBatteryChargeCurrent};
+  mqtt::TypedSensor<int> battery_capacity_{sensor_values_, mqtt::SensorId::kBatteryCapacity};
+
+  mqtt::TypedSensor<int> inverter_heat_sink_temperature_{sensor_values_,
+                                                         mqtt::SensorId::kHeatsinkTemperature};
+  mqtt::TypedSensor<int> mptt1_charger_temperature_{sensor_values_,
+                                                    mqtt::SensorId::kMptt1ChargerTemperature};
+  mqtt::TypedSensor<int> mptt2_charger_temperature_{sensor_values_,
+                                                    mqtt::SensorId::kMptt2ChargerTemperature};
+  mqtt::TypedSensor<int> pv_input_power_{sensor_values_, mqtt::SensorId::kPvWatts};
+  mqtt::TypedSensor<int> pv2_input_power_{sensor_values_, mqtt::SensorId::kPvWatts2};
+  mqtt::TypedSensor<float> pv_input_voltage_{sensor_values_, mqtt::SensorId::kPvVoltage};
+  mqtt::TypedSensor<float> pv2_input_voltage_{sensor_values_, mqtt::SensorId::kPv2Voltage};
+  mqtt::TypedSensor<int> total_energy_{sensor_values_, mqtt::SensorId::kPvTotalGeneratedEnergy};
+  mqtt::EnergyMeters energy_meters_{sensor_values_};
+  Pi18EnergyHistory energy_history_{
+      sensor_values_,
+      [this] { return GetCurrentTimeRaw(); },
+      [this](const Pi18EnergyHistory::Period& period) { return GetGeneratedEnergyRaw(period); }
+  };
+
+  mqtt::Warnings warnings_;
+
+  mqtt::Switch backlight_{sensor_values_, mqtt::SensorId::kBacklight,
+                          [this](bool state) { return TurnBacklight(state); }};
+  mqtt::Switch load_connection_{sensor_values_, mqtt::SensorId::kLoadConnection,
+                                [this](bool state) { return TurnLoadConnection(state); }};
 };
@@ -0,0 +1,191 @@
+#include "pi30_parallel_system.hh"
+
+#include <algorithm>
+#include <format>
+
+#include "configuration.h"
+#include "spdlog/spdlog.h"
+
+
+namespace {
+
+std::string GetUnitSensorName(int unit, std::string_view name) {
+  return std::format("Unit_{}_{}", unit, name);
+}
+
+/// @returns the index of the phase, or -1 if the unit isn't a part of a three-phase system.
+int GetPhase(OutputMode mode) {
+  switch (mode) {
+    case OutputMode::kPhase1Of3: return 0;
+    case OutputMode::kPhase2Of3: return 1;
+    case OutputMode::kPhase3Of3: return 2;
+    default: return -1;
+  }
+}
+
+}  // namespace
+
+
+struct Pi30ParallelSystem::Unit {
+  explicit Unit(int n)
+      : mode(GetUnitSensorName(n, "Mode")),
+        output_mode(GetUnitSensorName(n, "Output_mode")),
+        fault_code(GetUnitSensorName(n, "Fault_code")),
+        grid_voltage(GetUnitSensorName(n, "Grid_voltage"), mqtt::SensorKind::kVoltage),
+        output_voltage(GetUnitSensorName(n, "Output_voltage"), mqtt::SensorKind::kVoltage),
+        output_apparent_power(GetUnitSensorName(n, "Output_apparent_power"),
+                              mqtt::SensorKind::kApparentPower),
+        output_active_power(GetUnitSensorName(n, "Output_active_power"),
+                            mqtt::SensorKind::kPower),
+        output_load_percent(GetUnitSensorName(n, "Output_load_percent"),
+                            mqtt::SensorKind::kPercent),
+        battery_voltage(GetUnitSensorName(n, "Battery_voltage"), mqtt::SensorKind::kVoltage),
+        battery_charging_current(GetUnitSensorName(n, "Battery_charge_current"),
+                                 mqtt::SensorKind::kCurrent),
+        battery_discharge_current(GetUnitSensorName(n, "Battery_discharge_current"),
+                                  mqtt::SensorKind::kCurrent),
+        battery_capacity(GetUnitSensorName(n, "Battery_capacity"), mqtt::SensorKind::kBattery),
+        pv_voltage(GetUnitSensorName(n, "PV_voltage"), mqtt::SensorKind::kVoltage),
+        pv_power(GetUnitSensorName(n, "PV_watts"), mqtt::SensorKind::kPower) {}
+
+  /// The cycle of the last reply.
+  unsigned updated_cycle = 0;
+  UnitStatus status{};
+
+  mqtt::NamedSensor<DeviceMode> mode;
+  mqtt::NamedSensor<OutputMode> output_mode;
+  mqtt::NamedSensor<int> fault_code;
+  mqtt::NamedSensor<float> grid_voltage;
+  mqtt::NamedSensor<float> output_voltage;
+  mqtt::NamedSensor<int> output_apparent_power;
+  mqtt::NamedSensor<int> output_active_power;
+  mqtt::NamedSensor<int> output_load_percent;
+  mqtt::NamedSensor<float> battery_voltage;
+  mqtt::NamedSensor<int> battery_charging_current;
+  mqtt::NamedSensor<int> battery_discharge_current;
+  mqtt::NamedSensor<int> battery_capacity;
+  mqtt::NamedSensor<float> pv_voltage;
+  mqtt::NamedSensor<int> pv_power;
+};
+
+
+Pi30ParallelSystem::Pi30ParallelSystem(const Transport& transport, mqtt::SensorValues& values)
+    : transport_(transport),
+      units_online_(values, mqtt::SensorId::kParallelUnits),
+      output_active_power_(values, mqtt::SensorId::kParallelOutputActivePower),
+      pv_power_(values, mqtt::SensorId::kParallelPvWatts),
+      phase_load_{{values, mqtt::SensorId::kPhaseL1Load},
+                  {values, mqtt::SensorId::kPhaseL2Load},
+                  {values, mqtt::SensorId::kPhaseL3Load}} {}
+
+Pi30ParallelSystem::~Pi30ParallelSystem() = default;
+
+void Pi30ParallelSystem::Configure(OutputMode output_mode, int max_units) {
+  max_units = output_mode == OutputMode::kSingle ? 0 : std::clamp(max_units, 1, kMaxUnits);
+  if (output_mode == output_mode_ && max_units == max_units_) return;
+
+  output_mode_ = output_mode;
+  max_units_ = max_units;
+  if (max_units_ > 0) {
+    spdlog::info("Output mode is {}, polling up to {} parallel units", ToString(output_mode),
+                 max_units_);
+  }
+}
+
+void Pi30ParallelSystem::StartCycle() {
+  ++cycle_;
+  due_.reset();
+  if (max_units_ == 0) return;
+
+  // Replies of the previous cycle have been received by now.
+  int units_online = 0, output_active_power = 0, pv_power = 0;
+  int phase_load[3] = {};
+  bool has_phases = false, has_data = false;
+  for (int i = 0; i < kMaxUnits; ++i) {
+    const auto& unit = units_[i];
+    if (!unit) continue;
+    has_data = true;
+    if (!IsFresh(i)) continue;
+    ++units_online;
+    output_active_power += unit->status.output_active_power;
+    pv_power += static_cast<int>(unit->status.pv_input_voltage * unit->status.pv_input_current);
+    if (const auto phase = GetPhase(unit->status.output_mode); phase >= 0) {
+      phase_load[phase] += unit->status.output_active_power;
+      has_phases = true;
+    }
+  }
+  if (has_data) {
+    units_online_.Update(units_online);
+    output_active_power_.Update(output_active_power);
+    pv_power_.Update(pv_power);
+    for (int phase = 0; has_phases && phase < 3; ++phase) {
+      phase_load_[phase].Update(phase_load[phase]);
+    }
+  }
+
+  // Pick the units for the new cycle, continuing from where the previous one has stopped.
+  std::bitset<kMaxUnits> candidates;
+  for (int unit = 0; unit < max_units_; ++unit) {
+    const auto& missing_since = missing_since_[unit];
+    candidates[unit] = !missing_since || cycle_ - *missing_since >= kMissingUnitRecheckCycles;
+  }
+  const auto units_per_cycle = GetUnitsPerCycle();
+  period_ = std::max<unsigned>(1, (candidates.count() + units_per_cycle - 1) / units_per_cycle);
+  const auto first_unit = next_unit_ % max_units_;
+  for (int i = 0, picked = 0; i < max_units_ && picked < units_per_cycle; ++i) {
+    const auto unit = (first_unit + i) % max_units_;
+    if (!candidates[unit]) continue;
+    due_.set(unit);
+    ++picked;
+    next_unit_ = (unit + 1) % max_units_;
+  }
+}
+
+void Pi30ParallelSystem::Update(int unit_index, const std::optional<UnitStatus>& status) {
+  if (!status) {
+    if (!missing_since_[unit_index]) {
+      spdlog::debug("Parallel unit {} is missing", unit_index);
+    }
+    missing_since_[unit_index] = cycle_;
+    return;
+  }
+  missing_since_[unit_index].reset();
+  auto& unit = units_[unit_index];
+  if (!unit) {
+    unit = std::make_unique<Unit>(unit_index);
+  }
+  unit->updated_cycle = cycle_;
+  unit->status = *status;
+
+  unit->mode.Update(status->mode);
+  unit->output_mode.Update(status->output_mode);
+  unit->fault_code.Update(status->fault_code);
+  unit->grid_voltage.Update(status->grid_voltage);
+  unit->output_voltage.Update(status->output_voltage);
+  unit->output_apparent_power.Update(status->output_apparent_power);
+  unit->output_active_power.Update(status->output_active_power);
+  unit->output_load_percent.Update(status->output_load_percent);
+  unit->battery_voltage.Update(status->battery_voltage);
+  unit->battery_charging_current.Update(status->battery_charging_current);
+  unit->battery_discharge_current.Update(status->battery_discharge_current);
+  unit->battery_capacity.Update(status->battery_capacity);
+  unit->pv_voltage.Update(status->pv_input_voltage);
+  unit->pv_power.Update(static_cast<int>(status->pv_input_voltage * status->pv_input_current));
+}
+
+int Pi30ParallelSystem::GetUnitsPerCycle() const {
+  using Seconds = std::chrono::duration<double>;
+  Seconds query_duration = kDefaultQueryDuration;
+  const auto metrics = transport_.GetMetrics();
+  if (const auto qpgs = metrics.find("QPGS");
+      qpgs != metrics.end() && qpgs->second.p95_latency.count() > 0) {
+    query_duration = qpgs->second.p95_latency;
+  }
+  const auto budget = Seconds(Settings::Instance().polling_interval) * kTimeBudget;
+  return std::clamp(static_cast<int>(budget / query_duration), 1, kMaxUnits);
+}
+
+bool Pi30ParallelSystem::IsFresh(int unit) const {
+  // A unit is polled once in a period, so its values are older than that only if it has failed.
+  return !missing_since_[unit] && cycle_ - units_[unit]->updated_cycle <= 2 * period_;
+}
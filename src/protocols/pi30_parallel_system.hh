@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "mqtt/sensor.hh"
+#include "transport.hh"
+#include "types.hh"
+
+
+/// Units of a parallel (or three-phase) system, which are polled with QPGS0..QPGSn through the
+/// unit the poller is connected to. Every unit gets its own sensors ("Unit_<n>_...", numbered as in
+/// QPGSn), and the system gets the totals over all the units.
+/// Replies to QPGSn are long (~130 bytes, i.e. more than half a second at 2400 baud), so polling
+/// all the units every cycle could take longer than the polling interval. Instead, every cycle
+/// polls only as many units as fit into kTimeBudget of the interval, in turn.
+class Pi30ParallelSystem {
+ public:
+  /// The most units in a parallel system supported by the protocol.
+  static constexpr int kMaxUnits = 9;
+
+  /// A unit's reply to QPGSn.
+  struct UnitStatus {
+    DeviceMode mode;
+    int fault_code;
+    float grid_voltage;
+    float output_voltage;
+    int output_apparent_power;
+    int output_active_power;
+    int output_load_percent;
+    float battery_voltage;
+    int battery_charging_current;
+    int battery_discharge_current;
+    int battery_capacity;
+    float pv_input_voltage;
+    float pv_input_current;
+    OutputMode output_mode;
+  };
+
+  Pi30ParallelSystem(const Transport&, mqtt::SensorValues&);
+  ~Pi30ParallelSystem();
+
+  /// Apply the system settings reported by QPIRI.
+  /// @param max_units - the maximum number of units in the system.
+  void Configure(OutputMode, int max_units);
+
+  /// Publish the totals collected during the previous cycle, and pick the units to be polled in
+  /// the new one. Is called before the status queries of every cycle.
+  void StartCycle();
+
+  /// @returns whether QPGS<unit> should be queried in the current cycle.
+  bool IsDue(int unit) const { return due_[unit]; }
+
+  /// Handle the reply to QPGS<unit>.
+  /// @param status - nothing if there is no such unit in the system.
+  void Update(int unit, const std::optional<UnitStatus>& status);
+
+ private:
+  /// Share of the polling interval that QPGSn queries are allowed to take.
+  static constexpr double kTimeBudget = 0.5;
+  /// The duration of a QPGSn query until there are measurements.
+  static constexpr auto kDefaultQueryDuration = std::chrono::milliseconds(1500);
+  /// Units that were reported missing are checked again once in that many cycles, in case they are
+  /// added to the system.
+  static constexpr unsigned kMissingUnitRecheckCycles = 120;
+
+  struct Unit;
+
+  /// @returns how many QPGSn queries fit into the time budget of a cycle.
+  int GetUnitsPerCycle() const;
+  /// @returns whether the values of the @a unit that has replied at least once could be summed up
+  ///          with the others.
+  bool IsFresh(int unit) const;
+
+  const Transport& transport_;
+  OutputMode output_mode_ = OutputMode::kSingle;
+  int max_units_ = 0;
+
+  std::array<std::unique_ptr<Unit>, kMaxUnits> units_;
+  /// The cycle number when a unit was reported missing, if it was.
+  std::array<std::optional<unsigned>, kMaxUnits> missing_since_;
+  std::bitset<kMaxUnits> due_;
+  /// The unit to start picking due ones from, in the next cycle.
+  int next_unit_ = 0;
+  unsigned cycle_ = 0;
+  /// How many cycles it takes to poll all the units.
+  unsigned period_ = 1;
+
+  mqtt::TypedSensor<int> units_online_;
+  mqtt::TypedSensor<int> output_active_power_;
+  mqtt::TypedSensor<int> pv_power_;
+  mqtt::TypedSensor<int> phase_load_[3];
+};
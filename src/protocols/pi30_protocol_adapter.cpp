@@ -7,19 +7,6 @@
 
 namespace {
 
-//Generate 8 bit CRC of supplied string + 1 as used in REVO PI30 protocol
-//CHK=DATE0+....+1
-//CHK=The accumulated value of sent data+1, single byte.
-char CHK(std::string_view s) {
-  int crc = 0;
-  for (char c: s) {
-    crc += c;
-  }
-  ++crc;
-  crc &= 0xFF;
-  return crc;
-}
-
 BatteryType GetBatteryType(int type) {
   switch (type) {
     case 0: return BatteryType::kAgm;
@@ -143,13 +130,62 @@ constexpr DeviceMode GetDeviceMode(std::string_view mode) {
   throw std::runtime_error(std::format("Unknown device mode: {}", mode));
 }
 
+/// Warning flags as they go in reply to QPIWS.
+/// Note that different documents define different tables for them. This one is taken from
+/// "PI30_HS_MS_MSX_RS232_Protocol", which is the most widespread.
+constexpr mqtt::WarningFlag kWarningFlags[] = {
+    {"Reserved", ""},
+    {"Inverter fault", "Warning_inverter_fault"},
+    {"Bus over", "Warning_bus_over"},
+    {"Bus under", "Warning_bus_under"},
+    {"Bus soft fail", "Warning_bus_soft_fail"},
+    {"Line fail", "Warning_line_fail"},
+    {"OPV short", "Warning_OPV_short"},
+    {"Inverter voltage too low", "Warning_inverter_voltage_too_low"},
+    {"Inverter voltage too high", "Warning_inverter_voltage_too_high"},
+    {"Over temperature", "Warning_over_temperature"},
+    {"Fan locked", "Warning_fan_locked"},
+    {"Battery voltage high", "Warning_battery_voltage_high"},
+    {"Battery low alarm", "Warning_battery_low_alarm"},
+    {"Reserved", ""},
+    {"Battery under shutdown", "Warning_battery_under_shutdown"},
+    {"Reserved", ""},
+    {"Over load", "Warning_over_load"},
+    {"EEPROM fault", "Warning_EEPROM_fault"},
+    {"Inverter over current", "Warning_inverter_over_current"},
+    {"Inverter soft fail", "Warning_inverter_soft_fail"},
+    {"Self test fail", "Warning_self_test_fail"},
+    {"OP DC voltage over", "Warning_OP_DC_voltage_over"},
+    {"Battery open", "Warning_battery_open"},
+    {"Current sensor fail", "Warning_current_sensor_fail"},
+    {"Battery short", "Warning_battery_short"},
+    {"Power limit", "Warning_power_limit"},
+    {"PV voltage high", "Warning_PV_voltage_high"},
+    {"MPPT overload fault", "Warning_MPPT_overload_fault"},
+    {"MPPT overload warning", "Warning_MPPT_overload"},
+    {"Battery too low to charge", "Warning_battery_too_low_to_charge"},
+};
+
 }  // namespace
 
-Pi30ProtocolAdapter::Pi30ProtocolAdapter(const SerialPort& port)
-    : ProtocolAdapter(port) {}
+Pi30ProtocolAdapter::Pi30ProtocolAdapter(const Transport& transport)
+    : ProtocolAdapter(transport),
+      warnings_(sensor_values_, kWarningFlags),
+      parallel_system_(transport, sensor_values_) {
+  AddRatedInfoTask("QPIRI", "(", [this](auto& r) { HandleRatingInformation(r); });
+
+  AddStatusInfoTask("QPIGS", "(", [this](auto& r) { HandleGeneralStatus(r); });
+  AddStatusInfoTask("QMOD", "(", [this](auto& r) { HandleDeviceMode(r); });
+  AddStatusInfoTask("QPIWS", "(", [this](auto& r) { HandleWarnings(r); });
+  // Only some of the units are polled every cycle, see Pi30ParallelSystem.
+  for (int unit = 0; unit < Pi30ParallelSystem::kMaxUnits; ++unit) {
+    AddStatusInfoTask(std::format("QPGS{}", unit), "(",
+                      [this, unit](auto& r) { HandleParallelUnitStatus(unit, r); },
+                      [this, unit] { return parallel_system_.IsDue(unit); });
+  }
+}
 
-void Pi30ProtocolAdapter::GetRatedInfo() {
-  auto str = GetDeviceRatingInformationRaw();
+void Pi30ProtocolAdapter::HandleRatingInformation(const std::string& str) {
   if (str.length() < 80) {
     // Too short reply. Probably it's something like InfiniSolarE5.5KW, which returns the following:
     // BBB.B FF.F III.I EEE.E DDD.D AA.A GGG.G R MM T
@@ -214,26 +250,16 @@ void Pi30ProtocolAdapter::GetRatedInfo() {
 
   output_source_priority_.Update(GetOutputSourcePriority(output_source_priority));
   charger_source_priority_.Update(GetChargerPriority(charger_source_priority));
+
+  parallel_system_.Configure(GetOutputMode(output_mode), parallel_max_num);
 }
 
-/* TODO: fix
-// TODO: print human-readable warnings. The problem is that different documents define completely
-//  different tables for them.
-void Pi30ProtocolAdapter::GetWarnings() {
-  auto str = GetDeviceWarningStatusRaw();
-  for (auto c : str) {
-    if (c == 1) {
-      // Something is wrong.
-      return {str};
-    }
-  }
-  // No warnings detected.
-  return {};
+void Pi30ProtocolAdapter::HandleWarnings(const std::string& response) {
+  // Response: a0a1...a31, where each "aN" is either 0 or 1. Some devices send a few more flags.
+  warnings_.Update(mqtt::Warnings::ParseBitString(response));
 }
- */
 
-void Pi30ProtocolAdapter::GetStatusInfo() {
-  auto str = GetDeviceGeneralStatusRaw();
+void Pi30ProtocolAdapter::HandleGeneralStatus(const std::string& str) {
   // Again, three different documents describe tree different reply structure:
   // BBB.B CC.C DDD.D EE.E FFFF GGGG HHH III JJ.JJ KKK OOO TTTT EE.E UUU.U WW.WW PPPPP b7b6b5b4b3b2b1b0 QQ VV MMMMM b10b9b8 Y ZZ AAAA
   // BBB.B CC.C DDD.D EE.E FFFF GGGG HHH III JJ.JJ KKK OOO TTTT EEEE UUU.U WW.WW PPPPP b7b6b5b4b3b2b1b0
@@ -266,6 +292,10 @@ void Pi30ProtocolAdapter::GetStatusInfo() {
                              &battery_discharge_current,
                              device_status
                              );
+  if (n_args < 17) {
+    throw std::runtime_error("Unexpected data in GetDeviceGeneralStatus: " + str);
+  }
+
   grid_voltage_.Update(grid_voltage);
   grid_frequency_.Update(grid_frequency);
   ac_output_voltage_.Update(ac_output_voltage);
@@ -285,9 +315,67 @@ void Pi30ProtocolAdapter::GetStatusInfo() {
 
   inverter_heat_sink_temperature_.Update(inverter_heat_sink_temperature);
 
-  // Other status info.
+  energy_meters_.Update(pv_input_voltage * pv_input_current, ac_output_active_power,
+                        battery_voltage, battery_charging_current, battery_discharge_current);
+
   // TODO InfiniSolarE5.5KW supports total generated energy. Add it.
-  mode_.Update(GetDeviceMode(GetDeviceModeRaw()));
+}
+
+void Pi30ProtocolAdapter::HandleParallelUnitStatus(int unit, const std::string& str) {
+  // A BBBBBBBBBBBBBB C DD EEE.E FF.FF GGG.G HH.HH IIII JJJJ KKK LL.L MMM NNN OOO.O PPP QQQQQ RRRRR SSS b7b6b5b4b3b2b1b0 T U VVV WWW ZZ XX YYY
+  // "A" is 0 if there is no such unit, then the rest is meaningless.
+  if (str.starts_with('0')) {
+    parallel_system_.Update(unit, std::nullopt);
+    return;
+  }
+
+  Pi30ParallelSystem::UnitStatus status;
+  int exists, output_mode, total_charging_current, total_output_apparent_power,
+      total_output_active_power, total_output_load_percent, charger_source_priority,
+      max_charging_current, max_charging_range, max_ac_charging_current, pv_input_current;
+  float grid_frequency, output_frequency;
+  char serial_number[15], mode, device_status[10];
+  const auto n_args = sscanf(str.c_str(),
+                             "%1d %14s %c %d %f %f %f %f %d %d %d %f %d %d %f %d %d %d %d %8s %1d %1d %d %d %d %d %d",
+                             &exists,
+                             serial_number,
+                             &mode,
+                             &status.fault_code,
+                             &status.grid_voltage,
+                             &grid_frequency,
+                             &status.output_voltage,
+                             &output_frequency,
+                             &status.output_apparent_power,
+                             &status.output_active_power,
+                             &status.output_load_percent,
+                             &status.battery_voltage,
+                             &status.battery_charging_current,
+                             &status.battery_capacity,
+                             &status.pv_input_voltage,
+                             &total_charging_current,
+                             &total_output_apparent_power,
+                             &total_output_active_power,
+                             &total_output_load_percent,
+                             device_status,
+                             &output_mode,
+                             &charger_source_priority,
+                             &max_charging_current,
+                             &max_charging_range,
+                             &max_ac_charging_current,
+                             &pv_input_current,
+                             &status.battery_discharge_current
+                             );
+  if (n_args < 27) {
+    throw std::runtime_error("Unexpected data in GetParallelUnitStatus: " + str);
+  }
+  status.mode = GetDeviceMode(std::string_view(&mode, 1));
+  status.output_mode = GetOutputMode(output_mode);
+  status.pv_input_current = static_cast<float>(pv_input_current);
+  parallel_system_.Update(unit, status);
+}
+
+void Pi30ProtocolAdapter::HandleDeviceMode(const std::string& response) {
+  mode_.Update(GetDeviceMode(response));
 }
 
 bool Pi30ProtocolAdapter::SendCommand(std::string_view command) {
@@ -1,21 +1,29 @@
 #pragma once
 
 #include "protocol_adapter.hh"
+#include "pi30_parallel_system.hh"
+#include "mqtt/energy.hh"
 #include "mqtt/sensor.hh"
+#include "mqtt/warnings.hh"
 
 
 class Pi30ProtocolAdapter : public ProtocolAdapter {
  public:
-  explicit Pi30ProtocolAdapter(const SerialPort&);
+  explicit Pi30ProtocolAdapter(const Transport&);
 
   std::string GetSerialNumber() override { return GetSerialNumberRaw(); }
   void QueryProtocolId() override { GetDeviceProtocolIdRaw(); };
 
-  void GetRatedInfo() override;
-  void GetStatusInfo() override;
-
  protected:
   bool UseCrcInQueries() override { return true; }
+  void PrepareStatusCycle() override { parallel_system_.StartCycle(); }
+
+  // Handlers of the replies to the corresponding queries.
+  void HandleRatingInformation(const std::string&);
+  void HandleGeneralStatus(const std::string&);
+  void HandleDeviceMode(const std::string&);
+  void HandleWarnings(const std::string&);
+  void HandleParallelUnitStatus(int unit, const std::string&);
 
   bool SetInputVoltageRange(InputVoltageRange);
   bool SetChargerPriority(ChargerPriority);
@@ -36,43 +44,51 @@ class Pi30ProtocolAdapter : public ProtocolAdapter {
   std::string GetSelectableValueAboutMaxUtilityChargingCurrentRaw() { return Query("QMUCHGCR", "("); }
   std::string GetDspHasBootstrapOrNotRaw() { return Query("QBOOT", "("); }
   std::string GetOutputModeRaw() { return Query("QOPM", "("); }
-  // ...
-  // Here could go routines to query data for parallel system, but I haven't implemented them.
-  // ...
+  /// @param unit - 0..Pi30ParallelSystem::kMaxUnits - 1.
+  std::string GetParallelUnitStatusRaw(int unit) { return Query(std::format("QPGS{}", unit), "("); }
 
  private:
   bool SendCommand(std::string_view);
 
 
-  mqtt::InverterMode mode_;
+  mqtt::TypedSensor<DeviceMode> mode_{sensor_values_, mqtt::SensorId::kMode};
 
-  mqtt::BatteryNominalVoltage battery_nominal_voltage_;
-  mqtt::BatteryStopDischargingVoltageWithGrid battery_stop_discharging_voltage_with_grid_;
+  mqtt::TypedSensor<float> battery_nominal_voltage_{sensor_values_,
+                                                    mqtt::SensorId::kBatteryNominalVoltage};
+  mqtt::TypedSensor<float> battery_stop_discharging_voltage_with_grid_{
+      sensor_values_, mqtt::SensorId::kBatteryStopDischargingVoltageWithGrid};
 
 //  12V unit: 00.0V12V/12.3V/12.5V/12.8V/13V/13.3V/13.5V/13.8V/14V/14.3V/14.5
 //      24V unit: 00.0V/24V/24.5V/25V/25.5V/26V/26.5V/27V/27.5V/28V/28.5V/29V
 //      48V unit: 00.0V48V/49V/50V/51V/52V/53V/54V/55V/56V/57V/58V
 //  mqtt::BatteryStopChargingVoltageWithGrid battery_stop_charging_voltage_with_grid_;
-  mqtt::BatteryUnderVoltage battery_under_voltage_;
-  mqtt::BatteryBulkVoltage battery_bulk_voltage_;
-  mqtt::BatteryFloatVoltage battery_float_voltage_;
-  mqtt::BatteryType battery_type_{
+  mqtt::TypedSensor<float> battery_under_voltage_{sensor_values_,
+                                                  mqtt::SensorId::kBatteryUnderVoltage};
+  mqtt::TypedSensor<float> battery_bulk_voltage_{sensor_values_,
+                                                 mqtt::SensorId::kBatteryBulkVoltage};
+  mqtt::TypedSensor<float> battery_float_voltage_{sensor_values_,
+                                                  mqtt::SensorId::kBatteryFloatVoltage};
+  mqtt::Selector<BatteryType> battery_type_{
+      sensor_values_, mqtt::SensorId::kBatteryType,
       {BatteryType::kAgm, BatteryType::kFlooded},
       [this](BatteryType b) { return SetBatteryType(b); }
   };
 
-  mqtt::AcInputVoltageRangeSelector input_voltage_range_{
+  mqtt::Selector<InputVoltageRange> input_voltage_range_{
+      sensor_values_, mqtt::SensorId::kAcInputVoltageRange,
       {InputVoltageRange::kAppliance, InputVoltageRange::kUps},
       [this](InputVoltageRange r) { return SetInputVoltageRange(r); }
   };
 
-  mqtt::OutputSourcePrioritySelector output_source_priority_{
+  mqtt::Selector<OutputSourcePriority> output_source_priority_{
+      sensor_values_, mqtt::SensorId::kOutputSourcePriority,
       {OutputSourcePriority::kUtility,
        OutputSourcePriority::kSolarUtilityBattery,
        OutputSourcePriority::kSolarBatteryUtility},
       [this](OutputSourcePriority p) { return SetOutputSourcePriority(p); }
   };
-  mqtt::ChargerSourcePrioritySelector charger_source_priority_{
+  mqtt::Selector<ChargerPriority> charger_source_priority_{
+      sensor_values_, mqtt::SensorId::kChargerSourcePriority,
       {ChargerPriority::kUtilityFirst,
        ChargerPriority::kSolarFirst,
        ChargerPriority::kSolarAndUtility,
@@ -80,25 +96,37 @@ class Pi30ProtocolAdapter : public ProtocolAdapter {
       [this](ChargerPriority p) { return SetChargerPriority(p); }
   };
 
-  mqtt::GridVoltage grid_voltage_;
-  mqtt::GridFrequency grid_frequency_;
-  mqtt::OutputVoltage ac_output_voltage_;
-  mqtt::OutputFrequency ac_output_frequency_;
-  mqtt::OutputApparentPower ac_output_apparent_power_;
-  mqtt::OutputActivePower ac_output_active_power_;
-  mqtt::OutputLoadPercent output_load_percent_;
+  mqtt::TypedSensor<float> grid_voltage_{sensor_values_, mqtt::SensorId::kGridVoltage};
+  mqtt::TypedSensor<float> grid_frequency_{sensor_values_, mqtt::SensorId::kGridFrequency};
+  mqtt::TypedSensor<float> ac_output_voltage_{sensor_values_, mqtt::SensorId::kOutputVoltage};
+  mqtt::TypedSensor<float> ac_output_frequency_{sensor_values_, mqtt::SensorId::kOutputFrequency};
+  mqtt::TypedSensor<int> ac_output_apparent_power_{sensor_values_,
+                                                   mqtt::SensorId::kOutputApparentPower};
+  mqtt::TypedSensor<int> ac_output_active_power_{sensor_values_,
+                                                 mqtt::SensorId::kOutputActivePower};
+  mqtt::TypedSensor<int> output_load_percent_{sensor_values_, mqtt::SensorId::kOutputLoadPercent};
+
+  mqtt::TypedSensor<float> battery_voltage_{sensor_values_, mqtt::SensorId::kBatteryVoltage};
+  mqtt::TypedSensor<int> battery_charging_current_{sensor_values_,
+                                                   mqtt::SensorId::kBatteryChargeCurrent};
+  mqtt::TypedSensor<int> battery_discharge_current_{sensor_values_,
+                                                    mqtt::SensorId::kBatteryDischargeCurrent};
+  mqtt::TypedSensor<int> battery_capacity_{sensor_values_, mqtt::SensorId::kBatteryCapacity};
+  mqtt::TypedSensor<float> battery_voltage_from_scc_{sensor_values_,
+                                                     mqtt::SensorId::kBatteryVoltageFromScc};
+
+  mqtt::TypedSensor<int> pv_input_power_{sensor_values_, mqtt::SensorId::kPvWatts};
+  mqtt::TypedSensor<float> pv_bus_voltage_{sensor_values_, mqtt::SensorId::kPvBusVoltage};
+  mqtt::EnergyMeters energy_meters_{sensor_values_};
 
-  mqtt::BatteryVoltage battery_voltage_;
-  mqtt::BatteryChargeCurrent battery_charging_current_;
-  mqtt::BatteryDischargeCurrent battery_discharge_current_;
-  mqtt::BatteryCapacity battery_capacity_;
-  mqtt::BatteryVoltageFromScc battery_voltage_from_scc_;
+  mqtt::TypedSensor<int> inverter_heat_sink_temperature_{sensor_values_,
+                                                         mqtt::SensorId::kHeatsinkTemperature};
 
-  mqtt::PvWatts pv_input_power_;
-  mqtt::PvBusVoltage pv_bus_voltage_;
+  mqtt::Warnings warnings_;
 
-  mqtt::HeatsinkTemperature inverter_heat_sink_temperature_;
+  Pi30ParallelSystem parallel_system_;
 
   // TODO: implement.
-//  mqtt::BacklightSwitch backlight_{[this](bool state) { return TurnBacklight(state); }};
+//  mqtt::Switch backlight_{sensor_values_, mqtt::SensorId::kBacklight,
+//                          [this](bool state) { return TurnBacklight(state); }};
 };
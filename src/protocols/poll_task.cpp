@@ -0,0 +1,68 @@
+#include "poll_task.hh"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+/// How many failures in a row are tolerated before the circuit breaker opens.
+constexpr unsigned kErrorBudget = 3;
+
+constexpr auto kInitialBackoff = std::chrono::seconds(30);
+constexpr auto kMaxBackoff = std::chrono::minutes(30);
+
+}  // namespace
+
+
+PollTask::PollTask(std::string_view query, std::string_view expected_response_prefix,
+                   Handler&& handler, Condition&& is_due)
+    : query_(query),
+      expected_response_prefix_(expected_response_prefix),
+      handler_(std::move(handler)),
+      is_due_(std::move(is_due)) {}
+
+bool PollTask::TryAcquire(Clock::time_point now) {
+  if (is_due_ && !is_due_()) return false;
+  if (now < closed_until_) {
+    ++statistics_.skipped;
+    return false;
+  }
+  return true;
+}
+
+void PollTask::OnSuccess() {
+  ++statistics_.succeeded;
+  if (consecutive_failures_ >= kErrorBudget) {
+    spdlog::info("Query {} works again.", query_);
+  }
+  consecutive_failures_ = 0;
+  backoff_ = Clock::duration::zero();
+}
+
+void PollTask::OnDisconnected(std::string_view reason) {
+  ++statistics_.failed;
+  spdlog::debug("Query {} failed: {}", query_, reason);
+}
+
+void PollTask::ResetBreaker() {
+  consecutive_failures_ = 0;
+  backoff_ = Clock::duration::zero();
+  closed_until_ = Clock::time_point();
+}
+
+void PollTask::OnFailure(std::string_view reason, Clock::time_point now) {
+  ++statistics_.failed;
+  ++consecutive_failures_;
+  spdlog::error("Query {} failed ({} in a row, {} in total): {}",
+                query_, consecutive_failures_, statistics_.failed, reason);
+  if (consecutive_failures_ < kErrorBudget) return;
+
+  // Error budget is exhausted. Open the circuit breaker.
+  backoff_ = (backoff_ == Clock::duration::zero())
+             ? std::chrono::duration_cast<Clock::duration>(kInitialBackoff)
+             : std::min<Clock::duration>(backoff_ * 2, kMaxBackoff);
+  closed_until_ = now + backoff_;
+  spdlog::warn("Query {} is suspended for {} seconds.", query_,
+               std::chrono::duration_cast<std::chrono::seconds>(backoff_).count());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+
+
+/// A single step of polling the inverter: one query and the handler of its reply.
+/// Tasks are isolated from each other: a failure of one task (CRC mismatch, timeout, unparsable
+/// reply etc.) doesn't prevent the others from running. Each task has its own error budget: when
+/// it fails too many times in a row, its circuit breaker opens and the task is skipped for a while,
+/// so the serial link isn't wasted on it. The pause grows exponentially while failures continue.
+class PollTask {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Handler = std::function<void(const std::string& response)>;
+  /// Decides whether the task is due in the current cycle, see TryAcquire().
+  using Condition = std::function<bool()>;
+
+  struct Statistics {
+    unsigned succeeded = 0;
+    unsigned failed = 0;
+    /// How many times the task was skipped because its circuit breaker was open.
+    unsigned skipped = 0;
+  };
+
+  /// @param query - see ProtocolAdapter::Query().
+  /// @param expected_response_prefix - see ProtocolAdapter::Query().
+  /// @param handler - called with the reply (without the prefix). Is allowed to throw.
+  /// @param is_due - optional, for tasks that shouldn't run every cycle.
+  PollTask(std::string_view query, std::string_view expected_response_prefix, Handler&& handler,
+           Condition&& is_due = nullptr);
+
+  const std::string& GetQuery() const { return query_; }
+  std::string_view GetExpectedResponsePrefix() const { return expected_response_prefix_; }
+  const Statistics& GetStatistics() const { return statistics_; }
+
+  /// @returns false if the task isn't due, or if the circuit breaker is open, i.e. the task should
+  /// be skipped for now. Only the calls skipped because of the circuit breaker are counted.
+  bool TryAcquire(Clock::time_point now = Clock::now());
+
+  void Handle(const std::string& response) const { handler_(response); }
+
+  void OnSuccess();
+  void OnFailure(std::string_view reason, Clock::time_point now = Clock::now());
+  /// The query failed because the link to the device is lost. It says nothing about the task, so it
+  /// isn't charged to the error budget: the task keeps probing the link until it's restored.
+  void OnDisconnected(std::string_view reason);
+  /// Forget the failures in a row, e.g. the ones caused by the device going away, and let the task
+  /// run in the next cycle.
+  void ResetBreaker();
+
+ private:
+  const std::string query_;
+  const std::string expected_response_prefix_;
+  const Handler handler_;
+  const Condition is_due_;
+
+  Statistics statistics_;
+  unsigned consecutive_failures_ = 0;
+  Clock::duration backoff_ = Clock::duration::zero();
+  Clock::time_point closed_until_;
+};
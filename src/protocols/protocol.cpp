@@ -7,7 +7,7 @@
 Protocol ProtocolFromString(std::string_view s) {
   if (s == "PI17") return Protocol::PI17;
   if (s == "PI18") return Protocol::PI18;
-  if (s == "PI17") return Protocol::PI17;
+  if (s == "PI30") return Protocol::PI30;
   throw UnsupportedProtocolException(s);
 }
 
@@ -3,23 +3,40 @@
 #include <format>
 
 #include "../exceptions.h"
+#include "../frame_trace.hh"
+#include "../trace.hh"
+#include "../utils.h"
 #include "pi18_protocol_adapter.hh"
 #include "pi30_protocol_adapter.hh"
 
 
 namespace {
 
-void CheckStartsWith(std::string_view response, std::string_view expected_prefix) {
+void CheckStartsWith(std::string_view response, std::string_view expected_prefix,
+                     FrameTrace& frame_trace) {
   if (!response.starts_with(expected_prefix)) {
     const auto err = std::format("Response '{}' is expected to start with '{}'", response,
                                  expected_prefix);
-    spdlog::error(err);
+    frame_trace.Dump(err);
     throw std::runtime_error(err);
   }
 }
 
-std::unique_ptr<ProtocolAdapter> TryProtocol(Protocol p, SerialPort& port) {
-  auto adapter = ProtocolAdapter::Get(p, port);
+/// PI18 replies start with "^Dnnn", where "nnn" is the length of the rest of the reply (including
+/// CRC and carriage return).
+/// @returns the expected length of the whole reply, or 0 if it can't be figured out of the prefix.
+std::size_t GetExpectedReplyLength(std::string_view expected_prefix) {
+  if (expected_prefix.length() != 5 || !expected_prefix.starts_with("^D")) return 0;
+  std::size_t length = 0;
+  for (char c : expected_prefix.substr(2)) {
+    if (!std::isdigit(c)) return 0;
+    length = length * 10 + utils::AsDigit(c);
+  }
+  return expected_prefix.length() + length;
+}
+
+std::unique_ptr<ProtocolAdapter> TryProtocol(Protocol p, Transport& transport) {
+  auto adapter = ProtocolAdapter::Get(p, transport);
   try {
     adapter->QueryProtocolId();
     spdlog::info("Using protocol {}", ToString(p));
@@ -33,26 +50,128 @@ std::unique_ptr<ProtocolAdapter> TryProtocol(Protocol p, SerialPort& port) {
 }  // namespace
 
 
-std::unique_ptr<ProtocolAdapter> ProtocolAdapter::Get(Protocol protocol, const SerialPort& port) {
+std::unique_ptr<ProtocolAdapter> ProtocolAdapter::Get(Protocol protocol,
+                                                      const Transport& transport) {
   switch (protocol) {
     case Protocol::PI17: throw UnsupportedProtocolException("PI17");
-    case Protocol::PI18: return std::make_unique<Pi18ProtocolAdapter>(port);
-    case Protocol::PI30: return std::make_unique<Pi30ProtocolAdapter>(port);;
+    case Protocol::PI18: return std::make_unique<Pi18ProtocolAdapter>(transport);
+    case Protocol::PI30: return std::make_unique<Pi30ProtocolAdapter>(transport);;
   }
   throw std::runtime_error("Unreachable");
 }
 
 std::string ProtocolAdapter::Query(std::string_view query,
                                    std::string_view expected_response_prefix) {
-  auto response = port_.Query(query, UseCrcInQueries());
-  CheckStartsWith(response, expected_response_prefix);
+  auto response = transport_.Query(query, UseCrcInQueries(),
+                              GetExpectedReplyLength(expected_response_prefix));
+  CheckStartsWith(response, expected_response_prefix, transport_.GetFrameTrace());
   response.erase(0, expected_response_prefix.length());
   return response;
 }
 
-std::unique_ptr<ProtocolAdapter> DetectProtocol(SerialPort& port) {
+void ProtocolAdapter::AddRatedInfoTask(std::string_view query,
+                                       std::string_view expected_response_prefix,
+                                       PollTask::Handler&& handler) {
+  rated_info_tasks_.emplace_back(query, expected_response_prefix, std::move(handler));
+}
+
+void ProtocolAdapter::AddStatusInfoTask(std::string_view query,
+                                        std::string_view expected_response_prefix,
+                                        PollTask::Handler&& handler,
+                                        PollTask::Condition&& is_due) {
+  status_info_tasks_.emplace_back(query, expected_response_prefix, std::move(handler),
+                                  std::move(is_due));
+}
+
+std::vector<const PollTask*> ProtocolAdapter::GetTasks() const {
+  std::vector<const PollTask*> result;
+  for (const auto& task : rated_info_tasks_) result.push_back(&task);
+  for (const auto& task : status_info_tasks_) result.push_back(&task);
+  return result;
+}
+
+void ProtocolAdapter::Run(std::list<PollTask>& tasks) {
+  for (auto& task : tasks) {
+    if (!task.TryAcquire()) continue;
+    try {
+      const auto& prefix = task.GetExpectedResponsePrefix();
+      HandleReply(task, transport_.Query(task.GetQuery(), UseCrcInQueries(),
+                                         GetExpectedReplyLength(prefix)));
+      task.OnSuccess();
+    } catch (const DisconnectedException& e) {
+      OnDisconnected(task, e.what());
+      return;
+    } catch (const std::exception& e) {
+      task.OnFailure(e.what());
+    }
+  }
+}
+
+void ProtocolAdapter::OnDisconnected(PollTask& task, std::string_view reason) {
+  task.OnDisconnected(reason);
+  for (auto& t : rated_info_tasks_) t.ResetBreaker();
+  for (auto& t : status_info_tasks_) t.ResetBreaker();
+}
+
+void ProtocolAdapter::HandleReply(PollTask& task, std::string reply) {
+  CheckStartsWith(reply, task.GetExpectedResponsePrefix(), transport_.GetFrameTrace());
+  reply.erase(0, task.GetExpectedResponsePrefix().length());
+  try {
+    TRACE_SPAN("ProtocolAdapter::Handle", task.GetQuery());
+    task.Handle(reply);
+  } catch (const std::exception&) {
+    // The reply is fine from the transport's point of view, but can't be parsed.
+    transport_.GetFrameTrace().Dump(std::format("Failed to handle reply to {}", task.GetQuery()));
+    throw;
+  }
+}
+
+ProtocolAdapter::Cycle ProtocolAdapter::StartCycle() {
+  PrepareStatusCycle();
+  std::vector<PollTask*> tasks;
+  for (auto& task : rated_info_tasks_) tasks.push_back(&task);
+  for (auto& task : status_info_tasks_) tasks.push_back(&task);
+  return Cycle(*this, std::move(tasks));
+}
+
+ProtocolAdapter::Cycle::Cycle(ProtocolAdapter& adapter, std::vector<PollTask*>&& tasks)
+    : adapter_(adapter), tasks_(std::move(tasks)) {}
+
+std::optional<ProtocolAdapter::Cycle::Query> ProtocolAdapter::Cycle::Next() {
+  current_ = nullptr;
+  while (next_ < tasks_.size()) {
+    auto* task = tasks_[next_++];
+    if (!task->TryAcquire()) continue;
+    current_ = task;
+    return Query{
+        .query = task->GetQuery(),
+        .with_crc = adapter_.UseCrcInQueries(),
+        .expected_reply_length = GetExpectedReplyLength(task->GetExpectedResponsePrefix())};
+  }
+  return std::nullopt;
+}
+
+void ProtocolAdapter::Cycle::OnReply(const std::string& reply) {
+  try {
+    adapter_.HandleReply(*current_, reply);
+    current_->OnSuccess();
+  } catch (const std::exception& e) {
+    current_->OnFailure(e.what());
+  }
+}
+
+void ProtocolAdapter::Cycle::OnFailure(std::string_view reason) {
+  current_->OnFailure(reason);
+}
+
+void ProtocolAdapter::Cycle::OnDisconnected(std::string_view reason) {
+  adapter_.OnDisconnected(*current_, reason);
+  next_ = tasks_.size();
+}
+
+std::unique_ptr<ProtocolAdapter> DetectProtocol(Transport& transport) {
   for (auto protocol : {Protocol::PI30, Protocol::PI18}) {
-    if (auto adapter = TryProtocol(protocol, port)) {
+    if (auto adapter = TryProtocol(protocol, transport)) {
       return adapter;
     }
   }
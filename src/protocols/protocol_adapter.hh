@@ -1,15 +1,22 @@
 #pragma once
 
+#include <chrono>
+#include <list>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
-#include "serial_port.hh"
+#include "transport.hh"
+#include "poll_task.hh"
 #include "protocol.hh"
+#include "mqtt/sensor.hh"
 
 
 class ProtocolAdapter {
  public:
-  static std::unique_ptr<ProtocolAdapter> Get(Protocol, const SerialPort&);
+  static std::unique_ptr<ProtocolAdapter> Get(Protocol, const Transport&);
   virtual ~ProtocolAdapter() = default;
 
   virtual std::string GetSerialNumber() = 0;
@@ -25,20 +32,94 @@ class ProtocolAdapter {
   /// Rating information reflects inverter's nominal parameters. E.g. @a instant grid_voltage shows
   /// the current grid voltage, it can fluctuate, whereas @a rated grid_rating_voltage is the
   /// nominal voltage level that the inverter is designed to operate at.
-  virtual void GetRatedInfo() = 0;
+  /// @note never throws: failures of particular queries are logged and counted by their tasks.
+  void GetRatedInfo() { Run(rated_info_tasks_); }
 
   /// The current state of the inverter (volatile, instant metrics).
-  virtual void GetStatusInfo() = 0;
+  /// @note never throws: failures of particular queries are logged and counted by their tasks.
+  void GetStatusInfo() {
+    PrepareStatusCycle();
+    Run(status_info_tasks_);
+  }
+
+  /// Run the queries that aren't urgent (e.g. backfilling history), in the pause between poll
+  /// cycles, while they are expected to finish before @a deadline.
+  /// @note never throws.
+  virtual void RunBackgroundTasks(std::chrono::steady_clock::time_point /* deadline */) {}
+
+  /// All the tasks the adapter polls the inverter with. Used to report diagnostic counters.
+  std::vector<const PollTask*> GetTasks() const;
+
+  /// The same as GetRatedInfo() + GetStatusInfo(), but step by step, for callers that do the I/O
+  /// themselves (e.g. asynchronously, see Poller::Start()).
+  class Cycle {
+   public:
+    struct Query {
+      std::string_view query;
+      bool with_crc;
+      /// See Transport::Query().
+      std::size_t expected_reply_length;
+    };
+
+    /// @returns the next query to be made, or nothing if the cycle is over.
+    std::optional<Query> Next();
+    /// Handle the reply to the query returned by Next().
+    /// @note never throws: failures are logged and counted by the task.
+    void OnReply(const std::string& reply);
+    /// The query returned by Next() has failed.
+    void OnFailure(std::string_view reason);
+    /// The query returned by Next() has failed with DisconnectedException. The rest of the cycle is
+    /// skipped, the next one probes the link again.
+    void OnDisconnected(std::string_view reason);
+
+   private:
+    friend class ProtocolAdapter;
+    Cycle(ProtocolAdapter&, std::vector<PollTask*>&&);
+
+    ProtocolAdapter& adapter_;
+    const std::vector<PollTask*> tasks_;
+    std::size_t next_ = 0;
+    PollTask* current_ = nullptr;
+  };
+
+  Cycle StartCycle();
 
  protected:
-  ProtocolAdapter(SerialPort&&) = delete;
-  explicit ProtocolAdapter(const SerialPort& port) : port_(port) {}
+  ProtocolAdapter(Transport&&) = delete;
+  explicit ProtocolAdapter(const Transport& transport) : transport_(transport) {}
 
   virtual bool UseCrcInQueries() = 0;
   std::string Query(std::string_view query, std::string_view expected_response_prefix = "");
 
+  /// Register a task that is run within GetRatedInfo().
+  void AddRatedInfoTask(std::string_view query, std::string_view expected_response_prefix,
+                        PollTask::Handler&&);
+  /// Register a task that is run within GetStatusInfo().
+  /// @param is_due - optional, see PollTask::PollTask().
+  void AddStatusInfoTask(std::string_view query, std::string_view expected_response_prefix,
+                         PollTask::Handler&&, PollTask::Condition&& is_due = nullptr);
+
+  /// Is called before the status tasks of every cycle, e.g. to decide which of them are due.
+  virtual void PrepareStatusCycle() {}
+
+  const Transport& transport_;
+  /// Values of the device's sensors, which the adapter and its parts hold handles to.
+  mqtt::SensorValues sensor_values_;
+
+ private:
+  /// Run the tasks one by one. A failure of any task doesn't affect the others, but the loss of the
+  /// link ends the run.
+  void Run(std::list<PollTask>& tasks);
+  /// The @a task's query has failed because the link is lost. The breakers of all the tasks are
+  /// reset: their recent failures are likely caused by the device going away, and they must not keep
+  /// the tasks suspended once it's back.
+  void OnDisconnected(PollTask& task, std::string_view reason);
+  /// Check the reply to the @a task's query and hand it to the task.
+  /// @throws std::exception if the reply is unexpected or the task fails to handle it.
+  void HandleReply(PollTask& task, std::string reply);
 
-  const SerialPort& port_;
+  std::list<PollTask> rated_info_tasks_;
+  std::list<PollTask> status_info_tasks_;
 };
 
-std::unique_ptr<ProtocolAdapter> DetectProtocol(SerialPort&);
+std::unique_ptr<ProtocolAdapter> DetectProtocol(Transport&);
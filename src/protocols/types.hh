@@ -142,6 +142,26 @@ enum class OutputMode : char {
   kPhase3Of3,       //  Phase 3 of 3 Phase output
 };
 
+constexpr std::string ToString(OutputMode mode) {
+  switch (mode) {
+    case OutputMode::kSingle: return "Single";
+    case OutputMode::kParallel: return "Parallel";
+    case OutputMode::kPhase1Of3: return "Phase 1 of 3";
+    case OutputMode::kPhase2Of3: return "Phase 2 of 3";
+    case OutputMode::kPhase3Of3: return "Phase 3 of 3";
+  }
+  throw std::runtime_error(std::format("Unknown OutputMode: {}", (int) mode));
+}
+
+inline void FromString(const std::string& str, OutputMode& result) {
+  if (str == "Single") { result = OutputMode::kSingle; return; }
+  if (str == "Parallel") { result = OutputMode::kParallel; return; }
+  if (str == "Phase 1 of 3") { result = OutputMode::kPhase1Of3; return; }
+  if (str == "Phase 2 of 3") { result = OutputMode::kPhase2Of3; return; }
+  if (str == "Phase 3 of 3") { result = OutputMode::kPhase3Of3; return; }
+  throw std::runtime_error(std::format("Unexpected value for OutputMode: {}", str));
+}
+
 enum class MachineType : char {
   kGridTie,         //  Grid tie
   kOffGrid,         //  Off Grid
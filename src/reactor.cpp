@@ -0,0 +1,127 @@
+#include "reactor.hh"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+}  // namespace
+
+
+Reactor::Timer::Timer(Reactor& reactor, Callback&& on_expired) : reactor_(reactor) {
+  // steady_clock is CLOCK_MONOTONIC on Linux.
+  fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd_ < 0) ThrowSystemError("timerfd_create");
+  reactor_.Watch(fd_, [fd = fd_, on_expired = std::move(on_expired)] {
+    std::uint64_t expirations;
+    // Nothing to read means that the timer has been re-armed meanwhile.
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+    on_expired();
+  });
+}
+
+Reactor::Timer::~Timer() {
+  reactor_.Unwatch(fd_);
+  close(fd_);
+}
+
+void Reactor::Timer::Arm(Clock::time_point time) {
+  const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      time.time_since_epoch()).count();
+  itimerspec spec{};
+  spec.it_value.tv_sec = since_epoch / 1'000'000'000;
+  spec.it_value.tv_nsec = since_epoch % 1'000'000'000;
+  // Zero would disarm the timer.
+  if (spec.it_value.tv_sec <= 0 && spec.it_value.tv_nsec <= 0) spec.it_value.tv_nsec = 1;
+  if (timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    ThrowSystemError("timerfd_settime");
+  }
+}
+
+void Reactor::Timer::Disarm() {
+  const itimerspec spec{};
+  timerfd_settime(fd_, 0, &spec, nullptr);
+}
+
+
+Reactor::Reactor() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) ThrowSystemError("epoll_create1");
+}
+
+Reactor::~Reactor() {
+  if (jobs_thread_.joinable()) {
+    jobs_thread_.request_stop();
+    jobs_thread_.join();
+  }
+  close(epoll_fd_);
+}
+
+void Reactor::Watch(int fd, Callback&& on_readable) {
+  epoll_event event{.events = EPOLLIN, .data = {.fd = fd}};
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) ThrowSystemError("epoll_ctl");
+  callbacks_[fd] = std::make_shared<Callback>(std::move(on_readable));
+}
+
+void Reactor::Unwatch(int fd) {
+  if (callbacks_.erase(fd)) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  }
+}
+
+void Reactor::Run() {
+  constexpr int kMaxEvents = 32;
+  epoll_event events[kMaxEvents];
+  stopped_ = false;
+  while (!stopped_) {
+    const auto count = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      ThrowSystemError("epoll_wait");
+    }
+    for (int i = 0; i < count; ++i) {
+      // An earlier callback of this batch could have unwatched the descriptor.
+      const auto callback = callbacks_.find(events[i].data.fd);
+      if (callback == callbacks_.end()) continue;
+      const auto keep_alive = callback->second;
+      (*keep_alive)();
+    }
+  }
+}
+
+void Reactor::RunBlocking(Callback&& job) {
+  std::lock_guard lock(jobs_mutex_);
+  jobs_.push_back(std::move(job));
+  if (!jobs_thread_.joinable()) {
+    jobs_thread_ = std::jthread([this](std::stop_token stop) { RunJobs(stop); });
+  }
+  jobs_changed_.notify_one();
+}
+
+void Reactor::RunJobs(std::stop_token stop) {
+  while (true) {
+    Callback job;
+    {
+      std::unique_lock lock(jobs_mutex_);
+      if (!jobs_changed_.wait(lock, stop, [this] { return !jobs_.empty(); })) return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    try {
+      job();
+    } catch (const std::exception& e) {
+      spdlog::error("Background job failed: {}", e.what());
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/// A single-threaded event loop on epoll: calls back when file descriptors become readable or
+/// timers (timerfd) expire. It lets a single thread drive many serial links at once, see
+/// Poller::Start().
+/// Except for RunBlocking(), this class is NOT thread-safe: everything, callbacks included, happens
+/// in the thread that calls Run().
+class Reactor {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+
+  /// A one-shot timer. Its callback is called by the reactor once the time comes.
+  class Timer {
+   public:
+    Timer(Reactor&, Callback&& on_expired);
+    ~Timer();
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    /// (Re)start the timer. A time in the past makes it expire right away.
+    void Arm(Clock::time_point);
+    void Disarm();
+
+   private:
+    Reactor& reactor_;
+    int fd_;
+  };
+
+  /// @throws std::system_error if epoll isn't available.
+  Reactor();
+  ~Reactor();
+
+  Reactor(const Reactor&) = delete;
+  Reactor& operator=(const Reactor&) = delete;
+
+  /// Call @a on_readable whenever @a fd has data to read, until Unwatch(). It's level-triggered:
+  /// the callback is called again and again until everything is read.
+  void Watch(int fd, Callback&& on_readable);
+  /// It's fine to unwatch (and even close) the descriptor from within its own callback.
+  void Unwatch(int fd);
+
+  /// Dispatch events until Stop() is called.
+  void Run();
+  /// Make Run() return after the events at hand are dispatched.
+  void Stop() { stopped_ = true; }
+
+  /// Run @a job on the reactor's helper thread, one job at a time. It's for the rare work that can
+  /// only be done with blocking calls (e.g. background queries of the inverters), so that it doesn't
+  /// stall the loop. This function is thread-safe.
+  void RunBlocking(Callback&& job);
+
+ private:
+  void RunJobs(std::stop_token);
+
+  int epoll_fd_;
+  bool stopped_ = false;
+  /// Shared, so that a callback survives its own Unwatch().
+  std::unordered_map<int, std::shared_ptr<Callback>> callbacks_;
+
+  std::mutex jobs_mutex_;
+  std::condition_variable_any jobs_changed_;
+  std::deque<Callback> jobs_;
+  /// Started with the first job.
+  std::jthread jobs_thread_;
+};
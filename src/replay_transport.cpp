@@ -0,0 +1,121 @@
+#include "replay_transport.hh"
+
+#include <format>
+#include <thread>
+
+#include "exceptions.h"
+#include "frame.hh"
+#include "frame_trace.hh"
+#include "utils.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Extracts the reply the same way SerialPort::Receive() does it.
+/// @throws CrcMismatchException, CorruptedFrameException, TimeoutException.
+std::string GetReply(const capture::Record& record, frame::Checksum checksum) {
+  if (record.type == capture::RecordType::kTimeout) {
+    throw TimeoutException("Read timeout (replayed)");
+  }
+  const std::string_view data = record.data;
+  const auto frame_end = data.find('\r');
+  if (frame_end == std::string_view::npos) {
+    throw CorruptedFrameException(std::format("No carriage return in {} received bytes",
+                                              data.length()));
+  }
+  const auto received = data.substr(0, frame_end + 1);
+  const auto frame_start = frame::FindFrameStart(received, checksum);
+  return std::string(received.substr(
+      frame_start, received.length() - frame_start - frame::GetLength(checksum) - 1));
+}
+
+}  // namespace
+
+
+ReplayTransport::ReplayTransport(const std::string& capture_file, Speed speed)
+    : speed_(speed), reader_(capture_file) {}
+
+bool ReplayTransport::IsFinished() const {
+  std::lock_guard lock(mutex_);
+  return Peek() == nullptr;
+}
+
+const capture::Record* ReplayTransport::Peek() const {
+  if (!next_record_) {
+    next_record_ = reader_.Next();
+  }
+  return next_record_ ? &*next_record_ : nullptr;
+}
+
+capture::Record ReplayTransport::Take() const {
+  if (!Peek()) {
+    throw ReplayException("The capture is over");
+  }
+  auto record = std::move(*next_record_);
+  next_record_.reset();
+
+  if (speed_ == Speed::kRecorded) {
+    if (!start_time_) {
+      start_time_ = Clock::now() - record.time;
+    }
+    std::this_thread::sleep_until(*start_time_ + record.time);
+  }
+  return record;
+}
+
+std::string ReplayTransport::Query(std::string_view query, bool with_crc,
+                                   std::size_t /* expected_reply_length */) const {
+  std::lock_guard lock(mutex_);
+  std::string sent(query);
+  if (with_crc) {
+    sent += frame::GetCRC(sent);
+  }
+  sent += '\r';
+
+  const auto command = GetCommandName(query);
+  const auto start_time = Clock::now();
+  QueryMetrics metrics{.queries = 1};
+  while (true) {
+    const auto request = Take();
+    if (request.type != capture::RecordType::kSent || request.data != sent) {
+      throw ReplayException(std::format("Query '{}' doesn't match the captured '{}'",
+                                        utils::EscapeString(sent),
+                                        utils::EscapeString(request.data)));
+    }
+    GetFrameTrace().Record(FrameTrace::Direction::kSent, sent);
+    ++metrics.attempts;
+
+    const auto reply = Take();
+    GetFrameTrace().Record(FrameTrace::Direction::kReceived, reply.data);
+    // If the same query follows, then the attempt failed during the capture, and was retried.
+    const auto is_retried = [&] {
+      const auto* next = Peek();
+      return next && next->type == capture::RecordType::kSent && next->data == sent;
+    };
+    try {
+      auto result = GetReply(reply, GetReplyChecksum());
+      const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - start_time);
+      metrics.total_latency = metrics.max_latency = latency;
+      metrics.reply_length = result.length() + frame::GetLength(GetReplyChecksum()) + 1;
+      UpdateMetrics(command, metrics);
+      return result;
+    } catch (const TimeoutException&) {
+      ++metrics.timeouts;
+      if (!is_retried()) {
+        ++metrics.failures;
+        UpdateMetrics(command, metrics);
+        throw;
+      }
+    } catch (const std::exception&) {
+      // CrcMismatchException or CorruptedFrameException.
+      ++metrics.crc_errors;
+      if (!is_retried()) {
+        ++metrics.failures;
+        UpdateMetrics(command, metrics);
+        throw;
+      }
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+#include "capture.hh"
+#include "transport.hh"
+
+/// Feeds a session recorded with SerialPort::StartCapture() back to the protocol adapters.
+/// Queries must come in the same order as they were captured. The received frames are checked the
+/// same way SerialPort does it, and failed attempts are retried exactly as many times as they were
+/// during the capture.
+class ReplayTransport : public Transport {
+ public:
+  enum class Speed {
+    /// Keep the original timing of the frames.
+    kRecorded,
+    /// Don't wait at all.
+    kFastest,
+  };
+
+  ReplayTransport(const std::string& capture_file, Speed);
+
+  /// @throws ReplayException if @a query doesn't match the capture or the capture is over.
+  std::string Query(std::string_view query, bool with_crc,
+                    std::size_t expected_reply_length = 0) const override;
+
+  bool IsFinished() const;
+
+ private:
+  /// @returns the next record without consuming it, or nullptr if the capture is over.
+  const capture::Record* Peek() const;
+  /// Consume the next record, waiting for its time at the recorded speed.
+  /// @throws ReplayException if the capture is over.
+  capture::Record Take() const;
+
+  const Speed speed_;
+  mutable std::mutex mutex_;
+  mutable capture::Reader reader_;
+  mutable std::optional<capture::Record> next_record_;
+  /// When the replay has started. The time of each record is counted from it.
+  mutable std::optional<std::chrono::steady_clock::time_point> start_time_;
+};
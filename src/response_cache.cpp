@@ -0,0 +1,99 @@
+#include "response_cache.hh"
+
+
+bool ResponseCache::IsReadOnly(std::string_view query) {
+  return query.starts_with('Q') || query.starts_with("^P");
+}
+
+std::string ResponseCache::Get(std::string_view query, const QueryFunction& make_query) {
+  if (!IsReadOnly(query)) return make_query();
+
+  std::unique_lock lock(mutex_);
+  while (true) {
+    if (const auto entry = replies_.find(query);
+        entry != replies_.end() && Clock::now() - entry->second.time < ttl_) {
+      return entry->second.reply;
+    }
+    const auto in_flight = in_flight_.find(query);
+    if (in_flight == in_flight_.end()) break;
+
+    const auto future = in_flight->second->future;
+    lock.unlock();
+    if (auto reply = future.get()) return *std::move(reply);
+    lock.lock();
+  }
+  const auto in_flight = std::make_shared<InFlight>();
+  in_flight_.emplace(query, in_flight);
+  const auto generation = generation_;
+  lock.unlock();
+
+  try {
+    auto reply = make_query();
+    lock.lock();
+    Store(query, reply, generation);
+    Finish(query, in_flight.get(), reply);
+    return reply;
+  } catch (...) {
+    lock.lock();
+    Finish(query, in_flight.get(), std::nullopt, std::current_exception());
+    throw;
+  }
+}
+
+void ResponseCache::OnQueryStarted(std::string_view query) {
+  std::lock_guard lock(mutex_);
+  transport_query_generation_ = generation_;
+  // If the query is registered already, it's either a consumer's one that is being sent now, or
+  // it waits for the transport and its callers get the reply of this one meanwhile.
+  if (IsReadOnly(query) && !in_flight_.contains(query)) {
+    auto in_flight = std::make_shared<InFlight>();
+    in_flight->by_transport = true;
+    in_flight_.emplace(query, std::move(in_flight));
+  }
+}
+
+void ResponseCache::OnQueryFinished(std::string_view query, const std::string* reply) {
+  std::lock_guard lock(mutex_);
+  if (!IsReadOnly(query)) {
+    // Even a failed command may have been executed.
+    replies_.clear();
+    ++generation_;
+    return;
+  }
+  if (reply) {
+    Store(query, *reply, transport_query_generation_);
+  }
+  const auto in_flight = in_flight_.find(query);
+  if (in_flight == in_flight_.end()) return;
+  if (reply) {
+    Finish(query, in_flight->second.get(), *reply);
+  } else if (in_flight->second->by_transport) {
+    // Nobody to pass the exception on, so the consumers retry the query themselves.
+    Finish(query, in_flight->second.get(), std::nullopt);
+  }
+}
+
+void ResponseCache::Store(std::string_view query, const std::string& reply,
+                          std::uint64_t generation) {
+  // The state of the inverter may have changed since the query has been sent.
+  if (generation != generation_) return;
+  // The inverter may be busy or the command unsupported, so let the next client retry it.
+  if (reply == "(NAK" || reply == "^0") return;
+  auto entry = replies_.find(query);
+  if (entry == replies_.end()) {
+    entry = replies_.emplace(query, Entry{}).first;
+  }
+  entry->second = {.reply = reply, .time = Clock::now()};
+}
+
+void ResponseCache::Finish(std::string_view query, const InFlight* in_flight,
+                           std::optional<std::string> reply, std::exception_ptr error) {
+  const auto found = in_flight_.find(query);
+  if (found == in_flight_.end() || found->second.get() != in_flight) return;
+  if (error) {
+    found->second->promise.set_exception(error);
+  } else {
+    found->second->promise.set_value(std::move(reply));
+  }
+  in_flight_.erase(found);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "transport.hh"
+
+/// Replies of an inverter shared by several consumers (see ControlServer), so that they don't add
+/// serial load: a read-only query (e.g. QPIGS) is answered with a reply that is younger than the
+/// TTL, either to the poll cycle's own query or to another consumer's one. Identical queries that
+/// arrive while one is in flight (the poll cycle's one too, since the cache observes the transport)
+/// wait for its reply instead of being sent again.
+/// This class is thread-safe.
+class ResponseCache : public QueryObserver {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using QueryFunction = std::function<std::string()>;
+
+  /// @param ttl - how long a reply is served from the cache. 0 disables caching, though identical
+  ///        queries in flight are still merged.
+  explicit ResponseCache(Clock::duration ttl) : ttl_(ttl) {}
+
+  /// @returns the reply to @a query: the cached one, the one of the same query in flight, or made
+  ///          with @a make_query. The latter is always the case for queries that aren't read-only.
+  /// @throws what @a make_query throws, also to the callers waiting for the same query.
+  std::string Get(std::string_view query, const QueryFunction& make_query);
+
+  /// Registers the queries of the transport (e.g. the poll cycle's ones) as the ones in flight.
+  void OnQueryStarted(std::string_view query) override;
+  /// Remembers the reply and passes it to the callers waiting for it. Any query that isn't
+  /// read-only (e.g. a set-command) may change the inverter's state, so it drops all the cached
+  /// replies, as well as the replies to the queries that are in flight meanwhile.
+  void OnQueryFinished(std::string_view query, const std::string* reply) override;
+
+  /// @returns whether @a query only reads the inverter's state: PI30 "Q..." and PI18 "^P..." ones.
+  static bool IsReadOnly(std::string_view query);
+
+ private:
+  struct Entry {
+    std::string reply;
+    Clock::time_point time;
+  };
+  /// A query in flight. If it's the transport's own query and it fails, its waiters get nothing and
+  /// make the query themselves.
+  struct InFlight {
+    /// Whether it's registered by OnQueryStarted() rather than by Get().
+    bool by_transport = false;
+    std::promise<std::optional<std::string>> promise;
+    std::shared_future<std::optional<std::string>> future = promise.get_future().share();
+  };
+
+  /// Requires mutex_ to be locked.
+  /// @param generation - generation_ when the query has been sent.
+  void Store(std::string_view query, const std::string& reply, std::uint64_t generation);
+  /// Pass the reply (or the error) to the waiters of @a query, if it's still @a in_flight, i.e. it
+  /// hasn't been finished by the transport already. Requires mutex_ to be locked.
+  void Finish(std::string_view query, const InFlight* in_flight, std::optional<std::string> reply,
+              std::exception_ptr error = nullptr);
+
+  const Clock::duration ttl_;
+  std::mutex mutex_;
+  std::map<std::string, Entry, std::less<>> replies_;
+  std::map<std::string, std::shared_ptr<InFlight>, std::less<>> in_flight_;
+  /// Is incremented by each command that may change the inverter's state. Replies to the queries
+  /// sent before that are stale, so they aren't cached.
+  std::uint64_t generation_ = 0;
+  /// generation_ when the query of the transport in progress has started. The transport makes one
+  /// query at a time.
+  std::uint64_t transport_query_generation_ = 0;
+};
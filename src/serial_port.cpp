@@ -1,26 +1,56 @@
 #include "serial_port.hh"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
-#include <mutex>
+#include <filesystem>
+#include <optional>
+#include <poll.h>
+#include <random>
 #include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
 #include <termios.h>
+#include <thread>
 #include <unistd.h>
 
-#include "CRC.h"
 #include "exceptions.h"
-#include "utils.h"
+#include "frame.hh"
+#include "frame_trace.hh"
+#include "trace.hh"
 
 #include "spdlog/spdlog.h"
 
 
 namespace {
 
-time_t CurrentTimeInSeconds() {
-  return time(nullptr);
-}
+using Clock = std::chrono::steady_clock;
+
+/// Unknown reply length is treated as that long.
+constexpr std::size_t kDefaultReplyLength = 128;
+
+/// Time the inverter needs to start replying.
+constexpr auto kReplyLatency = std::chrono::milliseconds(1000);
+
+/// At 2400 baud 8N1 each byte takes 10 bits, i.e. ~4.2 ms.
+constexpr auto kByteTransferTime = std::chrono::microseconds(10 * 1000000 / 2400);
+
+/// Queries are sent by 8-byte chunks with pauses between them. It has to do with low speed USB
+/// specifications.
+constexpr std::size_t kChunkSize = 8;
+constexpr auto kChunkPause = std::chrono::milliseconds(50);
+
+/// See DrainLine().
+constexpr auto kDrainQuietTime = std::chrono::milliseconds(50);
+constexpr auto kMaxDrainTime = std::chrono::milliseconds(500);
+
+/// Pauses between attempts to reopen the device once it's gone, unless it reappears earlier.
+constexpr auto kInitialReconnectBackoff = std::chrono::seconds(1);
+constexpr auto kMaxReconnectBackoff = std::chrono::seconds(60);
+
+/// How often an asynchronous query checks whether a blocking one (made by another thread) is over.
+constexpr auto kLockRetryInterval = std::chrono::milliseconds(50);
 
 int AvailableBytes(int device) {
   int bytes;
@@ -28,42 +58,75 @@ int AvailableBytes(int device) {
   return bytes;
 }
 
-bool CheckCRC(std::string_view data) {
-  const uint16_t actual_crc = CRC::Calculate(data.data(), data.length() - 3, CRC::CRC_16_XMODEM());
-  char crc[2] = {static_cast<char>(actual_crc >> 8), static_cast<char>(actual_crc & 0xff)};
-  const bool matches = data[data.length() - 3] == crc[0] && data[data.length() - 2] == crc[1];
-  if (!matches) {
-    spdlog::warn("CRC mismatch. Actual: {:02x} {:02x}. Expected: {:02x} {:02x}.", crc[0],
-                 crc[1],
-                 data[data.length() - 3], data[data.length() - 2]);
+/// Reads (and thus discards) everything that is available at the moment.
+/// @returns the number of discarded bytes.
+std::size_t DiscardAvailableBytes(int device) {
+  char buffer[256];
+  std::size_t discarded = 0;
+  while (AvailableBytes(device) > 0) {
+    const auto n_bytes = read(device, buffer, std::size(buffer));
+    if (n_bytes <= 0) break;
+    discarded += n_bytes;
   }
-  return matches;
+  return discarded;
 }
 
-std::string GetCRC(std::string_view query) {
-  const uint16_t crc = CRC::Calculate(query.data(), query.length(), CRC::CRC_16_XMODEM());
-  return {static_cast<char>(crc >> 8), static_cast<char>(crc & 0xff)};
+/// @returns true if read() or write() has failed with @a error because the device is gone, e.g. the
+///          USB adapter is unplugged or the other end of the PTY is closed.
+bool IsLinkLost(int error) {
+  return error == EIO || error == ENODEV || error == ENXIO;
 }
 
-}  // namespace
-
+/// @returns true if the device has hung up, read() returns 0 then.
+bool IsHungUp(int device) {
+  pollfd fds{.fd = device, .events = POLLIN};
+  return poll(&fds, 1, 0) > 0 && (fds.revents & (POLLHUP | POLLERR | POLLNVAL));
+}
 
-SerialPort::SerialPort(std::string_view device) {
-  file_descriptor_ = open(device.data(), O_RDWR | O_NONBLOCK);
-  if (file_descriptor_ == -1) {
-    throw std::runtime_error(fmt::format("Unable to open device {}: {}.", device, strerror(errno)));
+/// Drains the bytes still arriving after the port is opened and flushed, e.g. the tail of a reply to
+/// a query of the previous process, until the line is quiet for kDrainQuietTime, but no longer than
+/// kMaxDrainTime, so that a noisy line doesn't stall the start.
+/// @returns the number of discarded bytes.
+std::size_t DrainLine(int device) {
+  const auto deadline = Clock::now() + kMaxDrainTime;
+  char buffer[256];
+  std::size_t discarded = 0;
+  while (true) {
+    const auto remaining =
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+    if (remaining.count() <= 0) break;
+    pollfd fds{.fd = device, .events = POLLIN};
+    if (poll(&fds, 1, std::min(remaining, kDrainQuietTime).count()) <= 0) break;
+    const auto n_bytes = read(device, buffer, std::size(buffer));
+    if (n_bytes <= 0) break;
+    discarded += n_bytes;
   }
+  return discarded;
+}
 
+/// @returns the pause before the retry number @a retry (starting from 0).
+Clock::duration GetBackoff(const RetryPolicy& policy, int retry) {
+  thread_local std::mt19937 random_generator{std::random_device{}()};
+  std::uniform_real_distribution<double> jitter(0.5, 1.0);
+
+  const auto backoff = std::min(policy.initial_backoff * (1 << std::min(retry, 16)),
+                                policy.max_backoff);
+  return std::chrono::duration_cast<Clock::duration>(backoff * jitter(random_generator));
+}
+
+/// Locks the serial port @a fd, sets it up and clears what is buffered.
+/// @throws std::runtime_error on failure.
+void Configure(int fd) {
   // Acquire exclusive lock (non-blocking - flock won't block if someone already locks the port).
-  if (flock(file_descriptor_, LOCK_EX | LOCK_NB) == -1) {
+  if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
     throw std::runtime_error("Serial port with file descriptor " +
-                             std::to_string(file_descriptor_) +
+                             std::to_string(fd) +
                              " is already locked by another process.");
   }
 
   // Set the baud rate and other serial config. Settings are: 2400 8N1.
   struct termios settings;
-  if (tcgetattr(file_descriptor_, &settings)) {
+  if (tcgetattr(fd, &settings)) {
     printf("Error %i from tcgetattr: %s\n", errno, strerror(errno));
     throw std::runtime_error("");
   }
@@ -90,60 +153,212 @@ SerialPort::SerialPort(std::string_view device) {
   settings.c_oflag &= ~ONLCR;        // Prevent conversion of newline to carriage return/line feed
 
   // apply the settings
-  if (tcsetattr(file_descriptor_, TCSANOW, &settings)) {
+  if (tcsetattr(fd, TCSANOW, &settings)) {
     throw std::runtime_error(fmt::format("Error {} from tcsetattr: {}", errno, strerror(errno)));
   }
-  tcflush(file_descriptor_, TCOFLUSH);
-  // Read all available data to "clear" possible garbage leftover.
+  // Clear possible garbage leftover. What is still arriving is drained by the caller.
+  tcflush(fd, TCIOFLUSH);
+}
+
+void LogDrained(std::size_t discarded, std::string_view device) {
+  if (discarded > 0) {
+    spdlog::info("Discarded {} bytes left on {}.", discarded, device);
+  }
+}
+
+}  // namespace
+
+
+/// State of the query made by QueryAsync().
+struct SerialPort::AsyncQuery {
+  enum class State {
+    kLocking,    // A blocking query is in progress, waiting for it to finish.
+    kSending,    // Waiting to send the next chunk of the frame.
+    kReceiving,  // The frame is sent, waiting for the reply (or the timeout).
+    kBackoff,    // Waiting to retry.
+    kDraining,   // The device is reopened, discarding what still arrives before sending.
+  };
+
+  AsyncQuery(Reactor& reactor, SerialPort& port)
+      : reactor(reactor), timer(reactor, [&port] { port.OnAsyncTimer(); }) {}
+
+  Reactor& reactor;
+  /// Fires when the current state is over.
+  Reactor::Timer timer;
+  State state = State::kLocking;
+  std::unique_lock<std::mutex> lock;
+  /// Is set once the lock is taken.
+  std::optional<ObservedQuery> observed;
+
+  std::string query;
+  bool with_crc;
+  std::string command;
+  std::chrono::milliseconds timeout;
+  QueryCallback callback;
+
+  Clock::time_point start_time;
+  QueryMetrics metrics{.queries = 1};
+  int crc_retries;
+  int timeout_retries;
+
+  /// The frame being sent and how much of it is sent already.
+  std::string frame;
+  std::size_t bytes_sent = 0;
+  char buffer[1024];
+  std::size_t bytes_read = 0;
+
+  /// See DrainLine().
+  Clock::time_point drain_deadline;
+  std::size_t bytes_drained = 0;
+};
+
+SerialPort::SerialPort(std::string_view device, const RetryPolicy& retry_policy)
+    : device_(device), file_descriptor_(Open(device_)), retry_policy_(retry_policy) {
+  // A USB adapter that re-enumerates, or a PTY of socat that is recreated, reappears in the same
+  // directory. Without the watch the port is reopened on the reconnect backoff only.
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  const auto directory = std::filesystem::path(device_).parent_path();
+  if (inotify_fd_ >= 0 &&
+      inotify_add_watch(inotify_fd_, directory.empty() ? "." : directory.c_str(),
+                        IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+  }
+}
+
+int SerialPort::Open(const std::string& device, bool drain) {
+  const int fd = open(device.c_str(), O_RDWR | O_NONBLOCK);
+  if (fd == -1) {
+    throw std::runtime_error(fmt::format("Unable to open device {}: {}.", device, strerror(errno)));
+  }
   try {
-    while (true) { Receive(1); }
-  } catch (const TimeoutException& /* ignored */) {
-  } catch (const CrcMismatchException& /* ignored */) {}
+    Configure(fd);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  if (drain) {
+    LogDrained(DrainLine(fd), device);
+  }
+  return fd;
+}
+
+void SerialPort::StartCapture(const std::string& filename) {
+  std::lock_guard lock(query_mutex_);
+  capture_ = std::make_unique<capture::Writer>(filename);
 }
 
 SerialPort::~SerialPort() {
+  if (async_query_) {
+    async_query_->reactor.Unwatch(file_descriptor_);
+  }
+  if (file_descriptor_ >= 0) {
+    close(file_descriptor_);
+  }
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+  }
+}
+
+DisconnectedException SerialPort::Disconnect(std::string_view reason) const {
+  spdlog::warn("Lost connection to {}: {}. Reconnecting...", device_, reason);
   close(file_descriptor_);
+  file_descriptor_ = -1;
+  reconnect_attempts_ = 0;
+  next_reconnect_time_ = Clock::now() + kInitialReconnectBackoff;
+  return DisconnectedException(fmt::format("{} is disconnected", device_));
 }
 
-void SerialPort::Send(std::string_view query, bool with_crc) const {
+bool SerialPort::DeviceAppeared() const {
+  if (inotify_fd_ < 0) return false;
+  const auto name = std::filesystem::path(device_).filename().string();
+  alignas(inotify_event) char buffer[4096];
+  bool appeared = false;
+  ssize_t n_bytes;
+  while ((n_bytes = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+    for (char* position = buffer; position < buffer + n_bytes;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(position);
+      appeared = appeared || (event->len > 0 && name == event->name);
+      position += sizeof(inotify_event) + event->len;
+    }
+  }
+  return appeared;
+}
+
+void SerialPort::EnsureConnected(bool drain) const {
+  if (file_descriptor_ >= 0) return;
+  // The events are consumed even if it's too early, so that old ones don't trigger a reconnect.
+  if (!DeviceAppeared() && Clock::now() < next_reconnect_time_) {
+    throw DisconnectedException(fmt::format("{} is disconnected", device_));
+  }
+  try {
+    file_descriptor_ = Open(device_, drain);
+  } catch (const std::exception& e) {
+    const auto backoff = std::min(
+        kInitialReconnectBackoff * (1 << std::min(reconnect_attempts_, 16)), kMaxReconnectBackoff);
+    ++reconnect_attempts_;
+    next_reconnect_time_ = Clock::now() + backoff;
+    throw DisconnectedException(fmt::format("{} is disconnected: {}", device_, e.what()));
+  }
+  spdlog::info("Reconnected to {} after {} attempt(s).", device_, reconnect_attempts_ + 1);
+}
+
+std::string SerialPort::MakeFrame(std::string_view query, bool with_crc) const {
   std::string data(query);
   if (with_crc) {
-    data += GetCRC(data);
+    data += frame::GetCRC(data);
   }
   data += '\r';  // Each query must end with carriage return (<cr>).
-  spdlog::debug("Send: '{}', hex: {}.", utils::EscapeString(data), utils::PrintBytesAsHex(data));
+  spdlog::debug("Send: '{}', hex: {}.", EscapedBytes{data}, HexBytes{data});
+  GetFrameTrace().Record(FrameTrace::Direction::kSent, data);
+  if (capture_) {
+    capture_->Write(capture::RecordType::kSent, data);
+  }
+  return data;
+}
+
+void SerialPort::Send(std::string_view query, bool with_crc) const {
+  TRACE_SPAN("SerialPort::Send", query);
+  const auto data = MakeFrame(query, with_crc);
 
-  // The code below sends data by 8-bytes chunks. It has to do with low speed USB specifications.
   int bytes_sent = 0;
   int remaining = data.length();
 
   while (remaining > 0) {
-    const auto bytes_to_send = (remaining > 8) ? 8 : remaining;
+    const auto bytes_to_send = std::min<int>(remaining, kChunkSize);
     const auto written = write(file_descriptor_, data.data() + bytes_sent, bytes_to_send);
     if (written < 0) {
+      if (IsLinkLost(errno)) throw Disconnect(strerror(errno));
       throw std::runtime_error(fmt::format("Failed to write. {}", strerror(errno)));
     }
 
     bytes_sent += written;
     remaining -= written;
-    usleep(50000);   // Sleep 50ms before sending another 8 bytes of info
+    std::this_thread::sleep_for(kChunkPause);
   }
 }
 
-std::string SerialPort::Receive(int timeout_in_seconds) const {
+std::string SerialPort::Receive(std::chrono::milliseconds timeout) const {
+  TRACE_SPAN("SerialPort::Receive");
   // We can't read or wait for response data infinitely. Use a timeout.
   // TODO use VMIN = 0, VTIME > 0 in port settings.
-  const time_t deadline_time = CurrentTimeInSeconds() + timeout_in_seconds;
+  const auto deadline_time = Clock::now() + timeout;
 
   char buffer[1024];
-  int bytes_read = 0;
+  std::size_t bytes_read = 0;
+  std::size_t frame_end;
 
   // Each response from inverter ends with <cr> (carriage return). So we read data until we find it.
   while (true) {
     usleep(50000);  // sleep 50ms TODO: make it configurable
     const auto n_bytes = read(file_descriptor_, buffer + bytes_read, std::size(buffer) - bytes_read);
-    if (n_bytes < 0) {
-      if (CurrentTimeInSeconds() > deadline_time) {
+    if (n_bytes < 0 && IsLinkLost(errno)) throw Disconnect(strerror(errno));
+    if (n_bytes == 0 && IsHungUp(file_descriptor_)) throw Disconnect("hung up");
+    if (n_bytes <= 0) {
+      if (Clock::now() > deadline_time) {
+        if (capture_) {
+          capture_->Write(capture::RecordType::kTimeout, {buffer, bytes_read});
+        }
         throw TimeoutException("Read timeout");
       }
       continue;
@@ -151,47 +366,363 @@ std::string SerialPort::Receive(int timeout_in_seconds) const {
     }
 
     const std::string_view data{&buffer[bytes_read], static_cast<std::size_t>(n_bytes)};
-    spdlog::debug("Read {} bytes: '{}', hex: {}.",
-                  n_bytes, utils::EscapeString(data), utils::PrintBytesAsHex(data));
+    spdlog::debug("Read {} bytes: '{}', hex: {}.", n_bytes, EscapedBytes{data}, HexBytes{data});
     bytes_read += n_bytes;
-    // Replies end with a carriage return (<cr>)
-    if (data.back() == '\r') {
+    // Replies end with a carriage return (<cr>). Though it isn't necessarily the last received byte.
+    if (const auto position = data.find('\r'); position != std::string_view::npos) {
+      frame_end = data.data() - buffer + position + 1;
       break;
     }
+    if (bytes_read == std::size(buffer)) {
+      ThrowOverflow({buffer, bytes_read});
+    }
   }
 
-  const auto available_bytes = AvailableBytes(file_descriptor_);
-  if (available_bytes) {
-    throw std::runtime_error(
-        fmt::format("{} bytes still available after carriage return.", available_bytes));
+  return ExtractReply({buffer, bytes_read}, frame_end);
+}
+
+void SerialPort::ThrowOverflow(std::string_view received) const {
+  RegisterCorruption(frame::Corruption::kOverflow);
+  DiscardAvailableBytes(file_descriptor_);
+  GetFrameTrace().Record(FrameTrace::Direction::kReceived, received);
+  if (capture_) {
+    capture_->Write(capture::RecordType::kReceived, received);
+  }
+  GetFrameTrace().Dump("No carriage return in the reply");
+  throw CorruptedFrameException(
+      fmt::format("No carriage return in {} received bytes", received.length()));
+}
+
+std::string SerialPort::ExtractReply(std::string_view received, std::size_t frame_end) const {
+  // Everything that follows the carriage return doesn't belong to the current reply.
+  const auto trailing_bytes = received.length() - frame_end +
+                              DiscardAvailableBytes(file_descriptor_);
+  if (trailing_bytes) {
+    RegisterCorruption(frame::Corruption::kTrailingGarbage);
+    spdlog::warn("Discarded {} bytes after carriage return.", trailing_bytes);
+  }
+
+  GetFrameTrace().Record(FrameTrace::Direction::kReceived, received);
+  if (capture_) {
+    capture_->Write(capture::RecordType::kReceived, received);
+  }
+
+  const auto frame = received.substr(0, frame_end);
+  std::size_t frame_start;
+  try {
+    frame_start = frame::FindFrameStart(frame, GetReplyChecksum());
+  } catch (const CorruptedFrameException&) {
+    RegisterCorruption(frame::Corruption::kNoFrameStart);
+    GetFrameTrace().Dump("No frame start in the reply");
+    throw;
+  } catch (const CrcMismatchException&) {
+    RegisterCorruption(frame::Corruption::kCrcMismatch);
+    GetFrameTrace().Dump("CRC mismatch in the reply");
+    throw;
   }
 
-  std::string response(buffer, bytes_read);
-  if (!CheckCRC(response)) {
-    throw CrcMismatchException();
+  if (frame_start) {
+    RegisterCorruption(frame::Corruption::kLeadingGarbage);
+    spdlog::warn("Discarded {} bytes before the frame start.", frame_start);
   }
 
-  // Cut crc and carriage return bytes.
-  response.resize(response.length() - 3);
-  return response;
+  // Cut garbage, checksum and carriage return bytes.
+  return std::string(frame.substr(
+      frame_start, frame_end - frame_start - frame::GetLength(GetReplyChecksum()) - 1));
+}
+
+unsigned SerialPort::GetCorruptionsCount(frame::Corruption corruption) const {
+  return corruptions_[static_cast<std::size_t>(corruption)];
 }
 
-std::string SerialPort::Query(std::string_view query, bool with_crc, int n_retries) const {
-  static std::mutex mutex_;
-  std::lock_guard lock(mutex_);
+void SerialPort::RegisterCorruption(frame::Corruption corruption) const {
+  ++corruptions_[static_cast<std::size_t>(corruption)];
+}
+
+std::chrono::milliseconds SerialPort::GetReplyTimeout(std::string_view command,
+                                                      std::size_t expected_reply_length) const {
+  if (expected_reply_length == 0) {
+    expected_reply_length = GetLastReplyLength(command);
+  }
+  if (expected_reply_length == 0) {
+    expected_reply_length = kDefaultReplyLength;
+  }
+  // Give twice as much time as required to transfer the reply, since serial-to-network bridges
+  // and USB adapters may deliver data in bursts.
+  const auto transfer_time = 2 * kByteTransferTime * expected_reply_length;
+  return kReplyLatency + std::chrono::duration_cast<std::chrono::milliseconds>(transfer_time);
+}
+
+std::string SerialPort::Query(std::string_view query, bool with_crc,
+                              std::size_t expected_reply_length) const {
+  TRACE_SPAN("SerialPort::Query", query);
+  std::lock_guard lock(query_mutex_);
+  ObservedQuery observed(*this, query);
+  const auto command = GetCommandName(query);
+  const auto timeout = GetReplyTimeout(command, expected_reply_length);
+  const auto start_time = Clock::now();
+
+  QueryMetrics metrics{.queries = 1};
+  int crc_retries = retry_policy_.crc_retries;
+  int timeout_retries = retry_policy_.timeout_retries;
   while (true) {
+    ++metrics.attempts;
     try {
+      TRACE_SPAN("SerialPort::Attempt", query);
+      EnsureConnected();
       Send(query, with_crc);
-      return Receive();
+      auto reply = Receive(timeout);
+
+      const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - start_time);
+      metrics.total_latency = metrics.max_latency = latency;
+      metrics.reply_length = reply.length() + frame::GetLength(GetReplyChecksum()) + 1;
+      UpdateMetrics(command, metrics);
+      spdlog::debug("Query {}: {} attempt(s), {} ms.", query, metrics.attempts,
+                    latency.count() / 1000);
+      observed.Succeed(reply);
+      return reply;
     } catch (const CrcMismatchException&) {
-      if (--n_retries <= 0) throw;
-      usleep(500000);
+      ++metrics.crc_errors;
+      if (--crc_retries < 0) {
+        ++metrics.failures;
+        UpdateMetrics(command, metrics);
+        throw;
+      }
+    } catch (const CorruptedFrameException&) {
+      ++metrics.crc_errors;
+      if (--crc_retries < 0) {
+        ++metrics.failures;
+        UpdateMetrics(command, metrics);
+        throw;
+      }
+    } catch (const DisconnectedException&) {
+      // Retrying makes no sense until the device is back, the next query will try to reconnect.
+      ++metrics.failures;
+      UpdateMetrics(command, metrics);
+      throw;
     } catch (const TimeoutException&) {
       // Sometimes the ending carriage return byte is corrupted, so Receive() doesn't meet it and
       // awaits more data (essentially that's a situation when CrcMismatchException should be thrown
       // instead).
-      if (--n_retries <= 0) throw;
-      usleep(500000);
+      ++metrics.timeouts;
+      if (--timeout_retries < 0) {
+        ++metrics.failures;
+        UpdateMetrics(command, metrics);
+        throw;
+      }
     }
+    TRACE_SPAN("SerialPort::Backoff", query);
+    std::this_thread::sleep_for(GetBackoff(retry_policy_, metrics.attempts - 1));
+  }
+}
+
+void SerialPort::QueryAsync(Reactor& reactor, std::string_view query, bool with_crc,
+                            std::size_t expected_reply_length, QueryCallback&& callback) {
+  if (async_query_) {
+    throw std::logic_error("Another asynchronous query is in progress");
+  }
+  async_query_ = std::make_unique<AsyncQuery>(reactor, *this);
+  auto& state = *async_query_;
+  state.lock = std::unique_lock(query_mutex_, std::defer_lock);
+  state.query = query;
+  state.with_crc = with_crc;
+  state.command = GetCommandName(query);
+  state.timeout = GetReplyTimeout(state.command, expected_reply_length);
+  state.callback = std::move(callback);
+  state.crc_retries = retry_policy_.crc_retries;
+  state.timeout_retries = retry_policy_.timeout_retries;
+  OnAsyncTimer();
+}
+
+void SerialPort::OnAsyncTimer() {
+  auto& state = *async_query_;
+  switch (state.state) {
+    case AsyncQuery::State::kLocking:
+      if (!state.lock.try_lock()) {
+        state.timer.Arm(Clock::now() + kLockRetryInterval);
+        return;
+      }
+      state.start_time = Clock::now();
+      state.observed.emplace(*this, state.query);
+      StartAsyncAttempt();
+      return;
+    case AsyncQuery::State::kSending:
+      SendAsyncChunk();
+      return;
+    case AsyncQuery::State::kReceiving:
+      state.reactor.Unwatch(file_descriptor_);
+      if (capture_) {
+        capture_->Write(capture::RecordType::kTimeout, {state.buffer, state.bytes_read});
+      }
+      OnAsyncAttemptFailed(std::make_exception_ptr(TimeoutException("Read timeout")));
+      return;
+    case AsyncQuery::State::kBackoff:
+      StartAsyncAttempt();
+      return;
+    case AsyncQuery::State::kDraining:
+      // The line has been quiet for kDrainQuietTime, or kMaxDrainTime is over.
+      state.reactor.Unwatch(file_descriptor_);
+      LogDrained(state.bytes_drained, device_);
+      SendAsyncFrame();
+      return;
   }
 }
+
+void SerialPort::StartAsyncAttempt() {
+  auto& state = *async_query_;
+  ++state.metrics.attempts;
+  const bool reconnecting = file_descriptor_ < 0;
+  try {
+    // Draining would block the reactor's thread, and thus the other devices, so it's done by the
+    // reactor instead.
+    EnsureConnected(false);
+  } catch (const DisconnectedException&) {
+    FinishAsyncQuery({}, std::current_exception());
+    return;
+  }
+  if (!reconnecting) {
+    SendAsyncFrame();
+    return;
+  }
+  state.state = AsyncQuery::State::kDraining;
+  state.drain_deadline = Clock::now() + kMaxDrainTime;
+  state.bytes_drained = 0;
+  state.reactor.Watch(file_descriptor_, [this] { OnAsyncDrainReadable(); });
+  state.timer.Arm(Clock::now() + kDrainQuietTime);
+}
+
+void SerialPort::OnAsyncDrainReadable() {
+  auto& state = *async_query_;
+  char buffer[256];
+  const auto n_bytes = read(file_descriptor_, buffer, std::size(buffer));
+  if ((n_bytes < 0 && IsLinkLost(errno)) || (n_bytes == 0 && IsHungUp(file_descriptor_))) {
+    const auto reason = n_bytes < 0 ? strerror(errno) : "hung up";
+    state.reactor.Unwatch(file_descriptor_);
+    state.timer.Disarm();
+    FinishAsyncQuery({}, std::make_exception_ptr(Disconnect(reason)));
+    return;
+  }
+  if (n_bytes <= 0) return;
+  state.bytes_drained += n_bytes;
+  // Wait for the line to be quiet again, but not past the deadline.
+  state.timer.Arm(std::min(Clock::now() + kDrainQuietTime, state.drain_deadline));
+}
+
+void SerialPort::SendAsyncFrame() {
+  auto& state = *async_query_;
+  state.frame = MakeFrame(state.query, state.with_crc);
+  state.bytes_sent = 0;
+  state.bytes_read = 0;
+  state.state = AsyncQuery::State::kSending;
+  SendAsyncChunk();
+}
+
+void SerialPort::SendAsyncChunk() {
+  auto& state = *async_query_;
+  const auto bytes_to_send = std::min(state.frame.length() - state.bytes_sent, kChunkSize);
+  const auto written = write(file_descriptor_, state.frame.data() + state.bytes_sent,
+                             bytes_to_send);
+  if (written < 0 && errno != EAGAIN) {
+    const auto error = errno;
+    state.timer.Disarm();
+    FinishAsyncQuery({}, IsLinkLost(error)
+        ? std::make_exception_ptr(Disconnect(strerror(error)))
+        : std::make_exception_ptr(std::runtime_error(
+              fmt::format("Failed to write. {}", strerror(error)))));
+    return;
+  }
+  state.bytes_sent += std::max<ssize_t>(written, 0);
+  if (state.bytes_sent < state.frame.length()) {
+    state.timer.Arm(Clock::now() + kChunkPause);
+    return;
+  }
+
+  state.state = AsyncQuery::State::kReceiving;
+  state.reactor.Watch(file_descriptor_, [this] { OnAsyncReadable(); });
+  state.timer.Arm(Clock::now() + state.timeout);
+}
+
+void SerialPort::OnAsyncReadable() {
+  auto& state = *async_query_;
+  const auto n_bytes = read(file_descriptor_, state.buffer + state.bytes_read,
+                            std::size(state.buffer) - state.bytes_read);
+  if ((n_bytes < 0 && IsLinkLost(errno)) || (n_bytes == 0 && IsHungUp(file_descriptor_))) {
+    // Otherwise the reactor would keep reporting the dead descriptor as readable.
+    const auto reason = n_bytes < 0 ? strerror(errno) : "hung up";
+    state.reactor.Unwatch(file_descriptor_);
+    state.timer.Disarm();
+    FinishAsyncQuery({}, std::make_exception_ptr(Disconnect(reason)));
+    return;
+  }
+  if (n_bytes <= 0) return;
+
+  const std::string_view data{&state.buffer[state.bytes_read], static_cast<std::size_t>(n_bytes)};
+  spdlog::debug("Read {} bytes: '{}', hex: {}.", n_bytes, EscapedBytes{data}, HexBytes{data});
+  state.bytes_read += n_bytes;
+  const std::string_view received{state.buffer, state.bytes_read};
+  // Replies end with a carriage return (<cr>). Though it isn't necessarily the last received byte.
+  const auto position = data.find('\r');
+  if (position == std::string_view::npos && state.bytes_read < std::size(state.buffer)) return;
+
+  state.reactor.Unwatch(file_descriptor_);
+  state.timer.Disarm();
+  std::string reply;
+  try {
+    if (position == std::string_view::npos) ThrowOverflow(received);
+    reply = ExtractReply(received, data.data() - state.buffer + position + 1);
+  } catch (...) {
+    OnAsyncAttemptFailed(std::current_exception());
+    return;
+  }
+  FinishAsyncQuery(std::move(reply), nullptr);
+}
+
+void SerialPort::OnAsyncAttemptFailed(std::exception_ptr error) {
+  auto& state = *async_query_;
+  bool retry = false;
+  try {
+    std::rethrow_exception(error);
+  } catch (const CrcMismatchException&) {
+    ++state.metrics.crc_errors;
+    retry = --state.crc_retries >= 0;
+  } catch (const CorruptedFrameException&) {
+    ++state.metrics.crc_errors;
+    retry = --state.crc_retries >= 0;
+  } catch (const TimeoutException&) {
+    ++state.metrics.timeouts;
+    retry = --state.timeout_retries >= 0;
+  } catch (...) {
+  }
+  if (!retry) {
+    FinishAsyncQuery({}, error);
+    return;
+  }
+  state.state = AsyncQuery::State::kBackoff;
+  state.timer.Arm(Clock::now() + GetBackoff(retry_policy_, state.metrics.attempts - 1));
+}
+
+void SerialPort::FinishAsyncQuery(std::string reply, std::exception_ptr error) {
+  // The port is free for the next query from now on, even if it's made by the callback.
+  const auto state = std::move(async_query_);
+  state->reactor.Unwatch(file_descriptor_);
+  auto& metrics = state->metrics;
+  if (error) {
+    ++metrics.failures;
+  } else {
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - state->start_time);
+    metrics.total_latency = metrics.max_latency = latency;
+    metrics.reply_length = reply.length() + frame::GetLength(GetReplyChecksum()) + 1;
+    spdlog::debug("Query {}: {} attempt(s), {} ms.", state->query, metrics.attempts,
+                  latency.count() / 1000);
+    state->observed->Succeed(reply);
+  }
+  UpdateMetrics(state->command, metrics);
+  // Reports the failure, if any.
+  state->observed.reset();
+
+  auto callback = std::move(state->callback);
+  state->lock = {};
+  callback(std::move(reply), error);
+}
@@ -1,10 +1,30 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
 
-class SerialPort {
+#include "capture.hh"
+#include "configuration.h"
+#include "exceptions.h"
+#include "frame.hh"
+#include "reactor.hh"
+#include "transport.hh"
+
+/// If the device is gone (e.g. a USB adapter re-enumerates, or the PTY of socat is recreated),
+/// queries fail with DisconnectedException at once, instead of timing out with all the retries,
+/// and the port is reopened by the next queries with a backoff, or as soon as the device reappears.
+/// Everything else (the protocol, the metrics, the capture) is kept, so polling just resumes.
+class SerialPort : public Transport {
  public:
-  SerialPort(std::string_view device);
+  /// @throws std::runtime_error if the device can't be opened.
+  explicit SerialPort(std::string_view device, const RetryPolicy& = {});
   SerialPort(const SerialPort&) = delete;
   SerialPort(SerialPort&&) = delete;
 
@@ -19,17 +39,87 @@ class SerialPort {
   void Send(std::string_view query, bool with_crc) const;
 
   /// Receive data from device and check its CRC.
+  /// Garbage around the frame (e.g. leftovers of previous corrupted replies) is discarded.
   /// @warning This function is NOT thread-safe.
   /// @returns a reply from the device, excluding CRC and carriage return (<cr>).
-  std::string Receive(int timeout_in_seconds = 5) const;
+  /// @throws CrcMismatchException, CorruptedFrameException, TimeoutException.
+  std::string Receive(std::chrono::milliseconds timeout = std::chrono::seconds(5)) const;
+
+  /// Combination of Send() and Receive() with checking CRC and retrying on CRC mismatch, corrupted
+  /// reply or timeout according to the port's RetryPolicy.
+  std::string Query(std::string_view query, bool with_crc,
+                    std::size_t expected_reply_length = 0) const override;
+
+  /// @param reply - the reply, as returned by Query(), if @a error is null.
+  using QueryCallback = std::function<void(std::string reply, std::exception_ptr error)>;
+
+  /// Query() that doesn't block: the frame is sent, and the reply awaited, by @a reactor, so one
+  /// thread can query many ports at once. Retries, metrics and capture are the same as in Query().
+  /// Blocking queries (e.g. from Home Assistant commands) made meanwhile from other threads wait for
+  /// this one to finish, and vice versa.
+  /// Only one asynchronous query at a time is allowed. The port must outlive it.
+  /// @param callback - is called by the reactor once the query succeeds or all the retries fail.
+  void QueryAsync(Reactor& reactor, std::string_view query, bool with_crc,
+                  std::size_t expected_reply_length, QueryCallback&& callback);
+
+  /// Record all the frames sent and received from now on into @a filename, see capture.hh.
+  void StartCapture(const std::string& filename);
 
-  /// Combination of Send() and Receive() with checking CRC and retrying on CRC mismatch.
-  /// This function is thread-safe.
-  /// @param query - see Send().
-  /// @param with_crc - see Send().
-  /// @param n_retries how many times to retry the query in case if CRC doesn't match.
-  std::string Query(std::string_view query, bool with_crc, int n_retries = 10) const;
+  /// @returns how many times the damage of the given kind was detected in replies.
+  unsigned GetCorruptionsCount(frame::Corruption) const;
 
  private:
-  int file_descriptor_;
+  struct AsyncQuery;
+
+  /// @returns the descriptor of @a device, locked and set up.
+  /// @param drain - discard what is still arriving on the line (see DrainLine()), otherwise the
+  ///        caller should do that.
+  /// @throws std::runtime_error on failure.
+  static int Open(const std::string& device, bool drain = true);
+  /// Closes the lost device, so that EnsureConnected() reopens it.
+  /// @returns the exception to report the failed query with.
+  DisconnectedException Disconnect(std::string_view reason) const;
+  /// Reopens the lost device if it's time to retry, or if it has reappeared.
+  /// @param drain - see Open().
+  /// @throws DisconnectedException if the device isn't reopened.
+  void EnsureConnected(bool drain = true) const;
+  /// @returns true if the device file has been (re)created since the last call.
+  bool DeviceAppeared() const;
+
+  /// @returns @a query ready to be sent: with CRC (if @a with_crc) and carriage return. The frame
+  ///          is logged and recorded as sent.
+  std::string MakeFrame(std::string_view query, bool with_crc) const;
+  /// Validates the reply that ends with the carriage return at @a frame_end - 1 of @a received
+  /// bytes. Everything after that is discarded.
+  /// @returns the reply, excluding garbage around the frame, CRC and carriage return.
+  /// @throws CrcMismatchException, CorruptedFrameException.
+  std::string ExtractReply(std::string_view received, std::size_t frame_end) const;
+  /// Handles @a received bytes that have filled the buffer without a carriage return.
+  [[noreturn]] void ThrowOverflow(std::string_view received) const;
+
+  void OnAsyncTimer();
+  void StartAsyncAttempt();
+  void OnAsyncDrainReadable();
+  void SendAsyncFrame();
+  void SendAsyncChunk();
+  void OnAsyncReadable();
+  void OnAsyncAttemptFailed(std::exception_ptr);
+  void FinishAsyncQuery(std::string reply, std::exception_ptr error);
+
+  void RegisterCorruption(frame::Corruption) const;
+  std::chrono::milliseconds GetReplyTimeout(std::string_view command,
+                                            std::size_t expected_reply_length) const;
+
+  const std::string device_;
+  /// -1 while the device is lost.
+  mutable int file_descriptor_;
+  const RetryPolicy retry_policy_;
+  /// Watches the directory of the device for it to reappear, or -1.
+  int inotify_fd_ = -1;
+  mutable std::chrono::steady_clock::time_point next_reconnect_time_;
+  mutable int reconnect_attempts_ = 0;
+  mutable std::mutex query_mutex_;
+  std::unique_ptr<capture::Writer> capture_;
+  mutable std::array<std::atomic<unsigned>, frame::kCorruptionKinds> corruptions_{};
+  std::unique_ptr<AsyncQuery> async_query_;
 };
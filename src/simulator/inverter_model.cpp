@@ -0,0 +1,274 @@
+#include "inverter_model.hh"
+
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <format>
+#include <stdexcept>
+
+#include "exceptions.h"
+#include "frame.hh"
+
+namespace simulator {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+/// @returns the value of the digit at the end of @a command, or -1 if there is no such digit.
+int GetLastDigit(std::string_view command) {
+  if (command.empty() || !std::isdigit(command.back())) return -1;
+  return command.back() - '0';
+}
+
+class Pi30Model : public InverterModel {
+ public:
+  explicit Pi30Model(const ModelOptions& options) : options_(options) {}
+
+ protected:
+  std::string GetPayload(std::string_view command) override {
+    if (command == "QPI") return "(PI30";
+    if (command == "QID") return "(92932004102443";
+    if (command == "QVFW") return "(VERFW:00072.70";
+    if (command == "QPIRI") return GetRatingInformation();
+    if (command == "QPIGS") return GetGeneralStatus();
+    if (command == "QMOD") return GetStatus().battery_discharge_current > 0 ? "(B" : "(L";
+    if (command == "QPIWS") return GetWarnings();
+    if (command.starts_with("QPGS") && command.length() == 5) {
+      return GetParallelUnitStatus(GetLastDigit(command));
+    }
+
+    // Set-commands.
+    const auto value = GetLastDigit(command);
+    if (command.starts_with("PCP0") && value >= 0 && value <= 3) {
+      charger_priority_ = value;
+      return "(ACK";
+    }
+    if (command.starts_with("POP0") && value >= 0 && value <= 2) {
+      output_source_priority_ = value;
+      return "(ACK";
+    }
+    if (command.starts_with("PGR0") && value >= 0 && value <= 1) {
+      input_voltage_range_ = value;
+      return "(ACK";
+    }
+    if (command.starts_with("PBT0") && value >= 0 && value <= 2) {
+      battery_type_ = value;
+      return "(ACK";
+    }
+    return "(NAK";
+  }
+
+ private:
+  std::string GetRatingInformation() const {
+    return std::format("(230.0 21.7 230.0 50.0 21.7 5000 4000 48.0 46.0 42.0 56.4 54.0 {} 30 060 "
+                       "{} {} {} 9 01 0 {} 54.0 0 1 120",
+                       battery_type_, input_voltage_range_, output_source_priority_,
+                       charger_priority_, GetOutputMode(0));
+  }
+
+  /// @returns the output mode of the @a unit, as in QPIRI and QPGSn.
+  int GetOutputMode(int unit) const {
+    if (options_.parallel_units <= 1) return 0;
+    return options_.three_phase ? 2 + unit % 3 : 1;
+  }
+
+  std::string GetParallelUnitStatus(int unit) const {
+    if (unit < 0 || unit >= options_.parallel_units || options_.parallel_units <= 1) {
+      return "(0 00000000000000 0 00 000.0 00.00 000.0 00.00 0000 0000 000 00.0 000 000 000.0 000 "
+             "00000 00000 000 00000000 0 0 000 000 00 00 000";
+    }
+    // The units share the load and the PV array, slightly unevenly.
+    const auto s = GetStatus();
+    const int n = options_.parallel_units;
+    const int active_power = s.output_active_power * (10 + unit) / (10 * n);
+    const int pv_current = static_cast<int>(s.pv_current) * (10 + unit) / (10 * n);
+    return std::format(
+        "(1 9293200410244{} {} 00 {:05.1f} {:05.2f} {:05.1f} {:05.2f} {:04d} {:04d} {:03d} {:04.1f} "
+        "{:03d} {:03d} {:05.1f} {:03d} {:05d} {:05d} {:03d} 00010110 {} {} 060 120 30 {:02d} {:03d}",
+        unit, s.battery_discharge_current > 0 ? 'B' : 'L', s.grid_voltage, s.grid_frequency,
+        s.output_voltage, s.output_frequency, active_power * 11 / 10, active_power,
+        s.output_load_percent / n, s.battery_voltage, s.battery_charging_current / n,
+        s.battery_capacity, s.pv_voltage, s.battery_charging_current,
+        s.output_apparent_power, s.output_active_power, s.output_load_percent, GetOutputMode(unit),
+        charger_priority_, pv_current, s.battery_discharge_current / n);
+  }
+
+  static std::string GetGeneralStatus() {
+    const auto s = GetStatus();
+    return std::format(
+        "({:05.1f} {:04.1f} {:05.1f} {:04.1f} {:04d} {:04d} {:03d} {:03d} {:05.2f} {:03d} {:03d} "
+        "{:04d} {:04.1f} {:05.1f} {:05.2f} {:05d} 00010110 00 00 {:05d} 010",
+        s.grid_voltage, s.grid_frequency, s.output_voltage, s.output_frequency,
+        s.output_apparent_power, s.output_active_power, s.output_load_percent, s.bus_voltage,
+        s.battery_voltage, s.battery_charging_current, s.battery_capacity, s.heatsink_temperature,
+        s.pv_current, s.pv_voltage, s.battery_voltage, s.battery_discharge_current, s.pv_power);
+  }
+
+  static std::string GetWarnings() {
+    std::string flags(32, '0');
+    if (GetStatus().battery_capacity < 20) {
+      flags[12] = '1';  // Battery low alarm.
+    }
+    return "(" + flags;
+  }
+
+  const ModelOptions options_;
+};
+
+
+class Pi18Model : public InverterModel {
+ protected:
+  std::string GetPayload(std::string_view command) override {
+    if (command == "^P005PI") return Data("18");
+    if (command == "^P005ID") return Data("1492932004102443000000");
+    if (command == "^P006VFW") return Data("05220,05220,00000");
+    if (command == "^P007PIRI") return GetRatedInformation();
+    if (command == "^P005GS") return GetGeneralStatus();
+    if (command == "^P006MOD") return Data(GetStatus().battery_discharge_current > 0 ? "03" : "05");
+    if (command == "^P007FLAG") return Data(std::format("0,0,0,0,0,{:d},0,0,0", backlight_));
+    if (command == "^P005FWS") return GetWarnings();
+    if (command == "^P004T") return GetTime();
+    if (command == "^P005ET") return Data(std::format("{:08d}", GetTotalEnergy()));
+    if (command.starts_with("^P009EY") || command.starts_with("^P011EM") ||
+        command.starts_with("^P013ED")) {
+      // Generated energy of a year/month/day. Doesn't have to be consistent with the total.
+      return Data(std::format("{:08d}", 5 * (command.length() - 6)));
+    }
+
+    // Set-commands.
+    const auto value = GetLastDigit(command);
+    if (command.starts_with("^S009PCP0,") && value >= 0 && value <= 2) {
+      charger_priority_ = value;
+      return "^1";
+    }
+    if (command.starts_with("^S007POP") && value >= 0 && value <= 1) {
+      output_source_priority_ = value;
+      return "^1";
+    }
+    if (command.starts_with("^S007PBT") && value >= 0 && value <= 2) {
+      battery_type_ = value;
+      return "^1";
+    }
+    if (command.starts_with("^S007PGR") && value >= 0 && value <= 1) {
+      input_voltage_range_ = value;
+      return "^1";
+    }
+    if (command.starts_with("^S007PSP") && value >= 0 && value <= 1) {
+      solar_power_priority_ = value;
+      return "^1";
+    }
+    if (command.starts_with("^S007LON") && value >= 0 && value <= 1) {
+      load_connection_ = value;
+      return "^1";
+    }
+    if (command == "^S006PEF" || command == "^S006PDF") {
+      backlight_ = (command == "^S006PEF");
+      return "^1";
+    }
+    return "^0";
+  }
+
+ private:
+  /// PI18 replies look like "^Dnnn<data>", where nnn is the length of data + CRC + <cr>.
+  static std::string Data(std::string_view data) {
+    return std::format("^D{:03d}{}", data.length() + 3, data);
+  }
+
+  std::string GetRatedInformation() const {
+    return Data(std::format("2300,217,2300,500,217,5000,5000,480,460,540,420,564,540,{},060,120,"
+                            "{},{},{},9,0,0,0,{},1,0",
+                            battery_type_, input_voltage_range_, output_source_priority_,
+                            charger_priority_, solar_power_priority_));
+  }
+
+  std::string GetGeneralStatus() const {
+    const auto s = GetStatus();
+    const auto battery_direction = s.battery_discharge_current > 0 ? 2 : 1;
+    return Data(std::format(
+        "{:04d},{:03d},{:04d},{:03d},{:04d},{:04d},{:03d},{:03d},{:03d},{:03d},{:03d},{:03d},"
+        "{:03d},{:03d},{:03d},{:03d},{:04d},{:04d},{:04d},{:04d},0,2,0,{:d},{},2,1,0",
+        std::lround(s.grid_voltage * 10), std::lround(s.grid_frequency * 10),
+        std::lround(s.output_voltage * 10), std::lround(s.output_frequency * 10),
+        s.output_apparent_power, s.output_active_power, s.output_load_percent,
+        std::lround(s.battery_voltage * 10), std::lround(s.battery_voltage * 10), 0,
+        s.battery_discharge_current, s.battery_charging_current, s.battery_capacity,
+        s.heatsink_temperature, s.heatsink_temperature + 2, 0, s.pv_power, 0,
+        std::lround(s.pv_voltage * 10), 0, load_connection_, battery_direction));
+  }
+
+  static std::string GetWarnings() {
+    const auto battery_low = GetStatus().battery_capacity < 20;
+    return Data(std::format("00,0,0,0,0,0,{:d},0,0,0,0,0,0,0,0,0,0", battery_low));
+  }
+
+  static std::string GetTime() {
+    const auto now = std::time(nullptr);
+    char buffer[16];
+    std::strftime(buffer, std::size(buffer), "%Y%m%d%H%M%S", std::localtime(&now));
+    return Data(buffer);
+  }
+
+  /// Total energy grows by 1 kWh every hour of the simulator's life.
+  static int GetTotalEnergy() {
+    static const auto start = std::chrono::steady_clock::now();
+    const auto hours = std::chrono::duration_cast<std::chrono::hours>(
+        std::chrono::steady_clock::now() - start);
+    return 12345 + hours.count();
+  }
+};
+
+}  // namespace
+
+
+std::unique_ptr<InverterModel> InverterModel::Create(Protocol protocol,
+                                                     const ModelOptions& options) {
+  switch (protocol) {
+    case Protocol::PI18: return std::make_unique<Pi18Model>();
+    case Protocol::PI30: return std::make_unique<Pi30Model>(options);
+    case Protocol::PI17: throw UnsupportedProtocolException("PI17");
+  }
+  throw std::runtime_error("Unreachable");
+}
+
+std::string InverterModel::Reply(std::string_view command) {
+  auto reply = GetPayload(command);
+  reply += frame::GetCRC(reply);
+  reply += '\r';
+  return reply;
+}
+
+InverterModel::Status InverterModel::GetStatus() {
+  const auto now = std::time(nullptr);
+  const auto* local_time = std::localtime(&now);
+  const double hour = local_time->tm_hour + local_time->tm_min / 60.0;
+  const double t = static_cast<double>(now);
+
+  Status s{};
+  s.grid_voltage = 230.0f + 3.0f * std::sin(t / 300);
+  s.grid_frequency = 50.0f + 0.1f * std::sin(t / 60);
+  s.output_voltage = 230.0f;
+  s.output_frequency = 50.0f;
+
+  // The load drifts slowly, within 150..950 W.
+  s.output_active_power = static_cast<int>(550 + 400 * std::sin(t / 900));
+  s.output_apparent_power = s.output_active_power * 11 / 10;
+  s.output_load_percent = s.output_apparent_power * 100 / 5000;
+
+  // PV follows the sun: 0 at night, up to 3 kW at noon.
+  const double sun = std::max(0.0, std::sin(kPi * (hour - 6) / 12));
+  s.pv_power = static_cast<int>(3000 * sun * (0.9 + 0.1 * std::sin(t / 37)));
+  s.pv_voltage = s.pv_power ? 300.0f + 50.0f * static_cast<float>(sun) : 0.0f;
+  s.pv_current = s.pv_power ? s.pv_power / s.pv_voltage : 0.0f;
+  s.bus_voltage = 400;
+
+  // The battery covers the difference between PV and load.
+  s.battery_capacity = static_cast<int>(60 + 35 * std::sin(t / 7200));
+  s.battery_voltage = 48.0f + 6.0f * s.battery_capacity / 100;
+  const int battery_power = s.pv_power - s.output_active_power;
+  s.battery_charging_current = battery_power > 0 ? battery_power / 50 : 0;
+  s.battery_discharge_current = battery_power < 0 ? -battery_power / 50 : 0;
+  s.heatsink_temperature = 30 + s.output_load_percent / 5;
+  return s;
+}
+
+}  // namespace simulator
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "protocols/protocol.hh"
+
+namespace simulator {
+
+struct ModelOptions {
+  /// The number of units in the parallel system, 1 for a standalone inverter. PI30 only.
+  int parallel_units = 1;
+  /// Whether the parallel units make a three-phase system, one unit per phase in turn.
+  bool three_phase = false;
+};
+
+/// Emulates the inverter's logic: answers queries with valid, realistic and time-varying values,
+/// and remembers settings changed by set-commands.
+class InverterModel {
+ public:
+  static std::unique_ptr<InverterModel> Create(Protocol, const ModelOptions& = {});
+  virtual ~InverterModel() = default;
+
+  /// @param command - the query, without CRC and carriage return.
+  /// @returns the whole reply frame, including CRC and carriage return.
+  std::string Reply(std::string_view command);
+
+ protected:
+  /// @returns the payload of the reply to @a command (without CRC and carriage return).
+  virtual std::string GetPayload(std::string_view command) = 0;
+
+  /// Instant metrics of the inverter. They vary with time: PV power follows the sun, load and
+  /// battery slowly drift.
+  struct Status {
+    float grid_voltage;
+    float grid_frequency;
+    float output_voltage;
+    float output_frequency;
+    int output_apparent_power;
+    int output_active_power;
+    int output_load_percent;
+    int bus_voltage;
+    float battery_voltage;
+    int battery_charging_current;
+    int battery_discharge_current;
+    int battery_capacity;
+    int heatsink_temperature;
+    float pv_voltage;
+    float pv_current;
+    int pv_power;
+  };
+  static Status GetStatus();
+
+  // Settings that could be changed with set-commands.
+  int battery_type_ = 0;
+  int input_voltage_range_ = 0;
+  int output_source_priority_ = 1;
+  int charger_priority_ = 1;
+  int solar_power_priority_ = 1;
+  bool backlight_ = true;
+  bool load_connection_ = true;
+};
+
+}  // namespace simulator
@@ -0,0 +1,83 @@
+// Emulates a Voltronic inverter on a pseudo-terminal, so inverter_poller could be run and
+// benchmarked without real hardware.
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#include "configuration.h"
+#include "protocols/protocol.hh"
+#include "pty_link.hh"
+#include "spdlog/spdlog.h"
+
+namespace {
+
+simulator::PtyLink* active_link = nullptr;
+
+void PrintHelp() {
+  std::cout <<
+"USAGE:  ./inverter_simulator <options>"
+"\nOPTIONS:"
+"\n    --protocol <PI18|PI30>   Protocol to emulate (default: PI30)."
+"\n    --link <path>            Symlink to the created pseudo-terminal (default: /tmp/ttyInverter)."
+"\n    --latency <ms>           Delay before replying to a query (default: 100)."
+"\n    --baud <rate>            Emulated baud rate, 0 to send replies at once (default: 2400)."
+"\n    --crc-errors <percent>   Corrupt CRC of the given percentage of replies (default: 0)."
+"\n    --garbage <percent>      Append garbage to the given percentage of replies (default: 0)."
+"\n    --seed <number>          Seed for the injected errors, to make runs reproducible."
+"\n    --parallel <units>       Emulate a parallel system of the given number of units (PI30 only)."
+"\n    --three-phase            The parallel units make a three-phase system."
+"\n    -h | --help              This Help Message."
+"\n    -d                       Log every query and reply.\n";
+}
+
+int GetInt(const CommandLineArguments& arguments, std::string_view option, int default_value) {
+  return arguments.IsSet(option) ? std::stoi(arguments.Get(option)) : default_value;
+}
+
+void OnSignal(int) {
+  if (active_link) active_link->Stop();
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  CommandLineArguments arguments(argc, argv);
+  if (arguments.IsSet("-h", "--help")) {
+    PrintHelp();
+    return 0;
+  }
+  spdlog::set_pattern("[%H:%M:%S.%e %^%l%$] %v");
+  spdlog::set_level(arguments.IsSet("-d") ? spdlog::level::debug : spdlog::level::info);
+
+  const auto protocol = arguments.IsSet("--protocol")
+                        ? ProtocolFromString(arguments.Get("--protocol"))
+                        : Protocol::PI30;
+  simulator::PtyLink::Options options;
+  if (arguments.IsSet("--link")) {
+    options.link = arguments.Get("--link");
+  }
+  options.latency = std::chrono::milliseconds(GetInt(arguments, "--latency", 100));
+  options.baud_rate = GetInt(arguments, "--baud", options.baud_rate);
+  options.crc_errors_percent = GetInt(arguments, "--crc-errors", 0);
+  options.garbage_percent = GetInt(arguments, "--garbage", 0);
+  if (arguments.IsSet("--seed")) {
+    options.seed = std::stoul(arguments.Get("--seed"));
+  }
+
+  const simulator::ModelOptions model_options{
+      .parallel_units = GetInt(arguments, "--parallel", 1),
+      .three_phase = arguments.IsSet("--three-phase")};
+  auto model = simulator::InverterModel::Create(protocol, model_options);
+  simulator::PtyLink pty_link(options);
+  active_link = &pty_link;
+  std::signal(SIGINT, OnSignal);
+  std::signal(SIGTERM, OnSignal);
+
+  spdlog::info("Emulating {} inverter on {} ({})", ToString(protocol), pty_link.GetDeviceName(),
+               options.link);
+  pty_link.Serve(*model);
+  spdlog::info("Stopped");
+  return 0;
+}
@@ -0,0 +1,143 @@
+#include "pty_link.hh"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <system_error>
+#include <thread>
+
+#include "frame.hh"
+#include "frame_trace.hh"
+#include "spdlog/spdlog.h"
+
+namespace simulator {
+namespace {
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+/// Switch the terminal to raw mode: no echo, no line editing, no CR/LF translation.
+void MakeRaw(int fd) {
+  termios settings;
+  if (tcgetattr(fd, &settings) != 0) ThrowSystemError("tcgetattr");
+  cfmakeraw(&settings);
+  if (tcsetattr(fd, TCSANOW, &settings) != 0) ThrowSystemError("tcsetattr");
+}
+
+/// Queries could be sent with or without CRC. Strip it if it's there.
+std::string_view StripCRC(std::string_view query) {
+  const std::string frame = std::string(query) + '\r';
+  if (query.length() > 2 && frame::CheckCRC(frame)) {
+    query.remove_suffix(2);
+  }
+  return query;
+}
+
+}  // namespace
+
+
+PtyLink::PtyLink(const Options& options) : options_(options), random_(options.seed) {
+  master_ = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master_ < 0) ThrowSystemError("posix_openpt");
+  if (grantpt(master_) != 0) ThrowSystemError("grantpt");
+  if (unlockpt(master_) != 0) ThrowSystemError("unlockpt");
+  MakeRaw(master_);
+
+  device_name_ = ptsname(master_);
+  slave_ = open(device_name_.c_str(), O_RDWR | O_NOCTTY);
+  if (slave_ < 0) ThrowSystemError("open");
+  MakeRaw(slave_);
+
+  if (!options_.link.empty()) {
+    unlink(options_.link.c_str());
+    if (symlink(device_name_.c_str(), options_.link.c_str()) != 0) ThrowSystemError("symlink");
+  }
+}
+
+PtyLink::~PtyLink() {
+  if (!options_.link.empty()) {
+    unlink(options_.link.c_str());
+  }
+  close(slave_);
+  close(master_);
+}
+
+void PtyLink::Serve(InverterModel& model) {
+  std::string query;
+  char buffer[256];
+  while (!stopped_) {
+    pollfd fd{.fd = master_, .events = POLLIN};
+    const auto n_ready = poll(&fd, 1, 100);
+    if (n_ready < 0 && errno != EINTR) ThrowSystemError("poll");
+    if (n_ready <= 0) continue;
+
+    const auto n_bytes = read(master_, buffer, std::size(buffer));
+    if (n_bytes < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      ThrowSystemError("read");
+    }
+
+    for (ssize_t i = 0; i < n_bytes; ++i) {
+      if (buffer[i] != '\r') {
+        query += buffer[i];
+        continue;
+      }
+      const auto command = StripCRC(query);
+      auto reply = model.Reply(command);
+      spdlog::debug("Query: '{}', reply: '{}'", EscapedBytes{command}, EscapedBytes{reply});
+      std::this_thread::sleep_for(options_.latency);
+      SendReply(std::move(reply));
+      query.clear();
+    }
+  }
+}
+
+void PtyLink::SendReply(std::string reply) {
+  std::uniform_int_distribution<int> percent(0, 99);
+  if (percent(random_) < options_.crc_errors_percent) {
+    // The CRC is right before the trailing <cr>.
+    reply[reply.length() - 2] ^= 0x5A;
+    spdlog::debug("Corrupted the CRC");
+  }
+  if (percent(random_) < options_.garbage_percent) {
+    std::uniform_int_distribution<int> length(1, 8);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (auto n = length(random_); n > 0; --n) {
+      reply += static_cast<char>(byte(random_));
+    }
+    spdlog::debug("Appended garbage");
+  }
+  Write(reply);
+}
+
+void PtyLink::Write(std::string_view data) {
+  if (options_.baud_rate <= 0) {
+    while (!data.empty()) {
+      const auto n_bytes = write(master_, data.data(), data.length());
+      if (n_bytes < 0) {
+        if (errno == EINTR || errno == EAGAIN) continue;
+        ThrowSystemError("write");
+      }
+      data.remove_prefix(n_bytes);
+    }
+    return;
+  }
+
+  // 1 start bit + 8 data bits + 1 stop bit.
+  const auto byte_time = std::chrono::microseconds(10 * 1'000'000 / options_.baud_rate);
+  auto next = std::chrono::steady_clock::now();
+  for (const auto byte : data) {
+    next += byte_time;
+    std::this_thread::sleep_until(next);
+    if (write(master_, &byte, 1) < 0 && errno != EINTR && errno != EAGAIN) {
+      ThrowSystemError("write");
+    }
+  }
+}
+
+}  // namespace simulator
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include "inverter_model.hh"
+
+namespace simulator {
+
+/// Connects an InverterModel to a pseudo-terminal, so inverter_poller could talk to it as if it
+/// were a real device (e.g. with "device=/tmp/ttyInverter" in inverter.conf).
+class PtyLink {
+ public:
+  struct Options {
+    /// Symlink to the slave side of the pseudo-terminal. Empty means "don't create a symlink".
+    std::string link = "/tmp/ttyInverter";
+    /// Time between receiving a query and starting to send the reply.
+    std::chrono::milliseconds latency{100};
+    /// Emulated baud rate: every byte of the reply is delayed accordingly. 0 disables emulation.
+    int baud_rate = 2400;
+    /// Probability (in percent) to corrupt the CRC of a reply.
+    int crc_errors_percent = 0;
+    /// Probability (in percent) to append random garbage after the reply.
+    int garbage_percent = 0;
+    unsigned seed = std::random_device{}();
+  };
+
+  /// @throws std::system_error if the pseudo-terminal couldn't be created.
+  explicit PtyLink(const Options&);
+  ~PtyLink();
+
+  PtyLink(const PtyLink&) = delete;
+  PtyLink& operator=(const PtyLink&) = delete;
+
+  /// @returns the name of the slave device, e.g. /dev/pts/3.
+  const std::string& GetDeviceName() const { return device_name_; }
+
+  /// Answer queries with @a model until Stop() is called.
+  void Serve(InverterModel& model);
+
+  /// Can be called from any thread (or from a signal handler).
+  void Stop() { stopped_ = true; }
+
+ private:
+  void SendReply(std::string reply);
+  void Write(std::string_view data);
+
+  const Options options_;
+  std::mt19937 random_;
+  int master_ = -1;
+  /// The slave side is kept open, otherwise reading from the master fails with EIO whenever the
+  /// poller closes the device.
+  int slave_ = -1;
+  std::string device_name_;
+  std::atomic<bool> stopped_ = false;
+};
+
+}  // namespace simulator
@@ -0,0 +1,200 @@
+#include "trace.hh"
+
+#include <array>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+namespace trace {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kMaxArgumentLength = 32;
+
+struct Event {
+  const char* name;
+  Clock::time_point start;
+  Clock::duration duration;
+  std::uint8_t argument_length;
+  std::array<char, kMaxArgumentLength> argument;
+};
+
+/// Spans of a single thread. The thread is the only producer, Flush() is the only consumer, so the
+/// ring needs no locks. When the ring is full, new spans are dropped (and counted).
+struct ThreadBuffer {
+  static constexpr std::size_t kCapacity = 4096;
+
+  explicit ThreadBuffer(int thread_id) : thread_id(thread_id) {}
+
+  const int thread_id;
+  std::array<Event, kCapacity> events;
+  /// The number of events ever written and read, respectively.
+  std::atomic<std::size_t> head = 0;
+  std::atomic<std::size_t> tail = 0;
+  std::atomic<std::size_t> dropped = 0;
+};
+
+/// Everything but the buffers is accessed by Flush(), Start() and Stop() only.
+struct Tracer {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+  std::string filename;
+  std::size_t max_file_size = 0;
+  std::ofstream file;
+  std::size_t file_size = 0;
+  bool file_has_events = false;
+  /// Chrome's timestamps are relative, so the beginning of the trace is zero.
+  Clock::time_point epoch;
+
+  static Tracer& Instance() {
+    static Tracer instance;
+    return instance;
+  }
+
+  void OpenFile() {
+    file.open(filename, std::ios::trunc);
+    if (!file) throw std::runtime_error("ERROR. Failed to open trace file: " + filename);
+    file << "[";
+    file_size = 1;
+    file_has_events = false;
+  }
+
+  /// Trace viewers accept unfinished files too, but the closing bracket makes it a valid JSON.
+  void CloseFile() {
+    file << "\n]\n";
+    file.close();
+  }
+
+  void RotateIfNeeded() {
+    if (file_size < max_file_size) return;
+    CloseFile();
+    const auto previous = filename + ".1";
+    std::rename(filename.c_str(), previous.c_str());
+    OpenFile();
+  }
+};
+
+ThreadBuffer& GetThreadBuffer() {
+  thread_local const auto buffer = [] {
+    auto& tracer = Tracer::Instance();
+    std::lock_guard lock(tracer.mutex);
+    auto buffer = std::make_shared<ThreadBuffer>(static_cast<int>(tracer.buffers.size()) + 1);
+    tracer.buffers.push_back(buffer);
+    return buffer;
+  }();
+  return *buffer;
+}
+
+void WriteEscaped(std::string_view str, std::string& out) {
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += std::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      out += c;
+    }
+  }
+}
+
+/// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU ("Complete Events")
+void Serialize(const Event& event, int thread_id, Clock::time_point epoch, std::string& out) {
+  using Microseconds = std::chrono::duration<double, std::micro>;
+  out += ",\n";
+  out += std::format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f})",
+                     event.name, thread_id, Microseconds(event.start - epoch).count(),
+                     Microseconds(event.duration).count());
+  if (event.argument_length) {
+    out += R"(,"args":{"arg":")";
+    WriteEscaped({event.argument.data(), event.argument_length}, out);
+    out += "\"}";
+  }
+  out += '}';
+}
+
+}  // namespace
+
+
+void Start(const std::string& filename, std::size_t max_file_size) {
+  auto& tracer = Tracer::Instance();
+  std::lock_guard lock(tracer.mutex);
+  tracer.filename = filename;
+  tracer.max_file_size = max_file_size;
+  tracer.epoch = Clock::now();
+  tracer.OpenFile();
+  implementation_details::enabled = true;
+  spdlog::info("Tracing into {}", filename);
+}
+
+void Flush() {
+  if (!IsEnabled()) return;
+  auto& tracer = Tracer::Instance();
+  std::lock_guard lock(tracer.mutex);
+
+  std::string json;
+  for (const auto& buffer : tracer.buffers) {
+    const auto tail = buffer->tail.load(std::memory_order_relaxed);
+    const auto head = buffer->head.load(std::memory_order_acquire);
+    for (auto i = tail; i != head; ++i) {
+      Serialize(buffer->events[i % ThreadBuffer::kCapacity], buffer->thread_id, tracer.epoch, json);
+    }
+    buffer->tail.store(head, std::memory_order_release);
+
+    if (const auto dropped = buffer->dropped.exchange(0)) {
+      spdlog::warn("Trace buffer of thread {} is full, {} spans are lost", buffer->thread_id,
+                   dropped);
+    }
+  }
+
+  if (json.empty()) return;
+  // Every event is prepended with a comma, but the first one in the file shouldn't be.
+  const std::string_view events = tracer.file_has_events ? json : std::string_view(json).substr(1);
+  tracer.file_has_events = true;
+  tracer.file << events << std::flush;
+  tracer.file_size += json.size();
+  tracer.RotateIfNeeded();
+}
+
+void Stop() {
+  if (!IsEnabled()) return;
+  Flush();
+  implementation_details::enabled = false;
+  auto& tracer = Tracer::Instance();
+  std::lock_guard lock(tracer.mutex);
+  tracer.CloseFile();
+}
+
+namespace implementation_details {
+
+void Record(const char* name, std::string_view argument, Clock::time_point start,
+            Clock::time_point end) {
+  auto& buffer = GetThreadBuffer();
+  const auto head = buffer.head.load(std::memory_order_relaxed);
+  if (head - buffer.tail.load(std::memory_order_acquire) == ThreadBuffer::kCapacity) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto& event = buffer.events[head % ThreadBuffer::kCapacity];
+  if (argument.length() > kMaxArgumentLength) {
+    argument.remove_prefix(argument.length() - kMaxArgumentLength);
+  }
+  event.name = name;
+  event.start = start;
+  event.duration = end - start;
+  event.argument_length = static_cast<std::uint8_t>(argument.copy(event.argument.data(),
+                                                                  argument.length()));
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace implementation_details
+}  // namespace trace
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/// Low-overhead tracing of the poll cycle, written in Chrome trace-event format, so it can be
+/// opened in chrome://tracing or https://ui.perfetto.dev.
+/// Recording a span only stores its name and timestamps into a ring buffer of the current thread;
+/// spans are serialized to JSON later, by Flush(). When tracing is off, a span costs a single
+/// atomic load.
+namespace trace {
+
+/// Start tracing into @a filename. When the file grows over @a max_file_size, it is renamed to
+/// "<filename>.1" (replacing the previous one), and a new file is started.
+/// @throws std::runtime_error if the file can't be opened.
+void Start(const std::string& filename, std::size_t max_file_size = 16 * 1024 * 1024);
+
+/// Serialize the spans recorded so far into the file. Meant to be called periodically, e.g. once
+/// per poll cycle, from a place that isn't time-critical.
+void Flush();
+
+/// Flush() and finish the file, so it's a complete JSON document.
+void Stop();
+
+namespace implementation_details {
+
+inline std::atomic<bool> enabled = false;
+
+void Record(const char* name, std::string_view argument,
+            std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+
+}  // namespace implementation_details
+
+inline bool IsEnabled() {
+  return implementation_details::enabled.load(std::memory_order_relaxed);
+}
+
+/// Records the time between its construction and destruction, see TRACE_SPAN.
+class Span {
+ public:
+  /// @param name - must be a string literal (only the pointer is stored).
+  /// @param argument - is shown along with the span, e.g. the query. Must outlive the span. Only the
+  ///        last 32 characters are kept: the end is the most specific part, e.g. of MQTT topics.
+  explicit Span(const char* name, std::string_view argument = {}) {
+    if (IsEnabled()) {
+      name_ = name;
+      argument_ = argument;
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~Span() {
+    if (name_) {
+      implementation_details::Record(name_, argument_, start_, std::chrono::steady_clock::now());
+    }
+  }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+ private:
+  const char* name_ = nullptr;
+  std::string_view argument_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCATENATE_IMPL(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_IMPL(a, b)
+
+/// Trace the rest of the current scope, e.g. TRACE_SPAN("SerialPort::Send", query).
+#define TRACE_SPAN(...) trace::Span TRACE_CONCATENATE(trace_span_, __LINE__)(__VA_ARGS__)
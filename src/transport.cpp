@@ -0,0 +1,65 @@
+#include "transport.hh"
+
+#include <algorithm>
+#include <span>
+
+namespace {
+
+/// @param samples - will be reordered.
+std::chrono::microseconds GetPercentile(std::span<std::chrono::microseconds> samples,
+                                        int percentile) {
+  if (samples.empty()) return {};
+  const auto index = std::min(samples.size() - 1, samples.size() * percentile / 100);
+  std::ranges::nth_element(samples, samples.begin() + index);
+  return samples[index];
+}
+
+}  // namespace
+
+
+std::string_view Transport::GetCommandName(std::string_view query) {
+  const auto end = query.find_last_not_of("0123456789,.");
+  return query.substr(0, end == std::string_view::npos ? query.length() : end + 1);
+}
+
+void Transport::UpdateMetrics(std::string_view command, const QueryMetrics& query) const {
+  std::lock_guard lock(metrics_mutex_);
+  auto metrics = metrics_.find(command);
+  if (metrics == metrics_.end()) {
+    metrics = metrics_.emplace(command, QueryMetrics{}).first;
+  }
+  auto& total = metrics->second;
+  total.queries += query.queries;
+  total.attempts += query.attempts;
+  total.crc_errors += query.crc_errors;
+  total.timeouts += query.timeouts;
+  total.failures += query.failures;
+  total.total_latency += query.total_latency;
+  total.max_latency = std::max(total.max_latency, query.max_latency);
+  if (query.reply_length) {
+    total.reply_length = query.reply_length;
+  }
+
+  if (query.failures == 0) {
+    auto& window = latency_windows_[metrics->first];
+    window.samples[window.count++ % kLatencyWindow] = query.total_latency;
+  }
+}
+
+std::size_t Transport::GetLastReplyLength(std::string_view command) const {
+  std::lock_guard lock(metrics_mutex_);
+  const auto metrics = metrics_.find(command);
+  return metrics != metrics_.end() ? metrics->second.reply_length : 0;
+}
+
+std::map<std::string, QueryMetrics> Transport::GetMetrics() const {
+  std::lock_guard lock(metrics_mutex_);
+  std::map<std::string, QueryMetrics> result(metrics_.begin(), metrics_.end());
+  for (const auto& [command, window] : latency_windows_) {
+    auto samples = window.samples;
+    const std::span recent(samples.data(), std::min(window.count, kLatencyWindow));
+    result[command].p50_latency = GetPercentile(recent, 50);
+    result[command].p95_latency = GetPercentile(recent, 95);
+  }
+  return result;
+}
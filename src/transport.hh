@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "frame.hh"
+#include "frame_trace.hh"
+
+/// Statistics of queries of a particular command, see Transport::Query().
+struct QueryMetrics {
+  /// The number of Query() calls.
+  unsigned queries = 0;
+  /// The number of Send()+Receive() exchanges, including retries.
+  unsigned attempts = 0;
+  /// Replies with mismatched CRC or corrupted otherwise.
+  unsigned crc_errors = 0;
+  unsigned timeouts = 0;
+  /// Queries that failed even after all the retries.
+  unsigned failures = 0;
+  /// Total and maximum duration of successful queries (including retries).
+  std::chrono::microseconds total_latency{0};
+  std::chrono::microseconds max_latency{0};
+  /// Latency percentiles over the last Transport::kLatencyWindow successful queries.
+  std::chrono::microseconds p50_latency{0};
+  std::chrono::microseconds p95_latency{0};
+  /// Length of the last successful reply including CRC and carriage return.
+  std::size_t reply_length = 0;
+};
+
+/// Is notified of the queries made via a Transport, e.g. to share their replies with other consumers
+/// (see ResponseCache). It's called on the querying thread, so it must be fast.
+class QueryObserver {
+ public:
+  virtual ~QueryObserver() = default;
+
+  /// @a query is about to be sent. The transport makes one query at a time, so it's always
+  /// followed by OnQueryFinished() of the same query before the next one starts.
+  virtual void OnQueryStarted(std::string_view query) = 0;
+  /// @param reply - nullptr if the query has failed (after all the retries).
+  virtual void OnQueryFinished(std::string_view query, const std::string* reply) = 0;
+};
+
+/// Delivers queries to the inverter and brings its replies back: either a real device (SerialPort)
+/// or a recorded session (ReplayTransport).
+class Transport {
+ public:
+  static constexpr std::size_t kLatencyWindow = 64;
+
+  virtual ~Transport() = default;
+
+  /// Send @a query and receive the reply, retrying on CRC mismatch, corrupted reply or timeout.
+  /// This function is thread-safe.
+  /// @param query - the query to be send. Should be without carriage return (<cr>) and crc.
+  /// @param with_crc - if set, generate and append crc bytes to the query.
+  /// @param expected_reply_length - the length of the reply including CRC and carriage return. Is
+  ///        used to figure out how long to wait for the reply. If unknown (0), then the length of
+  ///        the previous reply to the same command is used.
+  /// @returns the reply, excluding CRC and carriage return (<cr>).
+  virtual std::string Query(std::string_view query, bool with_crc,
+                            std::size_t expected_reply_length = 0) const = 0;
+
+  /// @returns the command without arguments, e.g. "^S007POP" for "^S007POP1". Queries with
+  ///          different arguments behave the same way, so they are accounted together.
+  static std::string_view GetCommandName(std::string_view query);
+
+  /// @returns statistics of queries, grouped by commands (i.e. queries without arguments).
+  std::map<std::string, QueryMetrics> GetMetrics() const;
+
+  /// @returns the recent frames sent and received by this transport.
+  FrameTrace& GetFrameTrace() const { return frame_trace_; }
+
+  /// @a observer is notified of every query, it must outlive the transport or be reset.
+  /// Must be set before the transport is shared between threads.
+  void SetQueryObserver(QueryObserver* observer) { query_observer_ = observer; }
+
+  /// Replies are expected to end with CRC, unless the inverter is talked to with CHK (see
+  /// console::Framing). Must be set before the transport is shared between threads.
+  void SetReplyChecksum(frame::Checksum checksum) { reply_checksum_ = checksum; }
+
+ protected:
+  /// Reports a query to the observer (see SetQueryObserver()): its start on construction, and its
+  /// failure on destruction, unless it has succeeded. Implementations keep it for the duration of
+  /// each query, so that every way a query may fail is reported.
+  class ObservedQuery {
+   public:
+    ObservedQuery(const Transport& transport, std::string_view query)
+        : observer_(transport.query_observer_), query_(query) {
+      if (observer_) observer_->OnQueryStarted(query_);
+    }
+    ~ObservedQuery() {
+      if (observer_) observer_->OnQueryFinished(query_, nullptr);
+    }
+    ObservedQuery(const ObservedQuery&) = delete;
+    ObservedQuery& operator=(const ObservedQuery&) = delete;
+
+    void Succeed(const std::string& reply) {
+      if (observer_) observer_->OnQueryFinished(query_, &reply);
+      observer_ = nullptr;
+    }
+
+   private:
+    QueryObserver* observer_;
+    const std::string query_;
+  };
+
+  void UpdateMetrics(std::string_view command, const QueryMetrics&) const;
+
+  /// @returns the length of the last successful reply to @a command, or 0 if there was none.
+  std::size_t GetLastReplyLength(std::string_view command) const;
+
+  frame::Checksum GetReplyChecksum() const { return reply_checksum_; }
+
+ private:
+  /// Latencies of the recent successful queries, a ring buffer.
+  struct LatencyWindow {
+    std::array<std::chrono::microseconds, kLatencyWindow> samples;
+    std::size_t count = 0;
+  };
+
+  mutable FrameTrace frame_trace_;
+  QueryObserver* query_observer_ = nullptr;
+  frame::Checksum reply_checksum_ = frame::Checksum::kCrc;
+  mutable std::mutex metrics_mutex_;
+  mutable std::map<std::string, QueryMetrics, std::less<>> metrics_;
+  mutable std::map<std::string, LatencyWindow, std::less<>> latency_windows_;
+};
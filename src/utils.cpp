@@ -1,8 +1,13 @@
 #include "utils.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
 #include <cstdio>
 #include <format>
 #include <stdexcept>
+#include <system_error>
 
 
 namespace utils {
@@ -10,51 +15,68 @@ namespace utils {
 std::string PrintBytesAsHex(std::string_view str) {
   // Each input symbol will be turned into 2 hex symbols + whitespace
   std::string result;
-  result.reserve(str.length() * 3 - 1);
-  char buffer[20];
-  for (std::size_t i = 0; i < str.length(); ++i) {
-    sprintf(buffer, "%02x", str[i]);
-    if (i != 0) {
-      result += ' ';
-    }
-    result += buffer[0];
-    result += buffer[1];
-  }
+  result.reserve(str.length() * 3);
+  WriteBytesAsHex(str, std::back_inserter(result));
   return result;
 }
 
 std::string EscapeString(std::string_view src) {
-  static constexpr char kHexChar[] = "0123456789abcdef";
-
   std::string dest;
-  bool last_hex_escape = false;  // true if last output char was \xNN.
+  dest.reserve(src.length());
+  WriteEscaped(src, std::back_inserter(dest));
+  return dest;
+}
 
-  for (char c : src) {
-    bool is_hex_escape = false;
-    switch (c) {
-      case '\n': dest.append("\\" "n"); break;
-      case '\r': dest.append("\\" "r"); break;
-      case '\t': dest.append("\\" "t"); break;
-      case '\"': dest.append("\\" "\""); break;
-      case '\'': dest.append("\\" "'"); break;
-      case '\\': dest.append("\\" "\\"); break;
-      default:
-        // Note that if we emit \xNN and the src character after that is a hex
-        // digit then that digit must be escaped too to prevent it being
-        // interpreted as part of the character code by C.
-        if ((c < 0x80) && (!isprint(c) || (last_hex_escape && isxdigit(c)))) {
-          dest.append("\\" "x");
-          dest.push_back(kHexChar[c / 16]);
-          dest.push_back(kHexChar[c % 16]);
-          is_hex_escape = true;
-        } else {
-          dest.push_back(c);
-        }
+namespace {
+
+[[noreturn]] void ThrowSystemError(const std::filesystem::path& filename) {
+  throw std::system_error(errno, std::generic_category(), filename.string());
+}
+
+/// Make the data of @a fd durable and close it.
+void SyncAndClose(int fd, const std::filesystem::path& filename) {
+  if (fsync(fd) != 0) {
+    const auto error = errno;
+    close(fd);
+    errno = error;
+    ThrowSystemError(filename);
+  }
+  if (close(fd) != 0) ThrowSystemError(filename);
+}
+
+}  // namespace
+
+void ReplaceFile(const std::filesystem::path& filename, std::string_view content) {
+  auto temporary = filename;
+  temporary += ".tmp";
+  const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) ThrowSystemError(temporary);
+  while (!content.empty()) {
+    const auto n_bytes = write(fd, content.data(), content.size());
+    if (n_bytes < 0 && errno == EINTR) continue;
+    if (n_bytes < 0) {
+      const auto error = errno;
+      close(fd);
+      unlink(temporary.c_str());
+      errno = error;
+      ThrowSystemError(temporary);
     }
-    last_hex_escape = is_hex_escape;
+    content.remove_prefix(n_bytes);
+  }
+  try {
+    SyncAndClose(fd, temporary);
+  } catch (const std::system_error&) {
+    unlink(temporary.c_str());
+    throw;
   }
+  if (std::rename(temporary.c_str(), filename.c_str()) != 0) ThrowSystemError(filename);
 
-  return dest;
+  // The rename itself is durable only when the directory is synced.
+  const auto directory = filename.has_parent_path() ? filename.parent_path()
+                                                    : std::filesystem::path(".");
+  const int directory_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directory_fd < 0) ThrowSystemError(directory);
+  SyncAndClose(directory_fd, directory);
 }
 
 unsigned AsDigit(char c) {
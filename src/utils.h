@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cctype>
+#include <filesystem>
 #include <format>
+#include <iterator>
 #include <string>
 #include <string_view>
 #include <span>
@@ -8,7 +11,64 @@
 
 namespace utils {
 
+/// Writes each byte of @a str as 2 hex digits, separated by whitespaces.
+template<typename OutputIterator>
+OutputIterator WriteBytesAsHex(std::string_view str, OutputIterator out) {
+  static constexpr char kHexChar[] = "0123456789abcdef";
+  for (std::size_t i = 0; i < str.length(); ++i) {
+    if (i != 0) {
+      *out++ = ' ';
+    }
+    const auto c = static_cast<unsigned char>(str[i]);
+    *out++ = kHexChar[c >> 4];
+    *out++ = kHexChar[c & 0xf];
+  }
+  return out;
+}
+
+/// Writes @a src escaping special and non-printable characters C-style.
+template<typename OutputIterator>
+OutputIterator WriteEscaped(std::string_view src, OutputIterator out) {
+  static constexpr char kHexChar[] = "0123456789abcdef";
+  const auto append = [&out](std::string_view s) {
+    for (char c : s) *out++ = c;
+  };
+
+  bool last_hex_escape = false;  // true if last output char was \xNN.
+  for (char c : src) {
+    bool is_hex_escape = false;
+    switch (c) {
+      case '\n': append("\\" "n"); break;
+      case '\r': append("\\" "r"); break;
+      case '\t': append("\\" "t"); break;
+      case '\"': append("\\" "\""); break;
+      case '\'': append("\\" "'"); break;
+      case '\\': append("\\" "\\"); break;
+      default: {
+        // Note that if we emit \xNN and the src character after that is a hex
+        // digit then that digit must be escaped too to prevent it being
+        // interpreted as part of the character code by C.
+        const auto byte = static_cast<unsigned char>(c);
+        if ((byte < 0x80) && (!isprint(byte) || (last_hex_escape && isxdigit(byte)))) {
+          append("\\" "x");
+          *out++ = kHexChar[byte / 16];
+          *out++ = kHexChar[byte % 16];
+          is_hex_escape = true;
+        } else {
+          *out++ = c;
+        }
+      }
+    }
+    last_hex_escape = is_hex_escape;
+  }
+  return out;
+}
+
 std::string PrintBytesAsHex(std::string_view str);
+/// Replace the file @a filename with @a content, so that it has either the old content or the new
+/// one, even if the power fails in the middle: a copy is written and synced, then renamed over.
+/// @throws std::system_error if anything fails, the file is left untouched then.
+void ReplaceFile(const std::filesystem::path& filename, std::string_view content);
 std::string EscapeString(std::string_view src);
 unsigned AsDigit(char);
 